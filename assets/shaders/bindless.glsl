@@ -0,0 +1,20 @@
+// Global bindless heap, see VulkanBindlessHeap. Resources are referenced by the slot handed out on creation.
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform texture2D bindlessTextures[];
+layout(set = 0, binding = 1) uniform sampler bindlessSamplers[];
+
+// Storage buffers alias the same binding, declare one view per element type:
+// BINDLESS_BUFFER(Instance, instanceBuffers);
+// ... instanceBuffers[nonuniformEXT(slot)].data[i]
+#define BINDLESS_BUFFER(Type, name) \
+    layout(std430, set = 0, binding = 2) buffer name##_block { Type data[]; } name[]
+
+vec4 bindlessSample(uint textureSlot, uint samplerSlot, vec2 uv) {
+    return texture(sampler2D(bindlessTextures[nonuniformEXT(textureSlot)], bindlessSamplers[nonuniformEXT(samplerSlot)]), uv);
+}
+
+// Storage images need their format, declare one array per format:
+// BINDLESS_STORAGE_IMAGE(r32f, image2D, depthPyramidMips);
+#define BINDLESS_STORAGE_IMAGE(Format, Type, name) \
+    layout(Format, set = 0, binding = 3) uniform Type name[]
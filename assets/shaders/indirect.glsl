@@ -0,0 +1,35 @@
+// Layouts shared with VulkanIndirectRenderer, include after bindless.glsl
+
+// IndirectDrawObject
+struct DrawObject {
+    // World space center and radius
+    vec4 boundingSphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    // Becomes firstInstance, the vertex shader finds the object's data through gl_InstanceIndex
+    uint instanceIndex;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// Rewritten every frame before culling
+struct CullView {
+    mat4 viewProjection;
+    // xyz normal pointing inside, w distance
+    vec4 frustumPlanes[6];
+};
+
+BINDLESS_BUFFER(DrawObject, drawObjects);
+BINDLESS_BUFFER(DrawCommand, drawCommands);
+BINDLESS_BUFFER(uint, drawCounts);
+BINDLESS_BUFFER(CullView, cullViews);
+// One per object, 1 when it was drawn last frame
+BINDLESS_BUFFER(uint, objectVisibilities);
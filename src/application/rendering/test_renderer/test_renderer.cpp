@@ -21,24 +21,13 @@ TestRenderer::TestRenderer(engine::renderer::VulkanRenderer *renderer) : m_rende
   };
 
   engine::renderer::BufferDesc bufferDesc = {
-      .usage = engine::renderer::BufferUsage::VERTEX_BUFFER | engine::renderer::BufferUsage::TRANSFER_DESTINATION,
-      .cpuAccess = engine::renderer::BufferCPUAccess::ReadOnly,
+      .usage = engine::renderer::BufferUsage::VERTEX_BUFFER,
+      .cpuAccess = engine::renderer::BufferCPUAccess::WriteDeviceLocal,
       .size = vertices.size() * sizeof(Vertex),
   };
 
-  engine::renderer::BufferDesc stagingBufferDesc = {
-      .usage = engine::renderer::BufferUsage::TRANSFER_SOURCE,
-      .cpuAccess = engine::renderer::BufferCPUAccess::WriteOnly,
-      .size = bufferDesc.size,
-  };
-
   m_vertexBufferId = m_renderer->createBuffer(bufferDesc);
-  auto stagingBufferId = m_renderer->createBuffer(stagingBufferDesc);
-  m_renderer->writeToBuffer(stagingBufferId, vertices.data(), bufferDesc.size);
-
-  VkCommandBuffer commandBuffer = m_renderer->beginSingleTimeCommands();
-  m_renderer->copyBuffer(commandBuffer, m_vertexBufferId, 0, stagingBufferId, 0, bufferDesc.size);
-  m_renderer->endSingleTimeCommands(commandBuffer);
+  m_renderer->writeToBuffer(m_vertexBufferId, vertices.data(), bufferDesc.size);
 }
 
 TestRenderer::~TestRenderer() {
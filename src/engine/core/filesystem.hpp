@@ -2,7 +2,10 @@
 
 #include <array>
 #include <filesystem>
+#include <fstream>
+#include <span>
 #include <stdexcept>
+#include <vector>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -40,4 +43,44 @@ inline std::filesystem::path getAbsolutePath(const std::filesystem::path &path)
 {
   return getExecutablePath().parent_path() / path;
 }
+
+// Location for data the engine regenerates when missing (pipeline caches, shader binaries, ...)
+inline std::filesystem::path getCachePath(const std::filesystem::path &path)
+{
+  return getExecutablePath().parent_path() / "cache" / path;
+}
+
+// Returns an empty vector when the file doesn't exist or can't be read
+inline std::vector<char> readBinaryFile(const std::filesystem::path &path)
+{
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) { return {}; }
+
+  std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  if (!file) { return {}; }
+
+  return buffer;
+}
+
+// Writes through a temporary file, so a crash never leaves a truncated file behind
+inline bool writeBinaryFile(const std::filesystem::path &path, std::span<const char> data)
+{
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error) { return false; }
+
+  std::filesystem::path tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) { return false; }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) { return false; }
+  }
+
+  std::filesystem::rename(tmpPath, path, error);
+  return !error;
+}
 }// namespace engine::core
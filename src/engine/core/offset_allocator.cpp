@@ -0,0 +1,245 @@
+#include "offset_allocator.hpp"
+#include <bit>
+#include <engine/core/assert.hpp>
+
+namespace engine::core {
+namespace {
+  constexpr uint32_t MANTISSA_BITS = 3;
+  constexpr uint32_t MANTISSA_VALUE = 1 << MANTISSA_BITS;
+  constexpr uint32_t MANTISSA_MASK = MANTISSA_VALUE - 1;
+
+  // Sizes are binned as a float with a 3 bit mantissa and a 5 bit exponent, sizes below 8 are denormals mapping to
+  // their own bin. Free regions are filed rounding down, so every region in a bin is at least the bin's size, and
+  // requests look from the bin rounding up, so any region found fits.
+  uint32_t uintToFloatRoundUp(uint32_t size)
+  {
+    if (size < MANTISSA_VALUE) { return size; }
+
+    const uint32_t highestSetBit = 31 - std::countl_zero(size);
+    const uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+    const uint32_t exponent = mantissaStartBit + 1;
+    uint32_t mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+
+    const uint32_t lowBitsMask = (1u << mantissaStartBit) - 1;
+    if ((size & lowBitsMask) != 0) { mantissa++; }
+
+    // A mantissa overflow carries into the exponent
+    return (exponent << MANTISSA_BITS) + mantissa;
+  }
+
+  uint32_t uintToFloatRoundDown(uint32_t size)
+  {
+    if (size < MANTISSA_VALUE) { return size; }
+
+    const uint32_t highestSetBit = 31 - std::countl_zero(size);
+    const uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+    const uint32_t exponent = mantissaStartBit + 1;
+    const uint32_t mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+    return (exponent << MANTISSA_BITS) | mantissa;
+  }
+
+  uint32_t floatToUint(uint32_t floatValue)
+  {
+    const uint32_t exponent = floatValue >> MANTISSA_BITS;
+    const uint32_t mantissa = floatValue & MANTISSA_MASK;
+    if (exponent == 0) { return mantissa; }
+    return (mantissa | MANTISSA_VALUE) << (exponent - 1);
+  }
+
+  uint32_t findLowestSetBitAfter(uint32_t bitMask, uint32_t startBitIndex)
+  {
+    if (startBitIndex >= 32) { return OffsetAllocator::NO_SPACE; }
+    const uint32_t maskAfterStart = bitMask & ~((1u << startBitIndex) - 1);
+    if (maskAfterStart == 0) { return OffsetAllocator::NO_SPACE; }
+    return std::countr_zero(maskAfterStart);
+  }
+}// namespace
+
+OffsetAllocator::OffsetAllocator(uint32_t size, uint32_t maxAllocations)
+  : m_size{ size }, m_maxAllocations{ maxAllocations }
+{
+  reset();
+}
+
+void OffsetAllocator::reset()
+{
+  m_freeStorage = 0;
+  m_usedBinsTop = 0;
+  m_usedBins.fill(0);
+  m_binIndices.fill(UNUSED);
+
+  m_nodes.assign(m_maxAllocations, Node{});
+  m_freeNodes.resize(m_maxAllocations);
+  // Popped from the back, so node 0 is used first
+  for (uint32_t i = 0; i < m_maxAllocations; i++) { m_freeNodes[i] = m_maxAllocations - i - 1; }
+
+  // Starts as one free region covering everything
+  insertNodeIntoBin(m_size, 0);
+}
+
+OffsetAllocator::Allocation OffsetAllocator::allocate(uint32_t size)
+{
+  // The remainder of the region found needs a node of its own
+  if (m_freeNodes.empty() || size == 0) { return {}; }
+
+  const uint32_t minBinIndex = uintToFloatRoundUp(size);
+  const uint32_t minTopBinIndex = minBinIndex >> MANTISSA_BITS;
+  const uint32_t minLeafBinIndex = minBinIndex & MANTISSA_MASK;
+
+  uint32_t topBinIndex = minTopBinIndex;
+  uint32_t leafBinIndex = NO_SPACE;
+
+  // Bins of the same exponent that are large enough, then the smallest larger exponent with anything in it
+  if (minTopBinIndex < TOP_BIN_COUNT && (m_usedBinsTop & (1u << topBinIndex))) {
+    leafBinIndex = findLowestSetBitAfter(m_usedBins[topBinIndex], minLeafBinIndex);
+  }
+  if (leafBinIndex == NO_SPACE) {
+    topBinIndex = findLowestSetBitAfter(m_usedBinsTop, minTopBinIndex + 1);
+    if (topBinIndex == NO_SPACE) { return {}; }
+    leafBinIndex = std::countr_zero(m_usedBins[topBinIndex]);
+  }
+
+  const uint32_t binIndex = (topBinIndex << MANTISSA_BITS) | leafBinIndex;
+
+  // Takes the head of the bin's list
+  const uint32_t nodeIndex = m_binIndices[binIndex];
+  Node &node = m_nodes[nodeIndex];
+  const uint32_t nodeTotalSize = node.dataSize;
+  node.dataSize = size;
+  node.used = true;
+  m_binIndices[binIndex] = node.binListNext;
+  if (node.binListNext != UNUSED) { m_nodes[node.binListNext].binListPrev = UNUSED; }
+  m_freeStorage -= nodeTotalSize;
+
+  if (m_binIndices[binIndex] == UNUSED) {
+    m_usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+    if (m_usedBins[topBinIndex] == 0) { m_usedBinsTop &= ~(1u << topBinIndex); }
+  }
+
+  // What's left of the region goes back to the bins, right after the allocation
+  const uint32_t remainder = nodeTotalSize - size;
+  if (remainder > 0) {
+    const uint32_t newNodeIndex = insertNodeIntoBin(remainder, node.dataOffset + size);
+
+    if (node.neighborNext != UNUSED) { m_nodes[node.neighborNext].neighborPrev = newNodeIndex; }
+    m_nodes[newNodeIndex].neighborPrev = nodeIndex;
+    m_nodes[newNodeIndex].neighborNext = node.neighborNext;
+    node.neighborNext = newNodeIndex;
+  }
+
+  return { .offset = node.dataOffset, .metadata = nodeIndex };
+}
+
+void OffsetAllocator::free(Allocation allocation)
+{
+  core::assertion(allocation.metadata < m_maxAllocations, "Invalid allocation");
+
+  const uint32_t nodeIndex = allocation.metadata;
+  Node &node = m_nodes[nodeIndex];
+  core::assertion(node.used, "Allocation at offset {} freed twice", allocation.offset);
+
+  uint32_t offset = node.dataOffset;
+  uint32_t size = node.dataSize;
+
+  // Merges with free neighbours, their nodes are released
+  if (node.neighborPrev != UNUSED && !m_nodes[node.neighborPrev].used) {
+    const Node &prevNode = m_nodes[node.neighborPrev];
+    offset = prevNode.dataOffset;
+    size += prevNode.dataSize;
+
+    removeNodeFromBin(node.neighborPrev);
+    node.neighborPrev = prevNode.neighborPrev;
+  }
+
+  if (node.neighborNext != UNUSED && !m_nodes[node.neighborNext].used) {
+    const Node &nextNode = m_nodes[node.neighborNext];
+    size += nextNode.dataSize;
+
+    removeNodeFromBin(node.neighborNext);
+    node.neighborNext = nextNode.neighborNext;
+  }
+
+  const uint32_t neighborNext = node.neighborNext;
+  const uint32_t neighborPrev = node.neighborPrev;
+
+  node = Node{};
+  m_freeNodes.push_back(nodeIndex);
+
+  const uint32_t combinedNodeIndex = insertNodeIntoBin(size, offset);
+  if (neighborNext != UNUSED) {
+    m_nodes[combinedNodeIndex].neighborNext = neighborNext;
+    m_nodes[neighborNext].neighborPrev = combinedNodeIndex;
+  }
+  if (neighborPrev != UNUSED) {
+    m_nodes[combinedNodeIndex].neighborPrev = neighborPrev;
+    m_nodes[neighborPrev].neighborNext = combinedNodeIndex;
+  }
+}
+
+uint32_t OffsetAllocator::insertNodeIntoBin(uint32_t size, uint32_t dataOffset)
+{
+  const uint32_t binIndex = uintToFloatRoundDown(size);
+  const uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+  const uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+  if (m_binIndices[binIndex] == UNUSED) {
+    m_usedBins[topBinIndex] |= 1u << leafBinIndex;
+    m_usedBinsTop |= 1u << topBinIndex;
+  }
+
+  const uint32_t topNodeIndex = m_binIndices[binIndex];
+  const uint32_t nodeIndex = m_freeNodes.back();
+  m_freeNodes.pop_back();
+
+  m_nodes[nodeIndex] = { .dataOffset = dataOffset, .dataSize = size, .binListNext = topNodeIndex };
+  if (topNodeIndex != UNUSED) { m_nodes[topNodeIndex].binListPrev = nodeIndex; }
+  m_binIndices[binIndex] = nodeIndex;
+
+  m_freeStorage += size;
+  return nodeIndex;
+}
+
+void OffsetAllocator::removeNodeFromBin(uint32_t nodeIndex)
+{
+  Node &node = m_nodes[nodeIndex];
+
+  if (node.binListPrev != UNUSED) {
+    // Inside the list, the bin keeps its head
+    m_nodes[node.binListPrev].binListNext = node.binListNext;
+    if (node.binListNext != UNUSED) { m_nodes[node.binListNext].binListPrev = node.binListPrev; }
+  } else {
+    const uint32_t binIndex = uintToFloatRoundDown(node.dataSize);
+    const uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+    const uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+    m_binIndices[binIndex] = node.binListNext;
+    if (node.binListNext != UNUSED) { m_nodes[node.binListNext].binListPrev = UNUSED; }
+
+    if (m_binIndices[binIndex] == UNUSED) {
+      m_usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+      if (m_usedBins[topBinIndex] == 0) { m_usedBinsTop &= ~(1u << topBinIndex); }
+    }
+  }
+
+  m_freeStorage -= node.dataSize;
+  m_freeNodes.push_back(nodeIndex);
+}
+
+uint32_t OffsetAllocator::getAllocationSize(Allocation allocation) const
+{
+  if (!allocation.isValid()) { return 0; }
+  return m_nodes[allocation.metadata].dataSize;
+}
+
+OffsetAllocator::StorageReport OffsetAllocator::getStorageReport() const
+{
+  uint32_t largestFreeRegion = 0;
+  if (m_usedBinsTop != 0 && !m_freeNodes.empty()) {
+    const uint32_t topBinIndex = 31 - std::countl_zero(m_usedBinsTop);
+    const uint32_t leafBinIndex = 31 - std::countl_zero(static_cast<uint32_t>(m_usedBins[topBinIndex]));
+    largestFreeRegion = floatToUint((topBinIndex << MANTISSA_BITS) | leafBinIndex);
+  }
+
+  return { .totalFreeSpace = m_freeNodes.empty() ? 0 : m_freeStorage, .largestFreeRegion = largestFreeRegion };
+}
+}// namespace engine::core
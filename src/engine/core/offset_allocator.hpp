@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace engine::core {
+// Two level segregated fit allocator of ranges inside an externally owned resource (a buffer, a descriptor array). It
+// never touches the memory itself, it only hands out offsets. Free regions are binned by a small float of their size
+// (3 bit mantissa), two levels of bitmasks find a bin large enough in O(1), and freeing merges the region with its free
+// neighbours right away, so the address space doesn't fragment into unusable slivers.
+class OffsetAllocator
+{
+public:
+  static constexpr uint32_t NO_SPACE = std::numeric_limits<uint32_t>::max();
+
+  struct Allocation
+  {
+    uint32_t offset = NO_SPACE;
+    // Node backing the allocation, needed to free it
+    uint32_t metadata = NO_SPACE;
+
+    inline bool isValid() const noexcept { return offset != NO_SPACE; }
+  };
+
+  struct StorageReport
+  {
+    uint32_t totalFreeSpace;
+    // Lower bound, regions are only tracked by bin
+    uint32_t largestFreeRegion;
+  };
+
+public:
+  // maxAllocations bounds the live allocations plus the free regions between them
+  OffsetAllocator(uint32_t size, uint32_t maxAllocations = 128 * 1024);
+
+  // Returns an invalid allocation when no free region is large enough
+  Allocation allocate(uint32_t size);
+  void free(Allocation allocation);
+  void reset();
+
+  uint32_t getAllocationSize(Allocation allocation) const;
+  StorageReport getStorageReport() const;
+  inline uint32_t getSize() const noexcept { return m_size; }
+
+private:
+  static constexpr uint32_t TOP_BIN_COUNT = 32;
+  static constexpr uint32_t BINS_PER_LEAF = 8;
+  static constexpr uint32_t LEAF_BIN_COUNT = TOP_BIN_COUNT * BINS_PER_LEAF;
+  static constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+
+  struct Node
+  {
+    uint32_t dataOffset = 0;
+    uint32_t dataSize = 0;
+    // Free regions of the same bin
+    uint32_t binListPrev = UNUSED;
+    uint32_t binListNext = UNUSED;
+    // Adjacent regions in the address space, free or not
+    uint32_t neighborPrev = UNUSED;
+    uint32_t neighborNext = UNUSED;
+    bool used = false;
+  };
+
+  uint32_t insertNodeIntoBin(uint32_t size, uint32_t dataOffset);
+  void removeNodeFromBin(uint32_t nodeIndex);
+
+private:
+  uint32_t m_size;
+  uint32_t m_maxAllocations;
+  uint32_t m_freeStorage = 0;
+
+  uint32_t m_usedBinsTop = 0;
+  std::array<uint8_t, TOP_BIN_COUNT> m_usedBins{};
+  // Head of each bin's list of free regions
+  std::array<uint32_t, LEAF_BIN_COUNT> m_binIndices{};
+
+  std::vector<Node> m_nodes;
+  // Stack of unused node indices
+  std::vector<uint32_t> m_freeNodes;
+};
+}// namespace engine::core
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace engine::core {
+// Bounded queue for exactly one producer thread and one consumer thread. Neither side ever takes a lock: each owns one
+// index and only reads the other's. A side that finds the queue full (or empty) blocks on the other's index with
+// atomic wait, which the other side notifies after every push (or pop).
+template<typename T, size_t Capacity> class SpscQueue
+{
+public:
+  static_assert(Capacity > 0);
+
+  // Producer only, blocks while the queue is full
+  void push(T value)
+  {
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    for (size_t head = m_head.load(std::memory_order_acquire); tail - head == Capacity;
+         head = m_head.load(std::memory_order_acquire)) {
+      m_head.wait(head, std::memory_order_acquire);
+    }
+
+    m_items[tail % Capacity] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_tail.notify_one();
+  }
+
+  // Consumer only, blocks while the queue is empty
+  T pop()
+  {
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    for (size_t tail = m_tail.load(std::memory_order_acquire); tail == head;
+         tail = m_tail.load(std::memory_order_acquire)) {
+      m_tail.wait(tail, std::memory_order_acquire);
+    }
+
+    T value = std::move(m_items[head % Capacity]);
+    m_head.store(head + 1, std::memory_order_release);
+    m_head.notify_one();
+    return value;
+  }
+
+  // Exact from either side for its own end, a snapshot otherwise
+  inline size_t size() const noexcept
+  {
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, Capacity> m_items = {};
+  // Separate cache lines, each is written by one thread and polled by the other
+  alignas(64) std::atomic<size_t> m_head = 0;
+  alignas(64) std::atomic<size_t> m_tail = 0;
+};
+}// namespace engine::core
@@ -82,12 +82,16 @@ struct RTBlendState {
 
   LogicOp logicOp = LogicOp::NoOp;
   uint8_t renderTargetWriteMask = ColorWriteEnable::All;
+
+  bool operator==(const RTBlendState &) const = default;
 };
 
 struct BlendState {
   bool alphaToCoverageEnable = false;
   bool independentBlendEnable = false;
   RTBlendState renderTargets[MAX_RENDER_TARGETS];
+
+  bool operator==(const BlendState &) const = default;
 };
 
 enum class FillMode { Solid = VK_POLYGON_MODE_FILL, Wireframe = VK_POLYGON_MODE_LINE };
@@ -116,6 +120,8 @@ struct RasterizerState {
   float depthBiasSlopeFactor = 0.0f;
   SampleCount sampleCount = SampleCount::SampleCount1;
   bool depthClampEnabled = false;
+
+  bool operator==(const RasterizerState &) const = default;
 };
 
 enum class PrimitiveTopology {
@@ -159,6 +165,8 @@ struct DepthStencilOpDesc {
   StencilOp stencilDepthFailOp = StencilOp::Keep;
   StencilOp stencilPassOp = StencilOp::Keep;
   ComparisonFunc stencilFunc = ComparisonFunc::Always;
+
+  bool operator==(const DepthStencilOpDesc &) const = default;
 };
 
 struct DepthStencilState {
@@ -170,6 +178,8 @@ struct DepthStencilState {
   uint8_t stencilWriteMask = 255;
   DepthStencilOpDesc frontFace;
   DepthStencilOpDesc backFace;
+
+  bool operator==(const DepthStencilState &) const = default;
 };
 
 enum class InputFormat {
@@ -233,6 +243,8 @@ struct GraphicsPipelineDesc {
   DepthStencilState depthStencilState;
   BlendState blendState;
   DepthImageFormat depthImageFormat = DepthImageFormat::Unknown;
+
+  bool operator==(const GraphicsPipelineDesc &) const = default;
 };
 } // namespace renderer
 } // namespace engine
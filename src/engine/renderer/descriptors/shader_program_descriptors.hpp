@@ -1,6 +1,9 @@
 #pragma once
 
 #include "engine/renderer/vulkan/vulkan_shader_manager.hpp"
+#include <engine/renderer/descriptors/pipeline_descriptors.hpp>
+#include <engine/renderer/vulkan/vulkan_dynamic_state.hpp>
+#include <array>
 #include <optional>
 #include <vulkan/vulkan.hpp>
 
@@ -11,14 +14,31 @@ struct ShaderProgramId {
 struct VulkanShaderProgramDesc {
   std::optional<std::vector<char>> vertexSpirv;
   std::optional<std::vector<char>> fragmentSpirv;
+  // Mutually exclusive with the graphics stages
+  std::optional<std::vector<char>> computeSpirv;
+  std::array<uint32_t, 3> workgroupSize = {1, 1, 1};
   std::vector<vk::VertexInputAttributeDescription2EXT> attributes;
   std::vector<vk::VertexInputBindingDescription2EXT> bindings;
+  // From VulkanPipelineLayoutCache, shared with other programs and not owned by the program
   std::vector<vk::DescriptorSetLayout> setLayouts;
+  vk::PipelineLayout pipelineLayout;
   std::vector<BindInfoPushConstant> pushConstants;
+  DynamicStateBlock state;
 };
 
 struct ShaderProgramDesc {
   size_t vertexShaderId;
   size_t fragmentShaderId;
+
+  PrimitiveTopology primitiveTopology = PrimitiveTopology::TriangleList;
+  RasterizerState rasterizerState = {.cullMode = CullMode::None, .frontFaceMode = FrontFaceState::CounterClockwise};
+  DepthStencilState depthStencilState = {
+      .depthEnable = true, .depthWriteEnable = true, .depthFunc = ComparisonFunc::LessEqual};
+  BlendState blendState;
+  uint32_t colorAttachmentCount = 1;
+};
+
+struct ComputeProgramDesc {
+  size_t computeShaderId;
 };
 } // namespace engine::renderer
\ No newline at end of file
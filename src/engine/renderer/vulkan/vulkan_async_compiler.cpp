@@ -0,0 +1,61 @@
+#include "vulkan_async_compiler.hpp"
+#include <algorithm>
+#include <engine/core/logger.hpp>
+
+namespace engine::renderer {
+VulkanAsyncCompiler::VulkanAsyncCompiler(uint32_t threadCount)
+{
+  if (threadCount == 0) { threadCount = std::max(1u, std::thread::hardware_concurrency() / 2); }
+
+  m_threads.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; i++) {
+    m_threads.emplace_back([this](std::stop_token stopToken) { run(stopToken); });
+  }
+  core::Logger::info("Compiling shaders and pipelines on {} background threads", threadCount);
+}
+
+VulkanAsyncCompiler::~VulkanAsyncCompiler()
+{
+  waitIdle();
+  for (std::jthread &thread : m_threads) { thread.request_stop(); }
+  // The jthreads join when m_threads is destroyed
+}
+
+void VulkanAsyncCompiler::submit(Job job)
+{
+  {
+    std::lock_guard lock{ m_mutex };
+    m_jobs.push_back(std::move(job));
+  }
+  m_jobAvailable.notify_one();
+}
+
+void VulkanAsyncCompiler::waitIdle()
+{
+  std::unique_lock lock{ m_mutex };
+  m_idle.wait(lock, [this] { return m_jobs.empty() && m_runningCount == 0; });
+}
+
+size_t VulkanAsyncCompiler::getPendingCount() const
+{
+  std::lock_guard lock{ m_mutex };
+  return m_jobs.size() + m_runningCount;
+}
+
+void VulkanAsyncCompiler::run(std::stop_token stopToken)
+{
+  std::unique_lock lock{ m_mutex };
+  while (m_jobAvailable.wait(lock, stopToken, [this] { return !m_jobs.empty(); })) {
+    Job job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_runningCount++;
+
+    lock.unlock();
+    job();
+    lock.lock();
+
+    m_runningCount--;
+    if (m_jobs.empty() && m_runningCount == 0) { m_idle.notify_all(); }
+  }
+}
+}// namespace engine::renderer
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine::renderer {
+// Worker threads compiling shader objects and pipelines off the frame loop. Jobs only get thread safe work: the
+// create calls themselves, the pipeline cache (internally synchronized) and the shader binary cache. Reflection,
+// layouts and anything else owned by the renderer are resolved on the calling thread before a job is submitted.
+class VulkanAsyncCompiler
+{
+public:
+  using Job = std::function<void()>;
+
+  // 0 picks one thread per two hardware threads, leaving the others to the game
+  explicit VulkanAsyncCompiler(uint32_t threadCount = 0);
+  // Waits for the jobs still queued
+  ~VulkanAsyncCompiler();
+
+  VulkanAsyncCompiler(const VulkanAsyncCompiler &) = delete;
+  VulkanAsyncCompiler &operator=(const VulkanAsyncCompiler &) = delete;
+
+  void submit(Job job);
+  // Blocks until every submitted job has run, e.g. before destroying what they write to
+  void waitIdle();
+
+  // Queued or running
+  size_t getPendingCount() const;
+  inline size_t getThreadCount() const noexcept { return m_threads.size(); }
+
+private:
+  void run(std::stop_token stopToken);
+
+private:
+  mutable std::mutex m_mutex;
+  std::condition_variable_any m_jobAvailable;
+  std::condition_variable m_idle;
+  std::deque<Job> m_jobs;
+  size_t m_runningCount = 0;
+
+  // Last member, the threads stop and join before the queue goes away
+  std::vector<std::jthread> m_threads;
+};
+}// namespace engine::renderer
@@ -0,0 +1,81 @@
+#include "vulkan_async_compute.hpp"
+#include <engine/core/logger.hpp>
+
+namespace engine::renderer {
+VulkanAsyncCompute::VulkanAsyncCompute(VulkanDevice *device) : m_device{ device }, m_timeline{ device }
+{
+  // Pools are reset as a whole once per frame, command buffers are never reset individually
+  for (Frame &frame : m_frames) {
+    vk::CommandPoolCreateInfo poolInfo = {
+      .flags = vk::CommandPoolCreateFlagBits::eTransient,
+      .queueFamilyIndex = m_device->getQueueFamilyIndices().computeFamily.value(),
+    };
+    frame.commandPool = m_device->getDevice().createCommandPool(poolInfo).value;
+  }
+
+  core::Logger::info("Async compute {}", isAsync() ? "runs on a separate queue" : "shares the graphics queue");
+}
+
+VulkanAsyncCompute::~VulkanAsyncCompute()
+{
+  m_timeline.wait(m_timeline.getLastSubmittedValue());
+  for (Frame &frame : m_frames) { m_device->getDevice().destroyCommandPool(frame.commandPool); }
+}
+
+void VulkanAsyncCompute::beginFrame(size_t frameIndex)
+{
+  m_currentFrame = frameIndex;
+  Frame &frame = m_frames[frameIndex];
+
+  m_timeline.wait(frame.lastValue);
+  m_device->getDevice().resetCommandPool(frame.commandPool);
+  frame.usedCommandBuffers = 0;
+}
+
+vk::CommandBuffer VulkanAsyncCompute::begin()
+{
+  Frame &frame = m_frames[m_currentFrame];
+  if (frame.usedCommandBuffers == frame.commandBuffers.size()) {
+    vk::CommandBufferAllocateInfo allocInfo = {
+      .commandPool = frame.commandPool,
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = 1,
+    };
+    frame.commandBuffers.push_back(m_device->getDevice().allocateCommandBuffers(allocInfo).value.front());
+  }
+
+  vk::CommandBuffer commandBuffer = frame.commandBuffers[frame.usedCommandBuffers++];
+  vk::CommandBufferBeginInfo beginInfo = {
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  };
+  commandBuffer.begin(beginInfo);
+  return commandBuffer;
+}
+
+uint64_t VulkanAsyncCompute::submit(vk::CommandBuffer commandBuffer,
+  std::span<const vk::SemaphoreSubmitInfo> waitSemaphores)
+{
+  commandBuffer.end();
+
+  const uint64_t value = m_timeline.advance();
+  vk::SemaphoreSubmitInfo signalInfo = m_timeline.getSignalInfo(value, vk::PipelineStageFlagBits2::eComputeShader);
+  vk::CommandBufferSubmitInfo commandBufferInfo = {
+    .commandBuffer = commandBuffer,
+  };
+  vk::SubmitInfo2 submitInfo = {
+    .waitSemaphoreInfoCount = static_cast<uint32_t>(waitSemaphores.size()),
+    .pWaitSemaphoreInfos = waitSemaphores.data(),
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &commandBufferInfo,
+    .signalSemaphoreInfoCount = 1,
+    .pSignalSemaphoreInfos = &signalInfo,
+  };
+  {
+    auto lock = m_device->lockQueue(m_device->getComputeQueue());
+    m_device->getComputeQueue().submit2(submitInfo);
+  }
+
+  m_frames[m_currentFrame].lastValue = value;
+  return value;
+}
+}// namespace engine::renderer
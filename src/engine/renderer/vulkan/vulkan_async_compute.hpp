@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_swapchain.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <span>
+#include <vector>
+
+namespace engine::renderer {
+// Submits compute work to the device's compute queue, separate from graphics when the device has a compute only
+// family. Every submission signals the next value of a timeline semaphore, graphics (or later compute) work consuming
+// the results waits on that value instead of the CPU waiting for anything.
+class VulkanAsyncCompute
+{
+public:
+  VulkanAsyncCompute(VulkanDevice *device);
+  ~VulkanAsyncCompute();
+
+  VulkanAsyncCompute(const VulkanAsyncCompute &) = delete;
+  VulkanAsyncCompute &operator=(const VulkanAsyncCompute &) = delete;
+
+  // Recycles the command buffers of a frame slot. Work submitted from the slot last time around is normally finished
+  // already, the graphics submission it fed into has been waited on through the frame fence.
+  void beginFrame(size_t frameIndex);
+
+  // Returns a command buffer of the current frame slot in the recording state
+  [[nodiscard]] vk::CommandBuffer begin();
+  // Ends and submits the command buffer. Returns the timeline value signaled once it has executed.
+  uint64_t submit(vk::CommandBuffer commandBuffer, std::span<const vk::SemaphoreSubmitInfo> waitSemaphores = {});
+
+  // What a submission on another queue waits on for the work that signaled value, at the stages consuming it
+  vk::SemaphoreSubmitInfo getWaitInfo(uint64_t value, vk::PipelineStageFlags2 stages) const
+  {
+    return m_timeline.getWaitInfo(value, stages);
+  }
+  inline const VulkanTimeline &getTimeline() const noexcept { return m_timeline; }
+  // False when compute shares the graphics queue, work then runs in submission order instead of overlapping
+  inline bool isAsync() const noexcept { return m_device->hasAsyncComputeQueue(); }
+
+private:
+  struct Frame
+  {
+    vk::CommandPool commandPool;
+    std::vector<vk::CommandBuffer> commandBuffers;
+    uint32_t usedCommandBuffers = 0;
+    // Last value signaled by work recorded from this slot
+    uint64_t lastValue = 0;
+  };
+
+private:
+  VulkanDevice *m_device;
+  VulkanTimeline m_timeline;
+
+  std::array<Frame, VulkanSwapchain::MAX_FRAMES_IN_FLIGHT> m_frames;
+  size_t m_currentFrame = 0;
+};
+}// namespace engine::renderer
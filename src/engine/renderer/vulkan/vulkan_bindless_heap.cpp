@@ -0,0 +1,250 @@
+#include "vulkan_bindless_heap.hpp"
+#include <algorithm>
+#include <engine/core/assert.hpp>
+#include <engine/core/exception.hpp>
+#include <engine/core/logger.hpp>
+
+namespace engine::renderer {
+// Upper bounds, the actual capacity is clamped to what the device can do
+constexpr uint32_t MAX_BINDLESS_SAMPLED_IMAGES = 1u << 16;
+constexpr uint32_t MAX_BINDLESS_SAMPLERS = 1u << 10;
+constexpr uint32_t MAX_BINDLESS_STORAGE_BUFFERS = 1u << 16;
+constexpr uint32_t MAX_BINDLESS_STORAGE_IMAGES = 1u << 12;
+
+VulkanBindlessHeap::VulkanBindlessHeap(VulkanDevice *device, const VulkanTimeline *frameTimeline)
+  : m_device{ device }, m_frameTimeline{ frameTimeline }
+{
+  queryCapacities();
+  createLayouts();
+  createDescriptorSet();
+  core::Logger::info("Bindless heap created: {} images, {} samplers, {} storage buffers, {} storage images",
+    m_sampledImageSlots.capacity(),
+    m_samplerSlots.capacity(),
+    m_storageBufferSlots.capacity(),
+    m_storageImageSlots.capacity());
+}
+
+VulkanBindlessHeap::~VulkanBindlessHeap()
+{
+  m_device->getDevice().destroyDescriptorPool(m_descriptorPool);
+  m_device->getDevice().destroyPipelineLayout(m_pipelineLayout);
+  m_device->getDevice().destroyDescriptorSetLayout(m_setLayout);
+}
+
+void VulkanBindlessHeap::queryCapacities()
+{
+  auto properties = m_device->getPhysicalDevice()
+                      .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+  const auto &indexingProperties = properties.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+
+  m_sampledImageSlots.init(std::min({ MAX_BINDLESS_SAMPLED_IMAGES,
+    indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+    indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages }));
+  m_samplerSlots.init(std::min({ MAX_BINDLESS_SAMPLERS,
+    indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+    indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers }));
+  m_storageBufferSlots.init(std::min({ MAX_BINDLESS_STORAGE_BUFFERS,
+    indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+    indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers }));
+  m_storageImageSlots.init(std::min({ MAX_BINDLESS_STORAGE_IMAGES,
+    indexingProperties.maxDescriptorSetUpdateAfterBindStorageImages,
+    indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageImages }));
+}
+
+void VulkanBindlessHeap::createLayouts()
+{
+  auto bindings = std::to_array<vk::DescriptorSetLayoutBinding>({
+    { .binding = SAMPLED_IMAGE_BINDING,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .descriptorCount = m_sampledImageSlots.capacity(),
+      .stageFlags = vk::ShaderStageFlagBits::eAll },
+    { .binding = SAMPLER_BINDING,
+      .descriptorType = vk::DescriptorType::eSampler,
+      .descriptorCount = m_samplerSlots.capacity(),
+      .stageFlags = vk::ShaderStageFlagBits::eAll },
+    { .binding = STORAGE_BUFFER_BINDING,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = m_storageBufferSlots.capacity(),
+      .stageFlags = vk::ShaderStageFlagBits::eAll },
+    { .binding = STORAGE_IMAGE_BINDING,
+      .descriptorType = vk::DescriptorType::eStorageImage,
+      .descriptorCount = m_storageImageSlots.capacity(),
+      .stageFlags = vk::ShaderStageFlagBits::eAll },
+  });
+
+  constexpr vk::DescriptorBindingFlags bindingFlag = vk::DescriptorBindingFlagBits::ePartiallyBound
+                                                     | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+                                                     | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+  auto bindingFlags = std::to_array({ bindingFlag, bindingFlag, bindingFlag, bindingFlag });
+
+  vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+  bindingFlagsInfo.setBindingFlags(bindingFlags);
+
+  vk::DescriptorSetLayoutCreateInfo layoutInfo = {
+    .pNext = &bindingFlagsInfo,
+    .flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+  };
+  layoutInfo.setBindings(bindings);
+
+  m_setLayout = m_device->getDevice().createDescriptorSetLayout(layoutInfo).value;
+
+  auto pushConstantRange = getPushConstantRange();
+  vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {
+    .setLayoutCount = 1,
+    .pSetLayouts = &m_setLayout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &pushConstantRange,
+  };
+
+  m_pipelineLayout = m_device->getDevice().createPipelineLayout(pipelineLayoutInfo).value;
+}
+
+void VulkanBindlessHeap::createDescriptorSet()
+{
+  auto poolSizes = std::to_array<vk::DescriptorPoolSize>({
+    { .type = vk::DescriptorType::eSampledImage, .descriptorCount = m_sampledImageSlots.capacity() },
+    { .type = vk::DescriptorType::eSampler, .descriptorCount = m_samplerSlots.capacity() },
+    { .type = vk::DescriptorType::eStorageBuffer, .descriptorCount = m_storageBufferSlots.capacity() },
+    { .type = vk::DescriptorType::eStorageImage, .descriptorCount = m_storageImageSlots.capacity() },
+  });
+
+  vk::DescriptorPoolCreateInfo poolInfo = {
+    .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+    .maxSets = 1,
+  };
+  poolInfo.setPoolSizes(poolSizes);
+
+  m_descriptorPool = m_device->getDevice().createDescriptorPool(poolInfo).value;
+
+  vk::DescriptorSetAllocateInfo allocInfo = {
+    .descriptorPool = m_descriptorPool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = &m_setLayout,
+  };
+
+  m_descriptorSet = m_device->getDevice().allocateDescriptorSets(allocInfo).value[0];
+}
+
+uint32_t VulkanBindlessHeap::registerSampledImage(vk::ImageView imageView, vk::ImageLayout layout)
+{
+  uint32_t slot = m_sampledImageSlots.allocate();
+  updateSampledImage(slot, imageView, layout);
+  return slot;
+}
+
+void VulkanBindlessHeap::updateSampledImage(uint32_t slot, vk::ImageView imageView, vk::ImageLayout layout)
+{
+  vk::DescriptorImageInfo imageInfo = { .imageView = imageView, .imageLayout = layout };
+  vk::WriteDescriptorSet write = {
+    .dstSet = m_descriptorSet,
+    .dstBinding = SAMPLED_IMAGE_BINDING,
+    .dstArrayElement = slot,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eSampledImage,
+    .pImageInfo = &imageInfo,
+  };
+  m_device->getDevice().updateDescriptorSets(write, nullptr);
+}
+
+void VulkanBindlessHeap::releaseSampledImage(uint32_t slot) { release(m_sampledImageSlots, slot); }
+
+uint32_t VulkanBindlessHeap::registerSampler(vk::Sampler sampler)
+{
+  uint32_t slot = m_samplerSlots.allocate();
+
+  vk::DescriptorImageInfo imageInfo = { .sampler = sampler };
+  vk::WriteDescriptorSet write = {
+    .dstSet = m_descriptorSet,
+    .dstBinding = SAMPLER_BINDING,
+    .dstArrayElement = slot,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eSampler,
+    .pImageInfo = &imageInfo,
+  };
+  m_device->getDevice().updateDescriptorSets(write, nullptr);
+
+  return slot;
+}
+
+void VulkanBindlessHeap::releaseSampler(uint32_t slot) { release(m_samplerSlots, slot); }
+
+uint32_t VulkanBindlessHeap::registerStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range)
+{
+  uint32_t slot = m_storageBufferSlots.allocate();
+  updateStorageBuffer(slot, buffer, offset, range);
+  return slot;
+}
+
+void VulkanBindlessHeap::updateStorageBuffer(uint32_t slot,
+  vk::Buffer buffer,
+  vk::DeviceSize offset,
+  vk::DeviceSize range)
+{
+  vk::DescriptorBufferInfo bufferInfo = { .buffer = buffer, .offset = offset, .range = range };
+  vk::WriteDescriptorSet write = {
+    .dstSet = m_descriptorSet,
+    .dstBinding = STORAGE_BUFFER_BINDING,
+    .dstArrayElement = slot,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eStorageBuffer,
+    .pBufferInfo = &bufferInfo,
+  };
+  m_device->getDevice().updateDescriptorSets(write, nullptr);
+}
+
+void VulkanBindlessHeap::releaseStorageBuffer(uint32_t slot) { release(m_storageBufferSlots, slot); }
+
+uint32_t VulkanBindlessHeap::registerStorageImage(vk::ImageView imageView)
+{
+  uint32_t slot = m_storageImageSlots.allocate();
+
+  vk::DescriptorImageInfo imageInfo = { .imageView = imageView, .imageLayout = vk::ImageLayout::eGeneral };
+  vk::WriteDescriptorSet write = {
+    .dstSet = m_descriptorSet,
+    .dstBinding = STORAGE_IMAGE_BINDING,
+    .dstArrayElement = slot,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eStorageImage,
+    .pImageInfo = &imageInfo,
+  };
+  m_device->getDevice().updateDescriptorSets(write, nullptr);
+
+  return slot;
+}
+
+void VulkanBindlessHeap::releaseStorageImage(uint32_t slot) { release(m_storageImageSlots, slot); }
+
+void VulkanBindlessHeap::release(SlotAllocator &allocator, uint32_t slot)
+{
+  // The frame being recorded may still reference the slot as well
+  m_pendingReleases.push_back({ .frameValue = m_frameTimeline->getNextValue(), .allocator = &allocator, .slot = slot });
+}
+
+void VulkanBindlessHeap::beginFrame()
+{
+  if (m_pendingReleases.empty()) { return; }
+
+  const uint64_t completedValue = m_frameTimeline->getCompletedValue();
+  while (!m_pendingReleases.empty() && m_pendingReleases.front().frameValue <= completedValue) {
+    m_pendingReleases.front().allocator->release(m_pendingReleases.front().slot);
+    m_pendingReleases.pop_front();
+  }
+}
+
+void VulkanBindlessHeap::bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint) const
+{
+  commandBuffer.bindDescriptorSets(bindPoint, m_pipelineLayout, SET_INDEX, m_descriptorSet, nullptr);
+}
+
+uint32_t VulkanBindlessHeap::SlotAllocator::allocate()
+{
+  if (!m_freeSlots.empty()) {
+    uint32_t slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    return slot;
+  }
+
+  if (m_next >= m_capacity) { core::panic("Bindless heap is full ({} slots)", m_capacity); }
+  return m_next++;
+}
+}// namespace engine::renderer
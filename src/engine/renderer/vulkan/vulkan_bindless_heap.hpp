@@ -0,0 +1,113 @@
+#pragma once
+
+#include <deque>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <limits>
+#include <vector>
+
+namespace engine::renderer {
+// One global update-after-bind descriptor set with large arrays of sampled images, samplers, storage buffers and
+// storage images.
+// Resources get a stable slot when they are created and shaders index the arrays with that slot (passed through
+// push constants or instance data), so the set is bound once per frame for the whole scene.
+class VulkanBindlessHeap
+{
+public:
+  static constexpr uint32_t SET_INDEX = 0;
+  static constexpr uint32_t SAMPLED_IMAGE_BINDING = 0;
+  static constexpr uint32_t SAMPLER_BINDING = 1;
+  static constexpr uint32_t STORAGE_BUFFER_BINDING = 2;
+  static constexpr uint32_t STORAGE_IMAGE_BINDING = 3;
+  static constexpr uint32_t INVALID_SLOT = std::numeric_limits<uint32_t>::max();
+
+  // Every program shares this range, otherwise their pipeline layouts wouldn't be compatible with the heap's one
+  static constexpr uint32_t PUSH_CONSTANT_SIZE = 128;
+  static constexpr vk::ShaderStageFlags PUSH_CONSTANT_STAGES =
+    vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+
+public:
+  // Released slots are held back until the frame timeline reaches the frame that released them
+  VulkanBindlessHeap(VulkanDevice *device, const VulkanTimeline *frameTimeline);
+  ~VulkanBindlessHeap();
+
+  VulkanBindlessHeap(const VulkanBindlessHeap &) = delete;
+  VulkanBindlessHeap &operator=(const VulkanBindlessHeap &) = delete;
+
+  [[nodiscard]] uint32_t registerSampledImage(vk::ImageView imageView,
+    vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+  void updateSampledImage(uint32_t slot,
+    vk::ImageView imageView,
+    vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+  void releaseSampledImage(uint32_t slot);
+
+  [[nodiscard]] uint32_t registerSampler(vk::Sampler sampler);
+  void releaseSampler(uint32_t slot);
+
+  [[nodiscard]] uint32_t registerStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range);
+  void updateStorageBuffer(uint32_t slot, vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range);
+  void releaseStorageBuffer(uint32_t slot);
+
+  // Storage images are always accessed in the general layout
+  [[nodiscard]] uint32_t registerStorageImage(vk::ImageView imageView);
+  void releaseStorageImage(uint32_t slot);
+
+  // Released slots may still be referenced by frames in flight, they become reusable once the frames recorded up to
+  // their release have finished
+  void beginFrame();
+
+  void bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint) const;
+
+  inline vk::DescriptorSetLayout getSetLayout() const noexcept { return m_setLayout; }
+  inline vk::PipelineLayout getPipelineLayout() const noexcept { return m_pipelineLayout; }
+  inline vk::PushConstantRange getPushConstantRange() const noexcept
+  {
+    return { .stageFlags = PUSH_CONSTANT_STAGES, .offset = 0, .size = PUSH_CONSTANT_SIZE };
+  }
+
+private:
+  class SlotAllocator
+  {
+  public:
+    void init(uint32_t capacity) { m_capacity = capacity; }
+    uint32_t allocate();
+    void release(uint32_t slot) { m_freeSlots.push_back(slot); }
+    uint32_t capacity() const { return m_capacity; }
+
+  private:
+    uint32_t m_capacity = 0;
+    uint32_t m_next = 0;
+    std::vector<uint32_t> m_freeSlots;
+  };
+
+  struct PendingRelease
+  {
+    uint64_t frameValue;
+    SlotAllocator *allocator;
+    uint32_t slot;
+  };
+
+  void release(SlotAllocator &allocator, uint32_t slot);
+
+  void queryCapacities();
+  void createLayouts();
+  void createDescriptorSet();
+
+private:
+  VulkanDevice *m_device;
+
+  SlotAllocator m_sampledImageSlots;
+  SlotAllocator m_samplerSlots;
+  SlotAllocator m_storageBufferSlots;
+  SlotAllocator m_storageImageSlots;
+
+  const VulkanTimeline *m_frameTimeline;
+  // In frame order
+  std::deque<PendingRelease> m_pendingReleases;
+
+  vk::DescriptorSetLayout m_setLayout;
+  vk::PipelineLayout m_pipelineLayout;
+  vk::DescriptorPool m_descriptorPool;
+  vk::DescriptorSet m_descriptorSet;
+};
+}// namespace engine::renderer
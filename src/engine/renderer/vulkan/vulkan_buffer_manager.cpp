@@ -1,46 +1,206 @@
 #include "vulkan_buffer_manager.hpp"
 #include "vulkan_utils.hpp"
+#include <engine/core/assert.hpp>
+#include <engine/core/logger.hpp>
 
 namespace engine {
 namespace renderer {
-  VulkanBufferManager::VulkanBufferManager(VulkanDevice *device) : m_device{ device } {}
+  VulkanBufferManager::VulkanBufferManager(VulkanDevice *device,
+    VulkanBindlessHeap *bindlessHeap,
+    const VulkanTimeline *frameTimeline,
+    VulkanDeletionQueue *deletionQueue)
+    : m_device{ device }, m_bindlessHeap{ bindlessHeap }, m_frameTimeline{ frameTimeline },
+      m_deletionQueue{ deletionQueue }
+  {
+    const QueueFamilyIndices &families = m_device->getQueueFamilyIndices();
+    m_sharedFamilies = { families.graphicsFamily.value(), families.computeFamily.value() };
 
-  size_t VulkanBufferManager::createBuffer(BufferDesc &desc)
+    createPools();
+  }
+
+  BufferMemoryClass VulkanBufferManager::getMemoryClass(const BufferDesc &desc)
   {
-    vk::BufferUsageFlags usage;
-    VmaAllocationCreateInfo allocInfo = {};
-    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    if (desc.cpuAccess == BufferCPUAccess::ReadOnly) { return BufferMemoryClass::Readback; }
+    if (desc.cpuAccess == BufferCPUAccess::WriteDeviceLocal) { return BufferMemoryClass::DeviceUpload; }
+    if (desc.cpuAccess == BufferCPUAccess::WriteOnly || (desc.usage & BufferUsage::TRANSFER_SOURCE)) {
+      return BufferMemoryClass::Upload;
+    }
+    return BufferMemoryClass::DeviceLocal;
+  }
+
+  static VmaAllocationCreateFlags getAllocationFlags(BufferMemoryClass memoryClass)
+  {
+    switch (memoryClass) {
+    case BufferMemoryClass::Upload:
+      return VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    case BufferMemoryClass::Readback:
+      return VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+    case BufferMemoryClass::DeviceUpload:
+      // Lets VMA settle for device local memory the CPU can't write, checked by createPools
+      return VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+             | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+    default:
+      return 0;
+    }
+  }
+
+  void VulkanBufferManager::createPools()
+  {
+    constexpr std::array<const char *, static_cast<size_t>(BufferMemoryClass::Count)> classNames = {
+      "device local",
+      "upload",
+      "readback",
+      "device upload",
+    };
 
-    if (desc.usage & BufferUsage::VERTEX_BUFFER) { usage |= vk::BufferUsageFlagBits::eVertexBuffer; }
+    // Any buffer usage, so the memory type found is compatible with every buffer the pool will hold
+    const vk::BufferCreateInfo representativeInfo = getBufferCreateInfo(0xff, 1024);
+    const VkBufferCreateInfo rawInfo = representativeInfo;
 
-    if (desc.usage & BufferUsage::INDEX_BUFFER) { usage |= vk::BufferUsageFlagBits::eIndexBuffer; }
+    for (size_t memoryClass = 0; memoryClass < m_pools.size(); memoryClass++) {
+      const bool isDeviceUpload = memoryClass == static_cast<size_t>(BufferMemoryClass::DeviceUpload);
+      VmaAllocationCreateInfo allocInfo = {};
+      allocInfo.usage = isDeviceUpload ? VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE : VMA_MEMORY_USAGE_AUTO;
+      allocInfo.flags = getAllocationFlags(static_cast<BufferMemoryClass>(memoryClass));
 
-    if (desc.usage & BufferUsage::UNIFORM_BUFFER) { usage |= vk::BufferUsageFlagBits::eUniformBuffer; }
+      uint32_t memoryTypeIndex = 0;
+      checkVkResult(
+        vmaFindMemoryTypeIndexForBufferInfo(m_device->getAllocator(), &rawInfo, &allocInfo, &memoryTypeIndex));
 
-    if (desc.usage & BufferUsage::STORAGE_BUFFER) { usage |= vk::BufferUsageFlagBits::eStorageBuffer; }
+      if (isDeviceUpload) {
+        VkMemoryPropertyFlags propertyFlags = 0;
+        vmaGetMemoryTypeProperties(m_device->getAllocator(), memoryTypeIndex, &propertyFlags);
+        m_hasDirectUpload = (propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+                            && (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        core::Logger::info("Device local buffers written by the CPU use {} uploads",
+          m_hasDirectUpload ? "direct" : "staged");
+      }
 
-    if (desc.usage & BufferUsage::INDIRECT_ARGUMENT_BUFFER) { usage |= vk::BufferUsageFlagBits::eIndirectBuffer; }
+      for (size_t small = 0; small < 2; small++) {
+        Pool &pool = m_pools[memoryClass][small];
+        pool.memoryTypeIndex = memoryTypeIndex;
 
-    if (desc.usage & BufferUsage::TRANSFER_SOURCE) {
-      usage |= vk::BufferUsageFlagBits::eTransferSrc;
-      allocInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        VmaPoolCreateInfo poolInfo = {};
+        poolInfo.memoryTypeIndex = memoryTypeIndex;
+        // 0 keeps VMA's preferred block size for large buffers
+        poolInfo.blockSize = small ? SMALL_BLOCK_SIZE : 0;
+        checkVkResult(vmaCreatePool(m_device->getAllocator(), &poolInfo, &pool.pool));
+
+        const std::string name = fmt::format("{} {} buffers", classNames[memoryClass], small ? "small" : "large");
+        vmaSetPoolName(m_device->getAllocator(), pool.pool, name.c_str());
+      }
+
+      core::Logger::info("Buffer pools for {} memory use memory type {}", classNames[memoryClass], memoryTypeIndex);
     }
+  }
 
-    if (desc.usage & BufferUsage::TRANSFER_DESTINATION) { usage |= vk::BufferUsageFlagBits::eTransferDst; }
+  vk::BufferCreateInfo VulkanBufferManager::getBufferCreateInfo(uint8_t bufferUsage, vk::DeviceSize size) const
+  {
+    // Every buffer can be copied from and to, defragmentation moves them with a copy
+    vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
 
-    VkDeviceSize descSize = std::max(desc.size, 1ul);
+    if (bufferUsage & BufferUsage::VERTEX_BUFFER) { usage |= vk::BufferUsageFlagBits::eVertexBuffer; }
+
+    if (bufferUsage & BufferUsage::INDEX_BUFFER) { usage |= vk::BufferUsageFlagBits::eIndexBuffer; }
+
+    if (bufferUsage & BufferUsage::UNIFORM_BUFFER) { usage |= vk::BufferUsageFlagBits::eUniformBuffer; }
+
+    if (bufferUsage & BufferUsage::STORAGE_BUFFER) { usage |= vk::BufferUsageFlagBits::eStorageBuffer; }
+
+    if (bufferUsage & BufferUsage::INDIRECT_ARGUMENT_BUFFER) { usage |= vk::BufferUsageFlagBits::eIndirectBuffer; }
 
     vk::BufferCreateInfo bufferInfo = {};
-    bufferInfo.size = descSize;
+    bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
+    // Storage and indirect buffers are what async compute produces for graphics, sharing them between the two
+    // families saves queue family ownership transfers around every dispatch
+    if (m_device->hasAsyncComputeQueue()
+        && (bufferUsage & (BufferUsage::STORAGE_BUFFER | BufferUsage::INDIRECT_ARGUMENT_BUFFER))) {
+      bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+      bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_sharedFamilies.size());
+      bufferInfo.pQueueFamilyIndices = m_sharedFamilies.data();
+    }
+
+    return bufferInfo;
+  }
+
+  const VulkanBufferManager::Pool &VulkanBufferManager::getPool(BufferMemoryClass memoryClass,
+    vk::DeviceSize size) const
+  {
+    return m_pools[static_cast<size_t>(memoryClass)][size <= SMALL_BUFFER_SIZE ? 1 : 0];
+  }
+
+  VmaBudget VulkanBufferManager::getHeapBudget(uint32_t memoryTypeIndex) const
+  {
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_device->getAllocator(), &memoryProperties);
+    const uint32_t heapIndex = memoryProperties->memoryTypes[memoryTypeIndex].heapIndex;
+
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+    vmaGetHeapBudgets(m_device->getAllocator(), budgets.data());
+    return budgets[heapIndex];
+  }
+
+  bool VulkanBufferManager::fitsInBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const
+  {
+    const VmaBudget budget = getHeapBudget(memoryTypeIndex);
+    return budget.usage + size <= budget.budget;
+  }
+
+  size_t VulkanBufferManager::createBuffer(BufferDesc &desc)
+  {
+    VkDeviceSize descSize = std::max(desc.size, 1ul);
+    BufferMemoryClass memoryClass = getMemoryClass(desc);
+    // Device local memory the CPU can write may be a small heap (the 256 MiB BAR window without resizable BAR), once
+    // it's full buffers fall back to plain device local memory and staged writes rather than evicting anything
+    if (memoryClass == BufferMemoryClass::DeviceUpload
+        && (!m_hasDirectUpload || !fitsInBudget(getPool(memoryClass, descSize).memoryTypeIndex, descSize))) {
+      memoryClass = BufferMemoryClass::DeviceLocal;
+    }
+    const Pool &pool = getPool(memoryClass, descSize);
+
+    // Over budget the driver starts paging or fails outright, give the owner a chance to free something first. The
+    // driver's numbers are only refetched once per frame, in between VMA adds its own allocations and frees to them,
+    // so whatever the callback frees shows up right away.
+    VmaBudget budget = getHeapBudget(pool.memoryTypeIndex);
+    while (budget.usage + descSize > budget.budget) {
+      const VmaBudget previous = budget;
+      const size_t queuedDeletions = m_deletionQueue->size();
+      if (!m_evictionCallback || !m_evictionCallback(descSize)) {
+        logMemoryBudgets();
+        core::panic("Buffer {} ({} bytes) doesn't fit in the memory budget", desc.name, descSize);
+      }
+
+      // Evicted resources are only freed once frames in flight are done with them, the allocation goes ahead over
+      // the budget until then
+      if (m_deletionQueue->size() > queuedDeletions) { break; }
+
+      // A pass that freed nothing would be repeated forever
+      budget = getHeapBudget(pool.memoryTypeIndex);
+      if (budget.usage >= previous.usage && budget.statistics.allocationBytes >= previous.statistics.allocationBytes) {
+        logMemoryBudgets();
+        core::panic(
+          "Eviction freed nothing, buffer {} ({} bytes) doesn't fit in the memory budget", desc.name, descSize);
+      }
+    }
+
     const size_t bufferId = getNewBufferId();
 
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.flags = getAllocationFlags(memoryClass);
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocInfo.pool = pool.pool;
+    // Lets defragmentation find the buffer an allocation belongs to
+    allocInfo.pUserData = reinterpret_cast<void *>(bufferId);
+
     Buffer &buffer = m_buffers[bufferId];
     buffer.size = descSize;
+    buffer.usage = desc.usage;
+    buffer.generation = m_nextGeneration++;
 
-    VkBufferCreateInfo rawInfo = bufferInfo;
+    VkBufferCreateInfo rawInfo = getBufferCreateInfo(desc.usage, descSize);
 
     VkBuffer rawBuffer;
     checkVkResult(
@@ -49,6 +209,21 @@ namespace renderer {
 
     buffer.name = desc.name;
 
+    VkMemoryPropertyFlags propertyFlags = 0;
+    vmaGetAllocationMemoryProperties(m_device->getAllocator(), buffer.allocation, &propertyFlags);
+    buffer.uploadPath = (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? BufferUploadPath::Direct
+                                                                              : BufferUploadPath::Staged;
+    if (desc.cpuAccess == BufferCPUAccess::WriteDeviceLocal) {
+      core::Logger::info("Buffer {} ({} bytes) is written {}",
+        desc.name,
+        descSize,
+        buffer.uploadPath == BufferUploadPath::Direct ? "directly" : "through staging");
+    }
+
+    if (desc.usage & BufferUsage::STORAGE_BUFFER) {
+      buffer.bindlessSlot = m_bindlessHeap->registerStorageBuffer(buffer.buffer, 0, vk::WholeSize);
+    }
+
     // TODO add debug marker
 
     return bufferId;
@@ -57,10 +232,145 @@ namespace renderer {
   void VulkanBufferManager::destroyBuffer(size_t bufferId)
   {
     Buffer &buffer = m_buffers[bufferId];
-    vmaDestroyBuffer(m_device->m_allocator, buffer.buffer, buffer.allocation);
+    // The heap holds the slot back until the frame timeline is past this frame
+    if (buffer.bindlessSlot != VulkanBindlessHeap::INVALID_SLOT) {
+      m_bindlessHeap->releaseStorageBuffer(buffer.bindlessSlot);
+    }
+    m_deletionQueue->push(m_frameTimeline->getNextValue(),
+      [device = m_device, vkBuffer = buffer.buffer, allocation = buffer.allocation] {
+        vmaDestroyBuffer(device->getAllocator(), vkBuffer, allocation);
+      });
+    buffer = {};
     m_freeIds.push(bufferId);
   }
 
+  void VulkanBufferManager::writeBuffer(size_t bufferId, const void *data, vk::DeviceSize size, vk::DeviceSize offset)
+  {
+    core::assertion(offset + size <= m_buffers[bufferId].size,
+      "Writing {} bytes at {} overflows buffer {}",
+      size,
+      offset,
+      m_buffers[bufferId].name);
+
+    if (m_buffers[bufferId].uploadPath == BufferUploadPath::Direct) {
+      // Flushes as well when the memory isn't host coherent
+      checkVkResult(
+        vmaCopyMemoryToAllocation(m_device->getAllocator(), data, m_buffers[bufferId].allocation, offset, size));
+      return;
+    }
+
+    BufferDesc stagingDesc = {
+      .name = fmt::format("{} staging", m_buffers[bufferId].name),
+      .usage = BufferUsage::TRANSFER_SOURCE,
+      .cpuAccess = BufferCPUAccess::WriteOnly,
+      .size = size,
+    };
+    // Can grow m_buffers, no reference is held across it
+    const size_t stagingId = createBuffer(stagingDesc);
+    checkVkResult(vmaCopyMemoryToAllocation(m_device->getAllocator(), data, m_buffers[stagingId].allocation, 0, size));
+    m_device->copyBuffer(m_buffers[bufferId].buffer, offset, m_buffers[stagingId].buffer, 0, size);
+    destroyBuffer(stagingId);
+  }
+
+  void VulkanBufferManager::beginFrame()
+  {
+    // With VK_EXT_memory_budget VMA refetches the budgets when the frame index changes
+    vmaSetCurrentFrameIndex(m_device->getAllocator(), ++m_frameIndex);
+  }
+
+  void VulkanBufferManager::defragment()
+  {
+    VmaAllocator allocator = m_device->getAllocator();
+    VmaDefragmentationStats totalStats = {};
+
+    for (auto &classPools : m_pools) {
+      for (Pool &pool : classPools) {
+        VmaDefragmentationInfo defragmentationInfo = {};
+        defragmentationInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+        defragmentationInfo.pool = pool.pool;
+
+        VmaDefragmentationContext context;
+        checkVkResult(vmaBeginDefragmentation(allocator, &defragmentationInfo, &context));
+
+        // Each pass hands out moves to new, temporary allocations. A buffer can't be rebound, so every moved buffer
+        // is recreated on its new memory and its contents copied over before the pass ends and VMA swaps the
+        // allocations.
+        VmaDefragmentationPassMoveInfo pass;
+        while (vmaBeginDefragmentationPass(allocator, context, &pass) == VK_INCOMPLETE) {
+          std::vector<vk::Buffer> oldBuffers;
+          oldBuffers.reserve(pass.moveCount);
+
+          vk::CommandBuffer commandBuffer = m_device->beginSingleTimeCommands();
+          for (uint32_t i = 0; i < pass.moveCount; i++) {
+            VmaDefragmentationMove &move = pass.pMoves[i];
+            VmaAllocationInfo allocationInfo;
+            vmaGetAllocationInfo(allocator, move.srcAllocation, &allocationInfo);
+            Buffer &buffer = m_buffers[reinterpret_cast<size_t>(allocationInfo.pUserData)];
+
+            // Destroyed buffers stay allocated until the deletion queue gets to them, their id may be reused already
+            if (buffer.allocation != move.srcAllocation) {
+              move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+              continue;
+            }
+
+            vk::Buffer newBuffer =
+              m_device->getDevice().createBuffer(getBufferCreateInfo(buffer.usage, buffer.size)).value;
+            checkVkResult(vmaBindBufferMemory(allocator, move.dstTmpAllocation, newBuffer));
+
+            vk::BufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = buffer.size };
+            commandBuffer.copyBuffer(buffer.buffer, newBuffer, copyRegion);
+
+            oldBuffers.push_back(buffer.buffer);
+            buffer.buffer = newBuffer;
+            buffer.generation = m_nextGeneration++;
+            if (buffer.bindlessSlot != VulkanBindlessHeap::INVALID_SLOT) {
+              m_bindlessHeap->updateStorageBuffer(buffer.bindlessSlot, newBuffer, 0, vk::WholeSize);
+            }
+          }
+          m_device->endSingleTimeCommands(commandBuffer);
+
+          for (vk::Buffer oldBuffer : oldBuffers) { m_device->getDevice().destroyBuffer(oldBuffer); }
+
+          if (vmaEndDefragmentationPass(allocator, context, &pass) == VK_SUCCESS) { break; }
+        }
+
+        VmaDefragmentationStats stats;
+        vmaEndDefragmentation(allocator, context, &stats);
+        totalStats.allocationsMoved += stats.allocationsMoved;
+        totalStats.bytesMoved += stats.bytesMoved;
+        totalStats.bytesFreed += stats.bytesFreed;
+        totalStats.deviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+      }
+    }
+
+    core::Logger::info("Buffer defragmentation moved {} buffers ({} bytes), freed {} blocks ({} bytes)",
+      totalStats.allocationsMoved,
+      totalStats.bytesMoved,
+      totalStats.deviceMemoryBlocksFreed,
+      totalStats.bytesFreed);
+  }
+
+  void VulkanBufferManager::logMemoryBudgets() const
+  {
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_device->getAllocator(), &memoryProperties);
+
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+    vmaGetHeapBudgets(m_device->getAllocator(), budgets.data());
+
+    constexpr double mebibyte = 1024.0 * 1024.0;
+    for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap++) {
+      const VmaBudget &budget = budgets[heap];
+      core::Logger::info("Memory heap {}: {:.1f} / {:.1f} MiB used, {} allocations in {} blocks ({:.1f} MiB)",
+        heap,
+        budget.usage / mebibyte,
+        budget.budget / mebibyte,
+        budget.statistics.allocationCount,
+        budget.statistics.blockCount,
+        budget.statistics.blockBytes / mebibyte);
+    }
+  }
+
   size_t VulkanBufferManager::getNewBufferId()
   {
     if (m_freeIds.empty()) {
@@ -77,6 +387,9 @@ namespace renderer {
   VulkanBufferManager::~VulkanBufferManager()
   {
     for (auto &buffer : m_buffers) { vmaDestroyBuffer(m_device->m_allocator, buffer.buffer, buffer.allocation); }
+    for (auto &classPools : m_pools) {
+      for (Pool &pool : classPools) { vmaDestroyPool(m_device->m_allocator, pool.pool); }
+    }
   }
 }// namespace renderer
 }// namespace engine
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <array>
+#include <engine/renderer/vulkan/vulkan_bindless_heap.hpp>
+#include <engine/renderer/vulkan/vulkan_deletion_queue.hpp>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <functional>
 #include <queue>
 #include <string>
 
@@ -20,6 +25,26 @@ enum class BufferCPUAccess {
   AccessNone,
   WriteOnly,
   ReadOnly,
+  // Written by the CPU now and then, read by the GPU a lot (dynamic vertex data, per-object constants). Device local,
+  // written through the mapping where the device has device local memory the CPU can write (resizable BAR, integrated
+  // GPUs), through a staging copy otherwise. See BufferUploadPath.
+  WriteDeviceLocal,
+};
+
+// How VulkanBufferManager::writeBuffer gets data into a buffer
+enum class BufferUploadPath {
+  Direct, // Copied through the mapping, the buffer is host visible
+  Staged, // Copied into a staging buffer and from there on the graphics queue
+};
+
+// Buffers are placed in one VMA pool per memory class, and within a class small buffers share smaller blocks so they
+// don't fragment (or keep alive) the blocks holding large ones
+enum class BufferMemoryClass {
+  DeviceLocal,
+  Upload,   // Written by the CPU, staging and CPU WriteOnly buffers
+  Readback, // Read by the CPU
+  DeviceUpload, // Device local and written by the CPU, only used when such memory exists
+  Count,
 };
 
 struct Buffer {
@@ -27,6 +52,10 @@ struct Buffer {
   VmaAllocation allocation;
   vk::Buffer buffer;
   vk::DeviceSize size;
+  uint8_t usage = 0; // BufferUsage, to recreate the buffer when defragmentation moves it
+  uint32_t bindlessSlot = VulkanBindlessHeap::INVALID_SLOT; // Only storage buffers get one
+  uint64_t generation = 0; // Changes whenever the vk::Buffer behind the id does, 0 once destroyed
+  BufferUploadPath uploadPath = BufferUploadPath::Staged;
 };
 
 struct BufferDesc {
@@ -38,27 +67,82 @@ struct BufferDesc {
 
 class VulkanBufferManager {
 public:
-  VulkanBufferManager(VulkanDevice *device);
+  VulkanBufferManager(VulkanDevice *device,
+    VulkanBindlessHeap *bindlessHeap,
+    const VulkanTimeline *frameTimeline,
+    VulkanDeletionQueue *deletionQueue);
   ~VulkanBufferManager();
 
   vk::Buffer getBuffer(size_t bufferId) const { return m_buffers[bufferId].buffer; }
   vk::DeviceSize getBufferSize(size_t bufferId) const { return m_buffers[bufferId].size; }
   VmaAllocation getBufferAllocation(size_t bufferId) const { return m_buffers[bufferId].allocation; }
   std::string_view getBufferName(size_t bufferId) const { return m_buffers[bufferId].name; }
+  uint32_t getBufferBindlessSlot(size_t bufferId) const { return m_buffers[bufferId].bindlessSlot; }
+  // Lets whoever baked getBuffer() into something (e.g. a recorded command buffer) tell when it went stale: the buffer
+  // was destroyed, its id reused or defragmentation moved it
+  uint64_t getBufferGeneration(size_t bufferId) const { return m_buffers[bufferId].generation; }
+  BufferUploadPath getBufferUploadPath(size_t bufferId) const { return m_buffers[bufferId].uploadPath; }
 
+  // Panics when the buffer doesn't fit in the heap's budget, even after asking the eviction callback to make room
   size_t createBuffer(BufferDesc &desc);
+  // Frames in flight may still use the buffer, it's destroyed once the frame being recorded has finished. The id can
+  // be reused right away.
   void destroyBuffer(size_t bufferId);
+  // Takes the buffer's upload path. A staged write waits for the graphics queue, a direct one doesn't: the caller makes
+  // sure the GPU no longer reads the range, e.g. by writing a different frame slot's part.
+  void writeBuffer(size_t bufferId, const void *data, vk::DeviceSize size, vk::DeviceSize offset = 0);
 
   size_t getBufferCount() const { return m_buffers.size(); }
 
+  // Called when an allocation would exceed the budget of its heap. Returns whether it freed something, the allocation
+  // is then retried.
+  using EvictionCallback = std::function<bool(vk::DeviceSize requiredSize)>;
+  void setEvictionCallback(EvictionCallback callback) { m_evictionCallback = std::move(callback); }
+
+  // Refreshes the heap budgets, once per frame
+  void beginFrame();
+  // Compacts every pool, moving buffers into fewer blocks and freeing the empty ones. Moved buffers get a new
+  // vk::Buffer (getBuffer() returns it afterwards) and keep their bindless slot. The GPU must be idle.
+  void defragment();
+
+  void logMemoryBudgets() const;
+
 private:
+  struct Pool {
+    VmaPool pool = nullptr;
+    uint32_t memoryTypeIndex = 0;
+  };
+
+  // Buffers up to this size go to the small buffer pool of their class
+  static constexpr vk::DeviceSize SMALL_BUFFER_SIZE = 256 * 1024;
+  static constexpr vk::DeviceSize SMALL_BLOCK_SIZE = 16 * 1024 * 1024;
+
+  static BufferMemoryClass getMemoryClass(const BufferDesc &desc);
+  void createPools();
+  vk::BufferCreateInfo getBufferCreateInfo(uint8_t usage, vk::DeviceSize size) const;
+  const Pool &getPool(BufferMemoryClass memoryClass, vk::DeviceSize size) const;
+  VmaBudget getHeapBudget(uint32_t memoryTypeIndex) const;
+  bool fitsInBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const;
   size_t getNewBufferId();
 
 private:
   VulkanDevice *m_device;
+  VulkanBindlessHeap *m_bindlessHeap;
+  const VulkanTimeline *m_frameTimeline;
+  VulkanDeletionQueue *m_deletionQueue;
+
+  // Indexed by BufferMemoryClass, large buffers first
+  std::array<std::array<Pool, 2>, static_cast<size_t>(BufferMemoryClass::Count)> m_pools;
+  // Whether the device upload pools got device local memory the CPU can write
+  bool m_hasDirectUpload = false;
+  EvictionCallback m_evictionCallback;
+  uint32_t m_frameIndex = 0;
+  // The family list concurrent buffers point to
+  std::array<uint32_t, 2> m_sharedFamilies;
 
   std::vector<Buffer> m_buffers;
   std::queue<size_t> m_freeIds;
+  uint64_t m_nextGeneration = 1;
 };
 } // namespace renderer
 } // namespace engine
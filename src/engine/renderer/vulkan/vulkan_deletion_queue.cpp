@@ -0,0 +1,26 @@
+#include "vulkan_deletion_queue.hpp"
+#include <engine/core/assert.hpp>
+
+namespace engine::renderer {
+VulkanDeletionQueue::~VulkanDeletionQueue()
+{
+  for (Entry &entry : m_entries) { entry.deleter(); }
+}
+
+void VulkanDeletionQueue::push(uint64_t value, Deleter deleter)
+{
+  core::assertion(
+    m_entries.empty() || m_entries.back().value <= value, "Deletions have to be queued in timeline order");
+  m_entries.push_back({ .value = value, .deleter = std::move(deleter) });
+}
+
+void VulkanDeletionQueue::collect(uint64_t completedValue)
+{
+  while (!m_entries.empty() && m_entries.front().value <= completedValue) {
+    // Popped first, a deleter may queue further deletions
+    Deleter deleter = std::move(m_entries.front().deleter);
+    m_entries.pop_front();
+    deleter();
+  }
+}
+}// namespace engine::renderer
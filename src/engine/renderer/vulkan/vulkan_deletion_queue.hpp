@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace engine::renderer {
+// Deferred destruction keyed by timeline values: a deleter runs once the timeline has reached the value of the last
+// submission that may use what it destroys. Values are pushed in non-decreasing order, as the value of the frame
+// being recorded only ever grows.
+class VulkanDeletionQueue
+{
+public:
+  using Deleter = std::function<void()>;
+
+  VulkanDeletionQueue() = default;
+  // Runs whatever is left, the owner waits for the GPU before destroying the queue
+  ~VulkanDeletionQueue();
+
+  VulkanDeletionQueue(const VulkanDeletionQueue &) = delete;
+  VulkanDeletionQueue &operator=(const VulkanDeletionQueue &) = delete;
+
+  void push(uint64_t value, Deleter deleter);
+  // Runs the deleters of every value up to completedValue, in order
+  void collect(uint64_t completedValue);
+
+  inline size_t size() const noexcept { return m_entries.size(); }
+
+private:
+  struct Entry
+  {
+    uint64_t value;
+    Deleter deleter;
+  };
+
+  std::deque<Entry> m_entries;
+};
+}// namespace engine::renderer
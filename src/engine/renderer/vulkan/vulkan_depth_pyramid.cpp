@@ -0,0 +1,202 @@
+#include "vulkan_depth_pyramid.hpp"
+#include <algorithm>
+#include <bit>
+#include <engine/core/logger.hpp>
+
+namespace engine::renderer {
+VulkanDepthPyramid::VulkanDepthPyramid(VulkanRenderer *renderer)
+  : m_renderer{ renderer }, m_device{ renderer->getDevice() }
+{
+  if (!m_renderer->getSwapchainPolicy().sampledDepth) {
+    SwapchainPolicy policy = m_renderer->getSwapchainPolicy();
+    policy.sampledDepth = true;
+    m_renderer->setSwapchainPolicy(policy);
+  }
+
+  m_depthSlots.fill(VulkanBindlessHeap::INVALID_SLOT);
+
+  // Linear filtering with a max reduction returns the farthest of the 2x2 footprint instead of their average, which is
+  // exactly one downsampling step (and a conservative occlusion test when sampling)
+  vk::SamplerReductionModeCreateInfo reductionInfo = {
+    .reductionMode = vk::SamplerReductionMode::eMax,
+  };
+  vk::SamplerCreateInfo samplerInfo = {
+    .pNext = &reductionInfo,
+    .magFilter = vk::Filter::eLinear,
+    .minFilter = vk::Filter::eLinear,
+    .mipmapMode = vk::SamplerMipmapMode::eNearest,
+    .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+    .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+    .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+    .minLod = 0.0f,
+    .maxLod = vk::LodClampNone,
+  };
+  m_sampler = m_device->getDevice().createSampler(samplerInfo).value;
+  m_samplerSlot = m_renderer->getBindlessHeap().registerSampler(m_sampler);
+
+  m_downsampleProgram =
+    m_renderer->createComputeProgram({ .computeShaderId = m_renderer->loadComputeShader("depth_pyramid") });
+}
+
+VulkanDepthPyramid::~VulkanDepthPyramid()
+{
+  VulkanBindlessHeap &heap = m_renderer->getBindlessHeap();
+  retire();
+  for (uint32_t slot : m_depthSlots) {
+    if (slot != VulkanBindlessHeap::INVALID_SLOT) { heap.releaseSampledImage(slot); }
+  }
+  heap.releaseSampler(m_samplerSlot);
+
+  m_renderer->deferDeletion([device = m_device, sampler = m_sampler] { device->getDevice().destroySampler(sampler); });
+}
+
+RenderGraphResource VulkanDepthPyramid::addBuildPass(RenderGraphResource depth)
+{
+  VulkanRenderGraph &graph = m_renderer->getRenderGraph();
+  VulkanBindlessHeap &heap = m_renderer->getBindlessHeap();
+
+  const vk::Extent2D depthExtent = graph.getImageExtent(depth);
+  if (depthExtent != m_depthExtent) {
+    retire();
+    create(depthExtent);
+  }
+
+  // The frame that last used this slot has completed, updating its descriptor is safe
+  const size_t frameIndex = m_renderer->getFrameIndex();
+  if (m_depthSlots[frameIndex] == VulkanBindlessHeap::INVALID_SLOT) {
+    m_depthSlots[frameIndex] = heap.registerSampledImage(graph.getImageView(depth));
+  } else {
+    heap.updateSampledImage(m_depthSlots[frameIndex], graph.getImageView(depth));
+  }
+
+  // Fully rewritten every frame, the previous frame's culling only has to be done sampling it
+  RenderGraphResource pyramid = graph.importImage("depth pyramid",
+    { .image = m_resources.image,
+      .view = m_resources.view,
+      .range = { vk::ImageAspectFlagBits::eColor, 0, m_mipCount, 0, 1 },
+      .extent = m_extent,
+      .initialLayout = vk::ImageLayout::eUndefined,
+      .initialStages = vk::PipelineStageFlagBits2::eComputeShader });
+
+  graph.addPass(
+    "build depth pyramid",
+    [&](VulkanRenderGraph::PassBuilder &builder) {
+      builder.read(depth, RenderGraphAccess::SampledCompute);
+      builder.write(pyramid, RenderGraphAccess::StorageCompute);
+    },
+    [this, image = m_resources.image, depthSlot = m_depthSlots[frameIndex]](
+      vk::CommandBuffer commandBuffer, const VulkanRenderGraph &) { record(commandBuffer, image, depthSlot); });
+
+  return pyramid;
+}
+
+void VulkanDepthPyramid::record(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t depthSlot) const
+{
+  m_renderer->bindComputeProgram(commandBuffer, m_downsampleProgram);
+
+  for (uint32_t mip = 0; mip < m_mipCount; mip++) {
+    const uint32_t width = std::max(m_extent.width >> mip, 1u);
+    const uint32_t height = std::max(m_extent.height >> mip, 1u);
+
+    // Mip 0 comes straight from the depth buffer, which is at most twice as large
+    DownsampleConstants constants = {
+      .outputWidth = static_cast<float>(width),
+      .outputHeight = static_cast<float>(height),
+      .sourceLod = mip == 0 ? 0.0f : static_cast<float>(mip - 1),
+      .sourceSlot = mip == 0 ? depthSlot : m_generalSlot,
+      .samplerSlot = m_samplerSlot,
+      .destinationSlot = m_mipSlots[mip],
+    };
+    m_renderer->pushConstant(commandBuffer, m_downsampleProgram, &constants, 0, sizeof(constants));
+    m_renderer->dispatchThreads(commandBuffer, m_downsampleProgram, width, height);
+    if (mip + 1 == m_mipCount) { break; }
+
+    // The graph only tracks the image as a whole, the dependency between mips is ours
+    vk::ImageMemoryBarrier2 barrier = {
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+      .oldLayout = vk::ImageLayout::eGeneral,
+      .newLayout = vk::ImageLayout::eGeneral,
+      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .image = image,
+      .subresourceRange = { vk::ImageAspectFlagBits::eColor, mip, 1, 0, 1 },
+    };
+    vk::DependencyInfo dependencyInfo = {
+      .imageMemoryBarrierCount = 1,
+      .pImageMemoryBarriers = &barrier,
+    };
+    commandBuffer.pipelineBarrier2(dependencyInfo);
+  }
+}
+
+void VulkanDepthPyramid::create(vk::Extent2D depthExtent)
+{
+  m_depthExtent = depthExtent;
+
+  // Rounding down to a power of two keeps every downsampling step an exact 2x2 reduction
+  m_extent = { std::bit_floor(std::max(depthExtent.width, 1u)), std::bit_floor(std::max(depthExtent.height, 1u)) };
+  m_mipCount = std::bit_width(std::max(m_extent.width, m_extent.height));
+
+  vk::ImageCreateInfo imageInfo = {
+    .imageType = vk::ImageType::e2D,
+    .format = FORMAT,
+    .extent = { .width = m_extent.width, .height = m_extent.height, .depth = 1 },
+    .mipLevels = m_mipCount,
+    .arrayLayers = 1,
+    .samples = vk::SampleCountFlagBits::e1,
+    .tiling = vk::ImageTiling::eOptimal,
+    .usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    .sharingMode = vk::SharingMode::eExclusive,
+    .initialLayout = vk::ImageLayout::eUndefined,
+  };
+  m_device->createImageWithInfo(imageInfo, VMA_MEMORY_USAGE_GPU_ONLY, m_resources.image, m_resources.allocation);
+
+  vk::ImageViewCreateInfo viewInfo = {
+    .image = m_resources.image,
+    .viewType = vk::ImageViewType::e2D,
+    .format = FORMAT,
+    .subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, m_mipCount, 0, 1 },
+  };
+  m_resources.view = m_device->getDevice().createImageView(viewInfo).value;
+
+  VulkanBindlessHeap &heap = m_renderer->getBindlessHeap();
+  m_sampledSlot = heap.registerSampledImage(m_resources.view);
+  m_generalSlot = heap.registerSampledImage(m_resources.view, vk::ImageLayout::eGeneral);
+
+  m_resources.mipViews.resize(m_mipCount);
+  m_mipSlots.resize(m_mipCount);
+  for (uint32_t mip = 0; mip < m_mipCount; mip++) {
+    viewInfo.subresourceRange.baseMipLevel = mip;
+    viewInfo.subresourceRange.levelCount = 1;
+    m_resources.mipViews[mip] = m_device->getDevice().createImageView(viewInfo).value;
+    m_mipSlots[mip] = heap.registerStorageImage(m_resources.mipViews[mip]);
+  }
+
+  core::Logger::info("Depth pyramid created: {}x{}, {} mips", m_extent.width, m_extent.height, m_mipCount);
+}
+
+void VulkanDepthPyramid::retire()
+{
+  if (!m_resources.image) { return; }
+
+  VulkanBindlessHeap &heap = m_renderer->getBindlessHeap();
+  heap.releaseSampledImage(m_sampledSlot);
+  heap.releaseSampledImage(m_generalSlot);
+  for (uint32_t slot : m_mipSlots) { heap.releaseStorageImage(slot); }
+  m_mipSlots.clear();
+
+  m_renderer->deferDeletion(
+    [device = m_device, resources = std::move(m_resources)]() mutable { destroy(device, resources); });
+  m_resources = {};
+}
+
+void VulkanDepthPyramid::destroy(VulkanDevice *device, Resources &resources)
+{
+  for (vk::ImageView view : resources.mipViews) { device->getDevice().destroyImageView(view); }
+  device->getDevice().destroyImageView(resources.view);
+  vmaDestroyImage(device->getAllocator(), resources.image, resources.allocation);
+}
+}// namespace engine::renderer
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <engine/renderer/vulkan_renderer.hpp>
+#include <vector>
+
+namespace engine::renderer {
+// Hierarchical depth buffer for occlusion culling. Every mip stores the farthest depth of the 2x2 texels below it, so a
+// single sample at the mip where a bounding box covers about one texel tells whether anything in front of the box
+// could hide it. Rebuilt every frame from the depth buffer by a compute pass, one dispatch per mip.
+class VulkanDepthPyramid
+{
+public:
+  static constexpr vk::Format FORMAT = vk::Format::eR32Sfloat;
+
+public:
+  // Switches the swapchain to sampled depth if it isn't already
+  VulkanDepthPyramid(VulkanRenderer *renderer);
+  ~VulkanDepthPyramid();
+
+  VulkanDepthPyramid(const VulkanDepthPyramid &) = delete;
+  VulkanDepthPyramid &operator=(const VulkanDepthPyramid &) = delete;
+
+  // Adds the pass downsampling depth into the pyramid and returns the pyramid as a graph resource, passes sampling it
+  // read it as SampledCompute or SampledGraphics. The pyramid follows the depth buffer's extent.
+  RenderGraphResource addBuildPass(RenderGraphResource depth);
+
+  // Whole mip chain in the shader read only layout, sample it with getSamplerSlot()
+  inline uint32_t getSampledSlot() const noexcept { return m_sampledSlot; }
+  // Max reduction sampler, a bilinear fetch returns the farthest of the four texels
+  inline uint32_t getSamplerSlot() const noexcept { return m_samplerSlot; }
+  inline vk::Extent2D getExtent() const noexcept { return m_extent; }
+  inline uint32_t getMipCount() const noexcept { return m_mipCount; }
+
+private:
+  struct Resources
+  {
+    vk::Image image;
+    VmaAllocation allocation = nullptr;
+    vk::ImageView view;
+    std::vector<vk::ImageView> mipViews;
+  };
+
+  struct DownsampleConstants
+  {
+    float outputWidth;
+    float outputHeight;
+    float sourceLod;
+    uint32_t sourceSlot;
+    uint32_t samplerSlot;
+    uint32_t destinationSlot;
+  };
+  static_assert(sizeof(DownsampleConstants) <= VulkanBindlessHeap::PUSH_CONSTANT_SIZE);
+
+  void create(vk::Extent2D depthExtent);
+  // Frames in flight may still sample the pyramid, it's destroyed once the frame being recorded is done
+  void retire();
+  static void destroy(VulkanDevice *device, Resources &resources);
+  void record(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t depthSlot) const;
+
+private:
+  VulkanRenderer *m_renderer;
+  VulkanDevice *m_device;
+
+  Resources m_resources;
+
+  vk::Extent2D m_depthExtent{};
+  vk::Extent2D m_extent{};
+  uint32_t m_mipCount = 0;
+
+  // m_sampledSlot is read by culling, m_generalSlot by the downsampling which reads the previous mip while it writes
+  // the next one
+  uint32_t m_sampledSlot = VulkanBindlessHeap::INVALID_SLOT;
+  uint32_t m_generalSlot = VulkanBindlessHeap::INVALID_SLOT;
+  std::vector<uint32_t> m_mipSlots;
+  // The depth buffer differs per frame slot, so does its descriptor
+  std::array<uint32_t, VulkanSwapchain::MAX_FRAMES_IN_FLIGHT> m_depthSlots;
+
+  vk::Sampler m_sampler;
+  uint32_t m_samplerSlot;
+
+  ShaderProgramId m_downsampleProgram;
+};
+}// namespace engine::renderer
@@ -1,5 +1,9 @@
 #include "vulkan_descriptors.hpp"
+#include "vulkan_utils.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <engine/core/logger.hpp>
 #include <vulkan/vulkan_core.h>
 
 namespace engine {
@@ -105,9 +109,6 @@ bool VulkanDescriptorPool::allocateDescriptor(const VkDescriptorSetLayout descri
       .pSetLayouts = &descriptorSetLayout,
   };
 
-  // Might want to create a "DescriptorPoolManager" class that handles this
-  // case, and builds a new pool whenever an old pool fills up. But this is
-  // beyond our current scope
   auto res = vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, &descriptor);
   if (res != VK_SUCCESS) {
     return false;
@@ -122,10 +123,172 @@ void VulkanDescriptorPool::freeDescriptors(std::vector<VkDescriptorSet> &descrip
 
 void VulkanDescriptorPool::resetPool() { vkResetDescriptorPool(m_device->getDevice(), m_descriptorPool, 0); }
 
+// *************** Descriptor Allocator *********************
+
+namespace {
+constexpr auto DEFAULT_POOL_RATIOS = std::to_array<VulkanDescriptorAllocator::PoolSizeRatio>({
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+    {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f},
+    {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f},
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0.5f},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0.5f},
+});
+} // namespace
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanDevice *device, uint32_t setsPerPool,
+                                                     std::span<const PoolSizeRatio> ratios)
+    : m_device{device}, m_setsPerPool{setsPerPool} {
+  if (ratios.empty()) {
+    ratios = DEFAULT_POOL_RATIOS;
+  }
+  m_ratios.assign(ratios.begin(), ratios.end());
+  m_readyPools.push_back(createPool(m_setsPerPool));
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator() {
+  for (auto pool : m_readyPools) {
+    vkDestroyDescriptorPool(m_device->getDevice(), pool, nullptr);
+  }
+  for (auto pool : m_fullPools) {
+    vkDestroyDescriptorPool(m_device->getDevice(), pool, nullptr);
+  }
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void *pNext) {
+  VkDescriptorPool pool = getPool();
+
+  VkDescriptorSetAllocateInfo allocInfo = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .pNext = pNext,
+      .descriptorPool = pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &layout,
+  };
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkResult result = vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, &set);
+
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    m_fullPools.push_back(pool);
+
+    allocInfo.descriptorPool = getPool();
+    result = vkAllocateDescriptorSets(m_device->getDevice(), &allocInfo, &set);
+  }
+  checkVkResult(result);
+
+  m_readyPools.push_back(allocInfo.descriptorPool);
+  return set;
+}
+
+void VulkanDescriptorAllocator::reset() {
+  for (auto pool : m_readyPools) {
+    vkResetDescriptorPool(m_device->getDevice(), pool, 0);
+  }
+  for (auto pool : m_fullPools) {
+    vkResetDescriptorPool(m_device->getDevice(), pool, 0);
+    m_readyPools.push_back(pool);
+  }
+  m_fullPools.clear();
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::getPool() {
+  if (!m_readyPools.empty()) {
+    VkDescriptorPool pool = m_readyPools.back();
+    m_readyPools.pop_back();
+    return pool;
+  }
+
+  // Each new pool is bigger than the previous one, so the chain stays short even for a bad initial guess
+  m_setsPerPool = std::min(m_setsPerPool + m_setsPerPool / 2, MAX_SETS_PER_POOL);
+  core::Logger::debug("Descriptor allocator grows, new pool with {} sets", m_setsPerPool);
+  return createPool(m_setsPerPool);
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::createPool(uint32_t setCount) const {
+  std::vector<VkDescriptorPoolSize> poolSizes;
+  poolSizes.reserve(m_ratios.size());
+  for (const PoolSizeRatio &ratio : m_ratios) {
+    poolSizes.push_back({ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * static_cast<float>(setCount)))});
+  }
+
+  VkDescriptorPoolCreateInfo poolInfo = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .maxSets = setCount,
+      .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+      .pPoolSizes = poolSizes.data(),
+  };
+
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  checkVkResult(vkCreateDescriptorPool(m_device->getDevice(), &poolInfo, nullptr, &pool));
+  return pool;
+}
+
+// *************** Descriptor Set Layout Cache *********************
+
+VulkanDescriptorSetLayout *
+VulkanDescriptorSetLayoutCache::getLayout(const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings) {
+  std::vector<VkDescriptorSetLayoutBinding> sortedBindings;
+  sortedBindings.reserve(bindings.size());
+  for (const auto &[binding, layoutBinding] : bindings) {
+    sortedBindings.push_back(layoutBinding);
+  }
+  return getLayout(sortedBindings);
+}
+
+VulkanDescriptorSetLayout *VulkanDescriptorSetLayoutCache::getLayout(std::span<const VkDescriptorSetLayoutBinding> bindings) {
+  LayoutKey key{.bindings = {bindings.begin(), bindings.end()}};
+  std::sort(key.bindings.begin(), key.bindings.end(),
+            [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) { return a.binding < b.binding; });
+
+  auto it = m_layouts.find(key);
+  if (it != m_layouts.end()) {
+    return it->second.get();
+  }
+
+  std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindingMap;
+  for (const VkDescriptorSetLayoutBinding &binding : key.bindings) {
+    bindingMap[binding.binding] = binding;
+  }
+
+  auto layout = std::make_unique<VulkanDescriptorSetLayout>(m_device, bindingMap);
+  VulkanDescriptorSetLayout *result = layout.get();
+  m_layouts.emplace(std::move(key), std::move(layout));
+  return result;
+}
+
+bool VulkanDescriptorSetLayoutCache::LayoutKey::operator==(const LayoutKey &other) const {
+  return std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(),
+                    [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+                      return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+                             a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags &&
+                             a.pImmutableSamplers == b.pImmutableSamplers;
+                    });
+}
+
+size_t VulkanDescriptorSetLayoutCache::LayoutKeyHash::operator()(const LayoutKey &key) const {
+  size_t seed = key.bindings.size();
+  for (const VkDescriptorSetLayoutBinding &binding : key.bindings) {
+    hashCombine(seed, binding.binding);
+    hashCombine(seed, binding.descriptorType);
+    hashCombine(seed, binding.descriptorCount);
+    hashCombine(seed, binding.stageFlags);
+  }
+  return seed;
+}
+
 // *************** Descriptor Writer *********************
 
 VulkanDescriptorWriter::VulkanDescriptorWriter(VulkanDescriptorSetLayout &setLayout, VulkanDescriptorPool &pool)
-    : m_setLayout{setLayout}, m_pool{pool} {}
+    : m_device{setLayout.m_device}, m_setLayout{setLayout}, m_pool{&pool} {}
+
+VulkanDescriptorWriter::VulkanDescriptorWriter(VulkanDescriptorSetLayout &setLayout,
+                                               VulkanDescriptorAllocator &allocator)
+    : m_device{setLayout.m_device}, m_setLayout{setLayout}, m_allocator{&allocator} {}
 
 VulkanDescriptorWriter &VulkanDescriptorWriter::writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
   assert(m_setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
@@ -176,8 +339,9 @@ VulkanDescriptorWriter &VulkanDescriptorWriter::writeImage(uint32_t binding, VkD
 }
 
 bool VulkanDescriptorWriter::build(VkDescriptorSet &set) {
-  bool success = m_pool.allocateDescriptor(m_setLayout.getDescriptorSetLayout(), set);
-  if (!success) {
+  if (m_allocator != nullptr) {
+    set = m_allocator->allocate(m_setLayout.getDescriptorSetLayout());
+  } else if (!m_pool->allocateDescriptor(m_setLayout.getDescriptorSetLayout(), set)) {
     return false;
   }
   overwrite(set);
@@ -188,7 +352,7 @@ void VulkanDescriptorWriter::overwrite(VkDescriptorSet &set) {
   for (auto &write : m_writes) {
     write.dstSet = set;
   }
-  vkUpdateDescriptorSets(m_pool.m_device->getDevice(), static_cast<uint32_t>(m_writes.size()), m_writes.data(), 0,
+  vkUpdateDescriptorSets(m_device->getDevice(), static_cast<uint32_t>(m_writes.size()), m_writes.data(), 0,
                          nullptr);
 }
 
@@ -2,6 +2,7 @@
 
 #include "vulkan_device.hpp"
 #include <memory>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
@@ -28,6 +29,7 @@ public:
   VulkanDescriptorSetLayout &operator=(const VulkanDescriptorSetLayout &) = delete;
 
   VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+  const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &getBindings() const { return bindings; }
 
 private:
   VulkanDevice *m_device;
@@ -61,6 +63,7 @@ public:
   VulkanDescriptorPool(const VulkanDescriptorPool &) = delete;
   VulkanDescriptorPool &operator=(const VulkanDescriptorPool &) = delete;
 
+  // Fails when the pool is exhausted, use VulkanDescriptorAllocator when the set count isn't known upfront
   bool allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet &descriptor) const;
 
   void freeDescriptors(std::vector<VkDescriptorSet> &descriptors) const;
@@ -74,9 +77,74 @@ private:
   friend class VulkanDescriptorWriter;
 };
 
+// Hands out descriptor sets from a chain of pools, a new (bigger) pool is created whenever the current one is
+// exhausted. reset() recycles every pool at once, so a per-frame instance can serve transient sets without
+// ever freeing them individually.
+class VulkanDescriptorAllocator {
+public:
+  struct PoolSizeRatio {
+    VkDescriptorType type;
+    float ratio;
+  };
+
+  static constexpr uint32_t DEFAULT_SETS_PER_POOL = 256;
+  static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+  VulkanDescriptorAllocator(VulkanDevice *device, uint32_t setsPerPool = DEFAULT_SETS_PER_POOL,
+                            std::span<const PoolSizeRatio> ratios = {});
+  ~VulkanDescriptorAllocator();
+  VulkanDescriptorAllocator(const VulkanDescriptorAllocator &) = delete;
+  VulkanDescriptorAllocator &operator=(const VulkanDescriptorAllocator &) = delete;
+
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void *pNext = nullptr);
+  void reset();
+
+  size_t getPoolCount() const { return m_readyPools.size() + m_fullPools.size(); }
+
+private:
+  VkDescriptorPool getPool();
+  VkDescriptorPool createPool(uint32_t setCount) const;
+
+private:
+  VulkanDevice *m_device;
+  std::vector<PoolSizeRatio> m_ratios;
+  std::vector<VkDescriptorPool> m_readyPools;
+  std::vector<VkDescriptorPool> m_fullPools;
+  uint32_t m_setsPerPool;
+};
+
+// Descriptor set layouts are deduplicated by their binding array, identical layouts share one VkDescriptorSetLayout
+class VulkanDescriptorSetLayoutCache {
+public:
+  VulkanDescriptorSetLayoutCache(VulkanDevice *device) : m_device{device} {}
+  VulkanDescriptorSetLayoutCache(const VulkanDescriptorSetLayoutCache &) = delete;
+  VulkanDescriptorSetLayoutCache &operator=(const VulkanDescriptorSetLayoutCache &) = delete;
+
+  VulkanDescriptorSetLayout *getLayout(const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings);
+  VulkanDescriptorSetLayout *getLayout(std::span<const VkDescriptorSetLayoutBinding> bindings);
+
+  size_t getLayoutCount() const { return m_layouts.size(); }
+
+private:
+  struct LayoutKey {
+    std::vector<VkDescriptorSetLayoutBinding> bindings; // Sorted by binding
+
+    bool operator==(const LayoutKey &other) const;
+  };
+
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey &key) const;
+  };
+
+private:
+  VulkanDevice *m_device;
+  std::unordered_map<LayoutKey, std::unique_ptr<VulkanDescriptorSetLayout>, LayoutKeyHash> m_layouts;
+};
+
 class VulkanDescriptorWriter {
 public:
   VulkanDescriptorWriter(VulkanDescriptorSetLayout &setLayout, VulkanDescriptorPool &pool);
+  VulkanDescriptorWriter(VulkanDescriptorSetLayout &setLayout, VulkanDescriptorAllocator &allocator);
 
   VulkanDescriptorWriter &writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo);
   VulkanDescriptorWriter &writeImage(uint32_t binding, VkDescriptorImageInfo *imageInfo);
@@ -85,8 +153,10 @@ public:
   void overwrite(VkDescriptorSet &set);
 
 private:
+  VulkanDevice *m_device;
   VulkanDescriptorSetLayout &m_setLayout;
-  VulkanDescriptorPool &m_pool;
+  VulkanDescriptorPool *m_pool = nullptr;
+  VulkanDescriptorAllocator *m_allocator = nullptr;
   std::vector<VkWriteDescriptorSet> m_writes;
 };
 } // namespace renderer
@@ -3,12 +3,14 @@
 #define VMA_IMPLEMENTATION
 #include "vulkan_device.hpp"
 #include <SDL3/SDL_vulkan.h>
+#include <algorithm>
 #include <engine/core/exception.hpp>
 #include <engine/core/logger.hpp>
 #include <engine/renderer/vulkan/vulkan_swapchain.hpp>
 #include <engine/renderer/vulkan/vulkan_utils.hpp>
 #include <map>
 #include <set>
+#include <string_view>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -16,7 +18,8 @@ namespace engine {
 namespace renderer {
   const std::vector<const char *> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 
-  const std::vector<const char *> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+  // VK_KHR_swapchain is added on top of these unless the device is headless
+  const std::vector<const char *> deviceExtensions = {
     //"VK_KHR_get_physical_device_properties2",
     "VK_KHR_maintenance1",
     "VK_KHR_maintenance3",
@@ -58,7 +61,7 @@ namespace renderer {
     initVulkan();
     VULKAN_HPP_DEFAULT_DISPATCHER.init(m_instance);
     setupDebugMessenger();
-    createSurface();
+    if (!isHeadless()) { createSurface(); }
     pickPhysicalDevice();
     createLogicalDevice();
     VULKAN_HPP_DEFAULT_DISPATCHER.init(m_device);
@@ -84,8 +87,10 @@ namespace renderer {
     }
 #endif
 
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-    core::Logger::info("Vulkan surface destroyed");
+    if (m_surface) {
+      vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+      core::Logger::info("Vulkan surface destroyed");
+    }
     vkDestroyInstance(m_instance, nullptr);
     core::Logger::info("Vulkan instance destroyed");
   }
@@ -157,6 +162,7 @@ namespace renderer {
   void VulkanDevice::pickPhysicalDevice()
   {
     auto devices = m_instance.enumeratePhysicalDevices().value;
+    if (devices.empty()) { core::panic("No Vulkan device found!"); }
 
     // Use an ordered map to automatically sort candidates by increasing score
     std::multimap<int, VkPhysicalDevice> candidates;
@@ -173,6 +179,9 @@ namespace renderer {
       m_physicalDevice = candidates.rbegin()->second;
       auto props = m_physicalDevice.getProperties();
       core::Logger::info("Selected device: {}", std::string(props.deviceName));
+      if (props.deviceType == vk::PhysicalDeviceType::eCpu) {
+        core::Logger::warn("No usable GPU, falling back to a CPU implementation");
+      }
     } else {
       core::panic("Failed to find a suitable GPU!");
     }
@@ -181,12 +190,13 @@ namespace renderer {
   void VulkanDevice::createLogicalDevice()
   {
     QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
+    m_queueFamilyIndices = indices;
 
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(),
       indices.transferFamily.value(),
-      indices.presentFamily.value(),
       indices.computeFamily.value() };
+    if (indices.presentFamily.has_value()) { uniqueQueueFamilies.insert(indices.presentFamily.value()); }
 
     core::Logger::info("Unique queue families: {}", uniqueQueueFamilies.size());
     if (uniqueQueueFamilies.size() < 2) {
@@ -194,7 +204,11 @@ namespace renderer {
     }
     core::Logger::info("Graphics queue family: {}", indices.graphicsFamily.value());
     core::Logger::info("Transfer queue family: {}", indices.transferFamily.value());
-    core::Logger::info("Present queue family: {}", indices.presentFamily.value());
+    if (indices.presentFamily.has_value()) {
+      core::Logger::info("Present queue family: {}", indices.presentFamily.value());
+    } else {
+      core::Logger::info("Headless device, no present queue");
+    }
     core::Logger::info("Compute queue family: {}", indices.computeFamily.value());
 
     float queuePriority = 1.0F;
@@ -203,12 +217,82 @@ namespace renderer {
         { .queueFamilyIndex = queueFamily, .queueCount = 1, .pQueuePriorities = &queuePriority });
     }
 
+    // Optional, the pipeline manager compiles whole pipelines without it
+    bool hasPipelineLibraryExtension = false;
+    // Optional, the image manager uploads through staging buffers without it
+    bool hasHostImageCopyExtension = false;
+    for (const auto &extension : m_physicalDevice.enumerateDeviceExtensionProperties().value) {
+      if (std::string_view(extension.extensionName) == VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) {
+        hasPipelineLibraryExtension = true;
+      }
+      if (std::string_view(extension.extensionName) == VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) {
+        hasHostImageCopyExtension = true;
+      }
+    }
+    if (hasPipelineLibraryExtension) {
+      auto features = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+      auto properties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>();
+      m_hasGraphicsPipelineLibrary =
+        features.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary;
+      m_hasFastPipelineLinking =
+        properties.get<vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>().graphicsPipelineLibraryFastLinking;
+    }
+
+    if (hasHostImageCopyExtension) {
+      auto features =
+        m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceHostImageCopyFeaturesEXT>();
+      // Uploaded images end up in the shader read only layout, host copies have to be able to write it
+      vk::PhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties = {};
+      vk::PhysicalDeviceProperties2 properties = { .pNext = &hostImageCopyProperties };
+      m_physicalDevice.getProperties2(&properties);
+      std::vector<vk::ImageLayout> copyDstLayouts(hostImageCopyProperties.copyDstLayoutCount);
+      hostImageCopyProperties.pCopyDstLayouts = copyDstLayouts.data();
+      m_physicalDevice.getProperties2(&properties);
+
+      m_hasHostImageCopy = features.get<vk::PhysicalDeviceHostImageCopyFeaturesEXT>().hostImageCopy
+                           && std::ranges::contains(copyDstLayouts, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
+    // Optional features are chained in front of the required ones
+    void *optionalFeatures = nullptr;
+
+    vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {
+      .graphicsPipelineLibrary = vk::True,
+    };
+    if (m_hasGraphicsPipelineLibrary) {
+      graphicsPipelineLibraryFeatures.pNext = optionalFeatures;
+      optionalFeatures = &graphicsPipelineLibraryFeatures;
+    }
+
+    vk::PhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures = {
+      .hostImageCopy = vk::True,
+    };
+    if (m_hasHostImageCopy) {
+      hostImageCopyFeatures.pNext = optionalFeatures;
+      optionalFeatures = &hostImageCopyFeatures;
+    }
+
     vk::PhysicalDeviceShaderObjectFeaturesEXT enabledShaderObjectFeaturesEXT = {
+      .pNext = optionalFeatures,
       .shaderObject = vk::True,
     };
 
-    vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {
+    // Synchronizes the async compute queue with graphics
+    vk::PhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {
       .pNext = &enabledShaderObjectFeaturesEXT,
+      .timelineSemaphore = vk::True,
+    };
+
+    // Barriers recorded by the render graph
+    vk::PhysicalDeviceSynchronization2Features synchronization2Features = {
+      .pNext = &timelineSemaphoreFeatures,
+      .synchronization2 = vk::True,
+    };
+
+    vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {
+      .pNext = &synchronization2Features,
       .dynamicRendering = vk::True,
     };
 
@@ -225,7 +309,14 @@ namespace renderer {
     vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
     descriptorIndexingFeatures.pNext = &shaderSubgroupFeatures;
     descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = vk::True;
+    descriptorIndexingFeatures.shaderStorageBufferArrayNonUniformIndexing = vk::True;
     descriptorIndexingFeatures.runtimeDescriptorArray = vk::True;
+    // Required by the bindless heap
+    descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = vk::True;
+    descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = vk::True;
+    descriptorIndexingFeatures.descriptorBindingStorageImageUpdateAfterBind = vk::True;
+    descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = vk::True;
+    descriptorIndexingFeatures.descriptorBindingPartiallyBound = vk::True;
 
     vk::PhysicalDeviceShaderAtomicInt64FeaturesKHR atomicInt64Features = {};
     atomicInt64Features.pNext = &descriptorIndexingFeatures;
@@ -257,8 +348,24 @@ namespace renderer {
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-    std::vector<const char *> enabledExtensions;
-    for (const char *extension : deviceExtensions) { enabledExtensions.push_back(extension); }
+    std::vector<const char *> enabledExtensions = getDeviceExtensions();
+
+    // Optional, without it VMA estimates the budget from its own allocations
+    for (const auto &extension : m_physicalDevice.enumerateDeviceExtensionProperties().value) {
+      if (std::string_view(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) {
+        enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_hasMemoryBudget = true;
+      }
+    }
+    if (m_hasGraphicsPipelineLibrary) {
+      enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+      enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+      core::Logger::info("Graphics pipeline libraries enabled (fast linking: {})", m_hasFastPipelineLinking);
+    }
+    if (m_hasHostImageCopy) {
+      enabledExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+      core::Logger::info("Host image copies enabled");
+    }
 
     createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
     createInfo.ppEnabledExtensionNames = enabledExtensions.data();
@@ -276,7 +383,11 @@ namespace renderer {
     m_device = m_physicalDevice.createDevice(createInfo).value;
     m_graphicsQueue = m_device.getQueue(indices.graphicsFamily.value(), 0);
     m_transferQueue = m_device.getQueue(indices.transferFamily.value(), 0);
-    m_presentQueue = m_device.getQueue(indices.presentFamily.value(), 0);
+    if (indices.presentFamily.has_value()) { m_presentQueue = m_device.getQueue(indices.presentFamily.value(), 0); }
+    m_computeQueue = m_device.getQueue(indices.computeFamily.value(), 0);
+    for (vk::Queue queue : { m_graphicsQueue, m_transferQueue, m_presentQueue, m_computeQueue }) {
+      if (queue) { m_queueMutexes.try_emplace(queue); }
+    }
 
     core::Logger::info("Vulkan logical device created");
   }
@@ -284,7 +395,7 @@ namespace renderer {
   void VulkanDevice::createAllocator()
   {
     VmaAllocatorCreateInfo allocatorInfo = {
-      .flags = 0,
+      .flags = m_hasMemoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u,
       .physicalDevice = m_physicalDevice,
       .device = m_device,
       .preferredLargeHeapBlockSize = 0,
@@ -299,7 +410,7 @@ namespace renderer {
 
     checkVkResult(vmaCreateAllocator(&allocatorInfo, &m_allocator));
 
-    core::Logger::info("Vulkan allocator created");
+    core::Logger::info("Vulkan allocator created, memory budget {}", m_hasMemoryBudget ? "queried" : "estimated");
   }
 
   void VulkanDevice::createCommandPool()
@@ -370,10 +481,14 @@ namespace renderer {
 
   std::vector<const char *> VulkanDevice::getRequiredExtensions()
   {
-    uint32_t sdlExtensionCount = 0;
-    const char *const *sdlExtensions = SDL_Vulkan_GetInstanceExtensions(&sdlExtensionCount);
+    std::vector<const char *> extensions;
 
-    std::vector<const char *> extensions(sdlExtensions, sdlExtensions + sdlExtensionCount);
+    // The surface extensions, SDL isn't asked at all when headless since there may be no video driver
+    if (!isHeadless()) {
+      uint32_t sdlExtensionCount = 0;
+      const char *const *sdlExtensions = SDL_Vulkan_GetInstanceExtensions(&sdlExtensionCount);
+      extensions.assign(sdlExtensions, sdlExtensions + sdlExtensionCount);
+    }
 
 #ifndef NDEBUG
     for (auto extension : extensions) { core::Logger::debug("SDL required extension: {}", extension); }
@@ -385,6 +500,13 @@ namespace renderer {
     return extensions;
   };
 
+  std::vector<const char *> VulkanDevice::getDeviceExtensions() const
+  {
+    std::vector<const char *> extensions = deviceExtensions;
+    if (!isHeadless()) { extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME); }
+    return extensions;
+  }
+
 #ifndef NDEBUG
   void VulkanDevice::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo)
   {
@@ -405,6 +527,16 @@ namespace renderer {
     auto deviceProperties = device.getProperties();
     // vk::PhysicalDeviceFeatures deviceFeatures = device.getFeatures();
 
+    // Make sure it supports the extensions we need
+    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    if (!extensionsSupported) { return 0; }
+
+    // And has the queues, a windowed device has to present to the surface
+    if (!findQueueFamilies(device).IsComplete(!isHeadless())) { return 0; }
+
+    // Software implementations (lavapipe, SwiftShader) are only used when there is no usable GPU, e.g. on CI machines
+    if (deviceProperties.deviceType == vk::PhysicalDeviceType::eCpu) { return 1; }
+
     int score = 0;
 
     // Discrete GPUs have a significant performance advantage
@@ -413,10 +545,6 @@ namespace renderer {
     // Maximum possible size of textures affects graphics quality
     score += deviceProperties.limits.maxImageDimension2D;
 
-    // Make sure it supports the extensions we need
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
-    if (!extensionsSupported) { return 0; }
-
     return score;
   }
 
@@ -424,7 +552,8 @@ namespace renderer {
   {
     auto availableExtensions = device.enumerateDeviceExtensionProperties().value;
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    std::vector<const char *> extensions = getDeviceExtensions();
+    std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
     for (const auto &extension : availableExtensions) { requiredExtensions.erase(extension.extensionName); }
 
@@ -457,18 +586,32 @@ namespace renderer {
         indices.computeFamilySupportsTimeStamps = queueFamily.timestampValidBits > 0;
       }
 
-      auto presentSupport = device.getSurfaceSupportKHR(i, m_surface).value;
+      if (m_surface) {
+        auto presentSupport = device.getSurfaceSupportKHR(i, m_surface).value;
 
-      if (queueFamily.queueCount > 0 && presentSupport) {
-        indices.presentFamily = i;
-        indices.presentFamilySupportsTimeStamps = queueFamily.timestampValidBits > 0;
+        if (queueFamily.queueCount > 0 && presentSupport) {
+          indices.presentFamily = i;
+          indices.presentFamilySupportsTimeStamps = queueFamily.timestampValidBits > 0;
+        }
       }
 
-      if (indices.IsComplete()) { break; }
+      if (indices.IsComplete(!isHeadless())) { break; }
 
       i++;
     }
 
+    // Prefer a family without graphics for compute, its queue runs on separate hardware queues and is what lets
+    // async compute overlap with rendering
+    for (uint32_t family = 0; family < queueFamilies.size(); family++) {
+      const auto &queueFamily = queueFamilies[family];
+      if (queueFamily.queueCount > 0 && queueFamily.queueFlags & vk::QueueFlagBits::eCompute
+          && !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)) {
+        indices.computeFamily = family;
+        indices.computeFamilySupportsTimeStamps = queueFamily.timestampValidBits > 0;
+        break;
+      }
+    }
+
     return indices;
   }
 
@@ -500,6 +643,27 @@ namespace renderer {
     image = vk::Image(rawImage);
   }
 
+  vk::Semaphore VulkanDevice::createTimelineSemaphore(uint64_t initialValue)
+  {
+    vk::SemaphoreTypeCreateInfo typeInfo = {
+      .semaphoreType = vk::SemaphoreType::eTimeline,
+      .initialValue = initialValue,
+    };
+    vk::SemaphoreCreateInfo semaphoreInfo = {
+      .pNext = &typeInfo,
+    };
+    return m_device.createSemaphore(semaphoreInfo).value;
+  }
+
+  bool VulkanDevice::supportsLazilyAllocatedMemory()
+  {
+    auto memoryProperties = m_physicalDevice.getMemoryProperties();
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+      if (memoryProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated) { return true; }
+    }
+    return false;
+  }
+
   vk::Format VulkanDevice::findSupportedFormat(const std::vector<vk::Format> &candidates,
     vk::ImageTiling tiling,
     vk::FormatFeatureFlags features)
@@ -516,6 +680,19 @@ namespace renderer {
     core::panic("Failed to find supported format!");
   }
 
+  void VulkanDevice::flushGPU()
+  {
+    // Always taken in the map's order, other callers only ever hold one
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto &[queue, mutex] : m_queueMutexes) { locks.emplace_back(mutex); }
+    m_device.waitIdle();
+  }
+
+  std::unique_lock<std::mutex> VulkanDevice::lockQueue(vk::Queue queue)
+  {
+    return std::unique_lock{ m_queueMutexes.at(queue) };
+  }
+
   vk::CommandBuffer VulkanDevice::beginSingleTimeCommands()
   {
     vk::CommandBufferAllocateInfo allocInfo = {
@@ -541,8 +718,11 @@ namespace renderer {
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    m_graphicsQueue.submit(submitInfo);
-    m_graphicsQueue.waitIdle();
+    {
+      auto lock = lockQueue(m_graphicsQueue);
+      m_graphicsQueue.submit(submitInfo);
+      m_graphicsQueue.waitIdle();
+    }
     m_device.freeCommandBuffers(m_graphicsCommandPool, commandBuffer);
   }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+#include <mutex>
 #include <optional>
 #include <vector>
 #include <vk_mem_alloc.h>
@@ -28,9 +30,10 @@ struct QueueFamilyIndices {
   std::optional<uint32_t> computeFamily;
   bool computeFamilySupportsTimeStamps;
 
-  bool IsComplete() {
-    return graphicsFamily.has_value() && transferFamily.has_value() && presentFamily.has_value() &&
-           computeFamily.has_value();
+  // Headless devices have no present family
+  bool IsComplete(bool needsPresent = true) {
+    return graphicsFamily.has_value() && transferFamily.has_value() &&
+           (presentFamily.has_value() || !needsPresent) && computeFamily.has_value();
   }
 };
 
@@ -38,26 +41,50 @@ class VulkanDevice {
   friend class VulkanBufferManager;
 
 public:
+  // Without a window the device is headless: no surface, no swapchain extension and no present queue. The renderer
+  // then draws into offscreen images, which also works on CPU implementations like lavapipe.
   VulkanDevice(SDL_Window *window);
   ~VulkanDevice();
 
+  inline bool isHeadless() const noexcept { return m_window == nullptr; }
+
   QueueFamilyIndices findQueueFamilies(const vk::PhysicalDevice device);
   inline QueueFamilyIndices findQueueFamilies() { return findQueueFamilies(m_physicalDevice); }
   SwapChainSupportDetails getSwapChainSupport();
 
-  inline void flushGPU() { m_device.waitIdle(); }
+  // Takes every queue lock, queues are externally synchronized for a device wait as well
+  void flushGPU();
   inline vk::Device &getDevice() noexcept { return m_device; };
   inline vk::PhysicalDevice &getPhysicalDevice() noexcept { return m_physicalDevice; };
   inline vk::SurfaceKHR &getSurface() noexcept { return m_surface; };
   inline vk::Queue &getGraphicsQueue() noexcept { return m_graphicsQueue; };
   inline vk::Queue &getTransferQueue() noexcept { return m_transferQueue; };
+  // Null on headless devices
   inline vk::Queue &getPresentQueue() noexcept { return m_presentQueue; };
+  // Same queue as graphics when the device has no separate compute family
+  inline vk::Queue &getComputeQueue() noexcept { return m_computeQueue; };
+  inline const QueueFamilyIndices &getQueueFamilyIndices() const noexcept { return m_queueFamilyIndices; };
+  // Submissions, presents and queue waits may come from several threads (see VulkanPresentThread), each has to hold
+  // the lock of its queue. Families sharing a queue share the lock.
+  [[nodiscard]] std::unique_lock<std::mutex> lockQueue(vk::Queue queue);
+  inline bool hasAsyncComputeQueue() const noexcept {
+    return m_queueFamilyIndices.computeFamily != m_queueFamilyIndices.graphicsFamily;
+  }
   inline VmaAllocator &getAllocator() noexcept { return m_allocator; };
   inline vk::CommandPool &getCommandPool() noexcept { return m_graphicsCommandPool; };
   inline vk::Instance &getInstance() noexcept { return m_instance; };
 
   void createImageWithInfo(const vk::ImageCreateInfo &imageInfo, VmaMemoryUsage memoryUsage, vk::Image &image,
                            VmaAllocation &imageAllocation);
+  // Tile based GPUs expose memory that is only committed if an attachment actually gets spilled out of tile memory
+  bool supportsLazilyAllocatedMemory();
+  vk::Semaphore createTimelineSemaphore(uint64_t initialValue = 0);
+  // VK_EXT_graphics_pipeline_library, enabled when available. Without fast linking, linking libraries may cost about
+  // as much as a full compile.
+  inline bool hasGraphicsPipelineLibrary() const noexcept { return m_hasGraphicsPipelineLibrary; }
+  inline bool hasFastPipelineLinking() const noexcept { return m_hasFastPipelineLinking; }
+  // VK_EXT_host_image_copy, enabled when available and able to copy into the shader read only layout
+  inline bool hasHostImageCopy() const noexcept { return m_hasHostImageCopy; }
   vk::Format findSupportedFormat(const std::vector<vk::Format> &candidates, vk::ImageTiling tiling,
                                  vk::FormatFeatureFlags features);
   vk::CommandBuffer beginSingleTimeCommands();
@@ -85,6 +112,7 @@ private:
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
 #endif
   std::vector<const char *> getRequiredExtensions();
+  std::vector<const char *> getDeviceExtensions() const;
   int rateDeviceSuitability(const vk::PhysicalDevice &device);
   bool checkDeviceExtensionSupport(const vk::PhysicalDevice &device);
 
@@ -98,10 +126,19 @@ private:
   vk::PhysicalDevice m_physicalDevice;
   vk::Device m_device;
   VmaAllocator m_allocator;
+  // VK_EXT_memory_budget, enabled when available
+  bool m_hasMemoryBudget = false;
+  bool m_hasGraphicsPipelineLibrary = false;
+  bool m_hasFastPipelineLinking = false;
+  bool m_hasHostImageCopy = false;
 
   vk::Queue m_graphicsQueue;
   vk::Queue m_transferQueue;
   vk::Queue m_presentQueue;
+  vk::Queue m_computeQueue;
+  QueueFamilyIndices m_queueFamilyIndices;
+  // One per distinct queue, only filled when the device is created
+  std::map<vk::Queue, std::mutex> m_queueMutexes;
 
   vk::CommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
   vk::CommandPool m_transferCommandPool = VK_NULL_HANDLE;
@@ -0,0 +1,343 @@
+#include "vulkan_dynamic_state.hpp"
+#include "vulkan_utils.hpp"
+#include <engine/core/assert.hpp>
+#include <limits>
+
+namespace engine::renderer {
+namespace {
+  constexpr size_t INVALID_STAGE_INDEX = std::numeric_limits<size_t>::max();
+
+  size_t getTrackedStageIndex(vk::ShaderStageFlagBits stage)
+  {
+    switch (stage) {
+    case vk::ShaderStageFlagBits::eVertex:
+      return 0;
+    case vk::ShaderStageFlagBits::eFragment:
+      return 1;
+    default:
+      return INVALID_STAGE_INDEX;
+    }
+  }
+
+  DynamicStateBlock::StencilFace toStencilFace(const DepthStencilOpDesc &desc)
+  {
+    return {
+      .failOp = static_cast<uint8_t>(desc.stencilFailOp),
+      .passOp = static_cast<uint8_t>(desc.stencilPassOp),
+      .depthFailOp = static_cast<uint8_t>(desc.stencilDepthFailOp),
+      .compareOp = static_cast<uint8_t>(desc.stencilFunc),
+    };
+  }
+
+  void setStencilFace(vk::CommandBuffer commandBuffer,
+    vk::StencilFaceFlags faceMask,
+    const DynamicStateBlock::StencilFace &face)
+  {
+    commandBuffer.setStencilOp(faceMask,
+      static_cast<vk::StencilOp>(face.failOp),
+      static_cast<vk::StencilOp>(face.passOp),
+      static_cast<vk::StencilOp>(face.depthFailOp),
+      static_cast<vk::CompareOp>(face.compareOp));
+  }
+}// namespace
+
+DynamicStateBlock DynamicStateBlock::create(PrimitiveTopology topology,
+  const RasterizerState &rasterizerState,
+  const DepthStencilState &depthStencilState,
+  const BlendState &blendState,
+  uint32_t colorAttachmentCount)
+{
+  core::assertion(colorAttachmentCount <= MAX_RENDER_TARGETS,
+    "A program can't write more than {} color attachments",
+    MAX_RENDER_TARGETS);
+
+  DynamicStateBlock block = {
+    .depthBiasConstant = rasterizerState.depthBias,
+    .depthBiasClamp = rasterizerState.depthBiasClamp,
+    .depthBiasSlope = rasterizerState.depthBiasSlopeFactor,
+    .topology = static_cast<uint8_t>(topology),
+    .polygonMode = static_cast<uint8_t>(rasterizerState.fillMode),
+    .cullMode = static_cast<uint8_t>(rasterizerState.cullMode),
+    .frontFace = static_cast<uint8_t>(rasterizerState.frontFaceMode),
+    .sampleCount = static_cast<uint8_t>(rasterizerState.sampleCount),
+    .depthCompareOp = static_cast<uint8_t>(depthStencilState.depthFunc),
+    .depthTestEnable = depthStencilState.depthEnable,
+    .depthWriteEnable = depthStencilState.depthWriteEnable,
+    .depthBiasEnable = rasterizerState.depthBiasEnabled,
+    .depthClampEnable = rasterizerState.depthClampEnabled,
+    .alphaToCoverageEnable = blendState.alphaToCoverageEnable,
+    .stencilTestEnable = depthStencilState.stencilEnable,
+    .stencilReadMask = depthStencilState.stencilReadMask,
+    .stencilWriteMask = depthStencilState.stencilWriteMask,
+    .stencilFront = toStencilFace(depthStencilState.frontFace),
+    .stencilBack = toStencilFace(depthStencilState.backFace),
+    .colorAttachmentCount = static_cast<uint8_t>(colorAttachmentCount),
+  };
+
+  for (uint32_t i = 0; i < colorAttachmentCount; i++) {
+    // Without independent blending every attachment follows the first one, like a pipeline would
+    const RTBlendState &target = blendState.independentBlendEnable ? blendState.renderTargets[i]
+                                                                   : blendState.renderTargets[0];
+    block.colorAttachments[i] = {
+      .blendEnable = target.blendEnable,
+      .srcColorBlend = static_cast<uint8_t>(target.srcBlend),
+      .dstColorBlend = static_cast<uint8_t>(target.destBlend),
+      .colorBlendOp = static_cast<uint8_t>(target.blendOp),
+      .srcAlphaBlend = static_cast<uint8_t>(target.srcBlendAlpha),
+      .dstAlphaBlend = static_cast<uint8_t>(target.destBlendAlpha),
+      .alphaBlendOp = static_cast<uint8_t>(target.blendOpAlpha),
+      .writeMask = target.renderTargetWriteMask,
+    };
+  }
+
+  block.hash = block.computeHash();
+  return block;
+}
+
+uint64_t DynamicStateBlock::computeHash() const
+{
+  size_t seed = 0;
+  hashCombine(seed, depthBiasConstant);
+  hashCombine(seed, depthBiasClamp);
+  hashCombine(seed, depthBiasSlope);
+  hashCombine(seed, topology);
+  hashCombine(seed, polygonMode);
+  hashCombine(seed, cullMode);
+  hashCombine(seed, frontFace);
+  hashCombine(seed, sampleCount);
+  hashCombine(seed, depthCompareOp);
+  hashCombine(seed, depthTestEnable);
+  hashCombine(seed, depthWriteEnable);
+  hashCombine(seed, depthBiasEnable);
+  hashCombine(seed, depthClampEnable);
+  hashCombine(seed, alphaToCoverageEnable);
+  hashCombine(seed, stencilTestEnable);
+  hashCombine(seed, stencilReadMask);
+  hashCombine(seed, stencilWriteMask);
+  for (const StencilFace &face : { stencilFront, stencilBack }) {
+    hashCombine(seed, face.failOp);
+    hashCombine(seed, face.passOp);
+    hashCombine(seed, face.depthFailOp);
+    hashCombine(seed, face.compareOp);
+  }
+  hashCombine(seed, colorAttachmentCount);
+  for (uint32_t i = 0; i < colorAttachmentCount; i++) {
+    const ColorAttachment &attachment = colorAttachments[i];
+    hashCombine(seed, attachment.blendEnable);
+    hashCombine(seed, attachment.srcColorBlend);
+    hashCombine(seed, attachment.dstColorBlend);
+    hashCombine(seed, attachment.colorBlendOp);
+    hashCombine(seed, attachment.srcAlphaBlend);
+    hashCombine(seed, attachment.dstAlphaBlend);
+    hashCombine(seed, attachment.alphaBlendOp);
+    hashCombine(seed, attachment.writeMask);
+  }
+  return seed;
+}
+
+void VulkanDynamicStateTracker::invalidate()
+{
+  m_hasState = false;
+  m_hasVertexInput = false;
+  m_hasStencilReference = false;
+  m_boundShaders.fill(nullptr);
+}
+
+void VulkanDynamicStateTracker::bindShaders(vk::CommandBuffer commandBuffer,
+  std::span<const vk::ShaderStageFlagBits> stages,
+  std::span<const vk::ShaderEXT> shaders)
+{
+  std::array<vk::ShaderStageFlagBits, MAX_TRACKED_STAGES> changedStages;
+  std::array<vk::ShaderEXT, MAX_TRACKED_STAGES> changedShaders;
+  uint32_t changedCount = 0;
+
+  for (size_t i = 0; i < stages.size(); i++) {
+    size_t stageIndex = getTrackedStageIndex(stages[i]);
+    core::assertion(stageIndex != INVALID_STAGE_INDEX, "Shader stage {} isn't tracked", vk::to_string(stages[i]));
+    if (m_boundShaders[stageIndex] == shaders[i]) { continue; }
+
+    m_boundShaders[stageIndex] = shaders[i];
+    changedStages[changedCount] = stages[i];
+    changedShaders[changedCount] = shaders[i];
+    changedCount++;
+  }
+
+  if (changedCount > 0) {
+    commandBuffer.bindShadersEXT(changedCount, changedStages.data(), changedShaders.data());
+  }
+}
+
+void VulkanDynamicStateTracker::setState(vk::CommandBuffer commandBuffer, const DynamicStateBlock &state)
+{
+  if (m_hasState && m_state.hash == state.hash && m_state == state) { return; }
+
+  const bool force = !m_hasState;
+  const DynamicStateBlock &current = m_state;
+
+  if (force) {
+    // Never driven by a program, only needs recording once per command buffer
+    commandBuffer.setRasterizerDiscardEnable(vk::False);
+    commandBuffer.setPrimitiveRestartEnable(vk::False);
+  }
+  if (force || current.topology != state.topology) {
+    commandBuffer.setPrimitiveTopology(static_cast<vk::PrimitiveTopology>(state.topology));
+  }
+  if (force || current.polygonMode != state.polygonMode) {
+    commandBuffer.setPolygonModeEXT(static_cast<vk::PolygonMode>(state.polygonMode));
+  }
+  if (force || current.cullMode != state.cullMode) {
+    commandBuffer.setCullMode(static_cast<vk::CullModeFlagBits>(state.cullMode));
+  }
+  if (force || current.frontFace != state.frontFace) {
+    commandBuffer.setFrontFace(static_cast<vk::FrontFace>(state.frontFace));
+  }
+  if (force || current.sampleCount != state.sampleCount) {
+    const auto samples = static_cast<vk::SampleCountFlagBits>(state.sampleCount);
+    // Two words cover up to 64 samples, only the ones the sample count needs are read
+    const std::array<vk::SampleMask, 2> sampleMask = { ~0u, ~0u };
+    commandBuffer.setRasterizationSamplesEXT(samples);
+    commandBuffer.setSampleMaskEXT(samples, sampleMask.data());
+  }
+  if (force || current.alphaToCoverageEnable != state.alphaToCoverageEnable) {
+    commandBuffer.setAlphaToCoverageEnableEXT(state.alphaToCoverageEnable);
+  }
+
+  setDepthState(commandBuffer, state, force);
+  setStencilState(commandBuffer, state, force);
+  setBlendState(commandBuffer, state, force);
+
+  m_state = state;
+  m_hasState = true;
+}
+
+void VulkanDynamicStateTracker::setDepthState(vk::CommandBuffer commandBuffer,
+  const DynamicStateBlock &state,
+  bool force)
+{
+  const DynamicStateBlock &current = m_state;
+
+  if (force || current.depthTestEnable != state.depthTestEnable) {
+    commandBuffer.setDepthTestEnable(state.depthTestEnable);
+  }
+  if (force || current.depthWriteEnable != state.depthWriteEnable) {
+    commandBuffer.setDepthWriteEnable(state.depthWriteEnable);
+  }
+  if (force || current.depthCompareOp != state.depthCompareOp) {
+    commandBuffer.setDepthCompareOp(static_cast<vk::CompareOp>(state.depthCompareOp));
+  }
+  if (force || current.depthClampEnable != state.depthClampEnable) {
+    commandBuffer.setDepthClampEnableEXT(state.depthClampEnable);
+  }
+  if (force || current.depthBiasEnable != state.depthBiasEnable) {
+    commandBuffer.setDepthBiasEnable(state.depthBiasEnable);
+  }
+
+  // The factors are only read while depth bias is enabled
+  const bool biasChanged = current.depthBiasConstant != state.depthBiasConstant
+                           || current.depthBiasClamp != state.depthBiasClamp
+                           || current.depthBiasSlope != state.depthBiasSlope || !current.depthBiasEnable;
+  if (state.depthBiasEnable && (force || biasChanged)) {
+    commandBuffer.setDepthBias(state.depthBiasConstant, state.depthBiasClamp, state.depthBiasSlope);
+  }
+}
+
+void VulkanDynamicStateTracker::setStencilState(vk::CommandBuffer commandBuffer,
+  const DynamicStateBlock &state,
+  bool force)
+{
+  const DynamicStateBlock &current = m_state;
+
+  if (force || current.stencilTestEnable != state.stencilTestEnable) {
+    commandBuffer.setStencilTestEnable(state.stencilTestEnable);
+  }
+  if (!state.stencilTestEnable) { return; }
+
+  // Ops and masks aren't recorded while the test is disabled, so whatever is tracked is stale after enabling it
+  const bool stale = force || !current.stencilTestEnable;
+  if (stale || current.stencilFront != state.stencilFront) {
+    setStencilFace(commandBuffer, vk::StencilFaceFlagBits::eFront, state.stencilFront);
+  }
+  if (stale || current.stencilBack != state.stencilBack) {
+    setStencilFace(commandBuffer, vk::StencilFaceFlagBits::eBack, state.stencilBack);
+  }
+  if (stale || current.stencilReadMask != state.stencilReadMask) {
+    commandBuffer.setStencilCompareMask(vk::StencilFaceFlagBits::eFrontAndBack, state.stencilReadMask);
+  }
+  if (stale || current.stencilWriteMask != state.stencilWriteMask) {
+    commandBuffer.setStencilWriteMask(vk::StencilFaceFlagBits::eFrontAndBack, state.stencilWriteMask);
+  }
+  if (!m_hasStencilReference) { setStencilReference(commandBuffer, 0); }
+}
+
+void VulkanDynamicStateTracker::setBlendState(vk::CommandBuffer commandBuffer,
+  const DynamicStateBlock &state,
+  bool force)
+{
+  const DynamicStateBlock &current = m_state;
+  const uint32_t count = state.colorAttachmentCount;
+  const bool countChanged = force || current.colorAttachmentCount != count;
+
+  std::array<vk::Bool32, MAX_RENDER_TARGETS> blendEnables;
+  std::array<vk::ColorBlendEquationEXT, MAX_RENDER_TARGETS> equations;
+  std::array<vk::ColorComponentFlags, MAX_RENDER_TARGETS> writeMasks;
+  bool enablesChanged = countChanged;
+  bool equationsChanged = countChanged;
+  bool writeMasksChanged = countChanged;
+  bool anyBlendEnabled = false;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const DynamicStateBlock::ColorAttachment &attachment = state.colorAttachments[i];
+    const DynamicStateBlock::ColorAttachment &previous = current.colorAttachments[i];
+
+    blendEnables[i] = attachment.blendEnable;
+    equations[i] = {
+      .srcColorBlendFactor = static_cast<vk::BlendFactor>(attachment.srcColorBlend),
+      .dstColorBlendFactor = static_cast<vk::BlendFactor>(attachment.dstColorBlend),
+      .colorBlendOp = static_cast<vk::BlendOp>(attachment.colorBlendOp),
+      .srcAlphaBlendFactor = static_cast<vk::BlendFactor>(attachment.srcAlphaBlend),
+      .dstAlphaBlendFactor = static_cast<vk::BlendFactor>(attachment.dstAlphaBlend),
+      .alphaBlendOp = static_cast<vk::BlendOp>(attachment.alphaBlendOp),
+    };
+    writeMasks[i] = static_cast<vk::ColorComponentFlags>(attachment.writeMask);
+
+    enablesChanged |= previous.blendEnable != attachment.blendEnable;
+    // Equations are only recorded while some attachment blends, so they're stale when blending gets turned on
+    equationsChanged |= previous.srcColorBlend != attachment.srcColorBlend
+                        || previous.dstColorBlend != attachment.dstColorBlend
+                        || previous.colorBlendOp != attachment.colorBlendOp
+                        || previous.srcAlphaBlend != attachment.srcAlphaBlend
+                        || previous.dstAlphaBlend != attachment.dstAlphaBlend
+                        || previous.alphaBlendOp != attachment.alphaBlendOp || !previous.blendEnable;
+    writeMasksChanged |= previous.writeMask != attachment.writeMask;
+    anyBlendEnabled |= attachment.blendEnable;
+  }
+
+  if (enablesChanged) { commandBuffer.setColorBlendEnableEXT(0, count, blendEnables.data()); }
+  if (anyBlendEnabled && equationsChanged) { commandBuffer.setColorBlendEquationEXT(0, count, equations.data()); }
+  if (writeMasksChanged) { commandBuffer.setColorWriteMaskEXT(0, count, writeMasks.data()); }
+}
+
+void VulkanDynamicStateTracker::setVertexInput(vk::CommandBuffer commandBuffer,
+  uint64_t vertexInputHash,
+  std::span<const vk::VertexInputBindingDescription2EXT> bindings,
+  std::span<const vk::VertexInputAttributeDescription2EXT> attributes)
+{
+  if (m_hasVertexInput && m_vertexInputHash == vertexInputHash) { return; }
+
+  commandBuffer.setVertexInputEXT(static_cast<uint32_t>(bindings.size()),
+    bindings.data(),
+    static_cast<uint32_t>(attributes.size()),
+    attributes.data());
+  m_vertexInputHash = vertexInputHash;
+  m_hasVertexInput = true;
+}
+
+void VulkanDynamicStateTracker::setStencilReference(vk::CommandBuffer commandBuffer, uint32_t reference)
+{
+  if (m_hasStencilReference && m_stencilReference == reference) { return; }
+
+  commandBuffer.setStencilReference(vk::StencilFaceFlagBits::eFrontAndBack, reference);
+  m_stencilReference = reference;
+  m_hasStencilReference = true;
+}
+}// namespace engine::renderer
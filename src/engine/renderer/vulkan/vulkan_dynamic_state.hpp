@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <engine/renderer/descriptors/pipeline_descriptors.hpp>
+#include <span>
+#include <vulkan/vulkan.hpp>
+
+namespace engine::renderer {
+// Fixed function state a shader object program is drawn with, packed down to the values the dynamic state commands
+// take. The hash lets the tracker skip a whole block in one comparison when consecutive programs share their state.
+struct DynamicStateBlock
+{
+  struct ColorAttachment
+  {
+    bool blendEnable = false;
+    uint8_t srcColorBlend = VK_BLEND_FACTOR_ONE;
+    uint8_t dstColorBlend = VK_BLEND_FACTOR_ZERO;
+    uint8_t colorBlendOp = VK_BLEND_OP_ADD;
+    uint8_t srcAlphaBlend = VK_BLEND_FACTOR_ONE;
+    uint8_t dstAlphaBlend = VK_BLEND_FACTOR_ZERO;
+    uint8_t alphaBlendOp = VK_BLEND_OP_ADD;
+    uint8_t writeMask = ColorWriteEnable::All;
+
+    bool operator==(const ColorAttachment &) const = default;
+  };
+
+  struct StencilFace
+  {
+    uint8_t failOp = VK_STENCIL_OP_KEEP;
+    uint8_t passOp = VK_STENCIL_OP_KEEP;
+    uint8_t depthFailOp = VK_STENCIL_OP_KEEP;
+    uint8_t compareOp = VK_COMPARE_OP_ALWAYS;
+
+    bool operator==(const StencilFace &) const = default;
+  };
+
+  float depthBiasConstant = 0.0f;
+  float depthBiasClamp = 0.0f;
+  float depthBiasSlope = 0.0f;
+
+  uint8_t topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  uint8_t polygonMode = VK_POLYGON_MODE_FILL;
+  uint8_t cullMode = VK_CULL_MODE_NONE;
+  uint8_t frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  uint8_t sampleCount = VK_SAMPLE_COUNT_1_BIT;
+  uint8_t depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  bool depthTestEnable = false;
+  bool depthWriteEnable = false;
+  bool depthBiasEnable = false;
+  bool depthClampEnable = false;
+  bool alphaToCoverageEnable = false;
+
+  bool stencilTestEnable = false;
+  uint8_t stencilReadMask = 0xff;
+  uint8_t stencilWriteMask = 0xff;
+  StencilFace stencilFront;
+  StencilFace stencilBack;
+
+  uint8_t colorAttachmentCount = 1;
+  std::array<ColorAttachment, MAX_RENDER_TARGETS> colorAttachments;
+
+  uint64_t hash = 0;
+
+  static DynamicStateBlock create(PrimitiveTopology topology,
+    const RasterizerState &rasterizerState,
+    const DepthStencilState &depthStencilState,
+    const BlendState &blendState,
+    uint32_t colorAttachmentCount);
+
+  bool operator==(const DynamicStateBlock &) const = default;
+
+private:
+  uint64_t computeHash() const;
+};
+
+// Remembers the dynamic state last recorded into one command buffer so binding a program only records the commands
+// that actually change something. Whatever else touches the state (binding a pipeline, a third party renderer) has to
+// invalidate the tracker, as does starting a new recording.
+class VulkanDynamicStateTracker
+{
+public:
+  void invalidate();
+
+  void bindShaders(vk::CommandBuffer commandBuffer,
+    std::span<const vk::ShaderStageFlagBits> stages,
+    std::span<const vk::ShaderEXT> shaders);
+  void setState(vk::CommandBuffer commandBuffer, const DynamicStateBlock &state);
+  void setVertexInput(vk::CommandBuffer commandBuffer,
+    uint64_t vertexInputHash,
+    std::span<const vk::VertexInputBindingDescription2EXT> bindings,
+    std::span<const vk::VertexInputAttributeDescription2EXT> attributes);
+  void setStencilReference(vk::CommandBuffer commandBuffer, uint32_t reference);
+
+private:
+  void setDepthState(vk::CommandBuffer commandBuffer, const DynamicStateBlock &state, bool force);
+  void setStencilState(vk::CommandBuffer commandBuffer, const DynamicStateBlock &state, bool force);
+  void setBlendState(vk::CommandBuffer commandBuffer, const DynamicStateBlock &state, bool force);
+
+private:
+  // Vertex and fragment, the only stages programs are built from
+  static constexpr size_t MAX_TRACKED_STAGES = 2;
+
+  bool m_hasState = false;
+  DynamicStateBlock m_state;
+
+  bool m_hasVertexInput = false;
+  uint64_t m_vertexInputHash = 0;
+
+  bool m_hasStencilReference = false;
+  uint32_t m_stencilReference = 0;
+
+  std::array<vk::ShaderEXT, MAX_TRACKED_STAGES> m_boundShaders;
+};
+}// namespace engine::renderer
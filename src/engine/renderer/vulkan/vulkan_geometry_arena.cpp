@@ -0,0 +1,129 @@
+#include "vulkan_geometry_arena.hpp"
+#include <algorithm>
+
+namespace engine::renderer {
+VulkanGeometryArena::VulkanGeometryArena(VulkanRenderer *renderer, const GeometryArenaDesc &desc)
+  : m_renderer{ renderer }, m_vertexStride{ desc.vertexStride }, m_stagingSize{ desc.stagingSize },
+    m_storage{ std::make_shared<Storage>(desc.maxVertices, desc.maxIndices) }
+{
+  core::assertion(desc.vertexStride > 0, "Geometry arena needs a vertex stride");
+
+  BufferDesc vertexDesc = {
+    .name = "geometry arena vertices",
+    .usage = BufferUsage::VERTEX_BUFFER | BufferUsage::STORAGE_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+    .size = static_cast<size_t>(desc.maxVertices) * desc.vertexStride,
+  };
+  m_vertexBuffer = m_renderer->createBuffer(vertexDesc);
+
+  BufferDesc indexDesc = {
+    .name = "geometry arena indices",
+    .usage = BufferUsage::INDEX_BUFFER | BufferUsage::STORAGE_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+    .size = static_cast<size_t>(desc.maxIndices) * sizeof(uint32_t),
+  };
+  m_indexBuffer = m_renderer->createBuffer(indexDesc);
+
+  BufferDesc stagingDesc = {
+    .name = "geometry arena staging",
+    .usage = BufferUsage::TRANSFER_SOURCE,
+    .cpuAccess = BufferCPUAccess::WriteOnly,
+    .size = desc.stagingSize,
+  };
+  m_stagingBuffer = m_renderer->createBuffer(stagingDesc);
+}
+
+VulkanGeometryArena::~VulkanGeometryArena()
+{
+  m_renderer->destroyBuffer(m_vertexBuffer);
+  m_renderer->destroyBuffer(m_indexBuffer);
+  m_renderer->destroyBuffer(m_stagingBuffer);
+}
+
+MeshHandle VulkanGeometryArena::addMesh(std::span<const std::byte> vertices, std::span<const uint32_t> indices)
+{
+  core::assertion(vertices.size() % m_vertexStride == 0, "Vertex data isn't a whole number of vertices");
+  core::assertion(!vertices.empty() && !indices.empty(), "Arena meshes are indexed and can't be empty");
+
+  const auto vertexCount = static_cast<uint32_t>(vertices.size() / m_vertexStride);
+  const auto indexCount = static_cast<uint32_t>(indices.size());
+
+  core::OffsetAllocator::Allocation vertexAllocation = m_storage->vertexAllocator.allocate(vertexCount);
+  if (!vertexAllocation.isValid()) { return {}; }
+
+  core::OffsetAllocator::Allocation indexAllocation = m_storage->indexAllocator.allocate(indexCount);
+  if (!indexAllocation.isValid()) {
+    m_storage->vertexAllocator.free(vertexAllocation);
+    return {};
+  }
+
+  upload(m_vertexBuffer, static_cast<vk::DeviceSize>(vertexAllocation.offset) * m_vertexStride, vertices);
+  upload(m_indexBuffer, static_cast<vk::DeviceSize>(indexAllocation.offset) * sizeof(uint32_t), std::as_bytes(indices));
+
+  Mesh mesh = {
+    .range = {
+      .firstIndex = indexAllocation.offset,
+      .indexCount = indexCount,
+      .vertexOffset = static_cast<int32_t>(vertexAllocation.offset),
+      .vertexCount = vertexCount,
+    },
+    .vertexAllocation = vertexAllocation,
+    .indexAllocation = indexAllocation,
+  };
+
+  MeshHandle handle;
+  if (m_storage->freeMeshIndices.empty()) {
+    handle.index = static_cast<uint32_t>(m_storage->meshes.size());
+    m_storage->meshes.push_back(mesh);
+  } else {
+    handle.index = m_storage->freeMeshIndices.front();
+    m_storage->freeMeshIndices.pop();
+    m_storage->meshes[handle.index] = mesh;
+  }
+  return handle;
+}
+
+void VulkanGeometryArena::removeMesh(MeshHandle mesh)
+{
+  core::assertion(mesh.isValid() && mesh.index < m_storage->meshes.size(), "Invalid mesh handle");
+  m_renderer->deferDeletion([storage = m_storage, index = mesh.index] {
+    Mesh &removed = storage->meshes[index];
+    storage->vertexAllocator.free(removed.vertexAllocation);
+    storage->indexAllocator.free(removed.indexAllocation);
+    removed = {};
+    storage->freeMeshIndices.push(index);
+  });
+}
+
+const MeshRange &VulkanGeometryArena::getMesh(MeshHandle mesh) const
+{
+  core::assertion(mesh.isValid() && mesh.index < m_storage->meshes.size(), "Invalid mesh handle");
+  return m_storage->meshes[mesh.index].range;
+}
+
+void VulkanGeometryArena::bind(vk::CommandBuffer commandBuffer) const
+{
+  m_renderer->setVertexBuffer(commandBuffer, 0, m_vertexBuffer);
+  m_renderer->setIndexBuffer(commandBuffer, m_indexBuffer, IndexFormat::Uint32);
+}
+
+void VulkanGeometryArena::draw(vk::CommandBuffer commandBuffer,
+  MeshHandle mesh,
+  uint32_t instanceCount,
+  uint32_t firstInstance) const
+{
+  const MeshRange &range = getMesh(mesh);
+  commandBuffer.drawIndexed(range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, firstInstance);
+}
+
+void VulkanGeometryArena::upload(size_t dstBuffer, vk::DeviceSize dstOffset, std::span<const std::byte> data)
+{
+  // Each chunk waits for the graphics queue, after which the staging buffer can take the next one
+  for (vk::DeviceSize offset = 0; offset < data.size(); offset += m_stagingSize) {
+    const vk::DeviceSize size = std::min<vk::DeviceSize>(m_stagingSize, data.size() - offset);
+    m_renderer->writeToBuffer(m_stagingBuffer, const_cast<std::byte *>(data.data() + offset), size);
+
+    VkCommandBuffer commandBuffer = m_renderer->beginSingleTimeCommands();
+    m_renderer->copyBuffer(commandBuffer, dstBuffer, dstOffset + offset, m_stagingBuffer, 0, size);
+    m_renderer->endSingleTimeCommands(commandBuffer);
+  }
+}
+}// namespace engine::renderer
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <engine/core/offset_allocator.hpp>
+#include <engine/renderer/vulkan_renderer.hpp>
+#include <memory>
+#include <queue>
+#include <span>
+
+namespace engine::renderer {
+struct GeometryArenaDesc
+{
+  // Every mesh in the arena shares the vertex layout
+  uint32_t vertexStride = 0;
+  uint32_t maxVertices = 0;
+  uint32_t maxIndices = 0;
+  // Uploads larger than this are split
+  vk::DeviceSize stagingSize = 4 * 1024 * 1024;
+};
+
+struct MeshHandle
+{
+  static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+  uint32_t index = INVALID_INDEX;
+
+  inline bool isValid() const noexcept { return index != INVALID_INDEX; }
+  bool operator==(const MeshHandle &) const = default;
+};
+
+// What a draw of the mesh passes to vkCmdDrawIndexed (or puts in an indirect command)
+struct MeshRange
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  int32_t vertexOffset;
+  uint32_t vertexCount;
+};
+
+// One device local vertex buffer and one index buffer (32 bit indices) holding many meshes. Ranges are handed out by
+// an OffsetAllocator, so meshes can stream in and out at any time without fragmenting the buffers, and everything in
+// the arena draws after a single bind(), by direct or indirect draws with the ranges from getMesh(). Both buffers are
+// also storage buffers for shaders pulling vertices themselves.
+class VulkanGeometryArena
+{
+public:
+  VulkanGeometryArena(VulkanRenderer *renderer, const GeometryArenaDesc &desc);
+  // Frames in flight may still draw from the buffers, they're destroyed once those are done. Before the renderer.
+  ~VulkanGeometryArena();
+
+  VulkanGeometryArena(const VulkanGeometryArena &) = delete;
+  VulkanGeometryArena &operator=(const VulkanGeometryArena &) = delete;
+
+  // Indices are relative to the mesh's first vertex. Waits for the upload. Returns an invalid handle when the arena
+  // has no room left.
+  [[nodiscard]] MeshHandle addMesh(std::span<const std::byte> vertices, std::span<const uint32_t> indices);
+  template<typename Vertex>
+  [[nodiscard]] MeshHandle addMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+  {
+    core::assertion(sizeof(Vertex) == m_vertexStride, "Vertex size {} doesn't match the arena stride", sizeof(Vertex));
+    return addMesh(std::as_bytes(vertices), indices);
+  }
+  // Frames in flight may still draw the mesh, its ranges become reusable once the frame being recorded has finished
+  void removeMesh(MeshHandle mesh);
+
+  const MeshRange &getMesh(MeshHandle mesh) const;
+
+  // Binds the vertex buffer to slot 0 and the index buffer
+  void bind(vk::CommandBuffer commandBuffer) const;
+  void draw(vk::CommandBuffer commandBuffer,
+    MeshHandle mesh,
+    uint32_t instanceCount = 1,
+    uint32_t firstInstance = 0) const;
+
+  inline size_t getVertexBuffer() const noexcept { return m_vertexBuffer; }
+  inline size_t getIndexBuffer() const noexcept { return m_indexBuffer; }
+  inline core::OffsetAllocator::StorageReport getVertexStorageReport() const
+  {
+    return m_storage->vertexAllocator.getStorageReport();
+  }
+  inline core::OffsetAllocator::StorageReport getIndexStorageReport() const
+  {
+    return m_storage->indexAllocator.getStorageReport();
+  }
+
+private:
+  struct Mesh
+  {
+    MeshRange range;
+    core::OffsetAllocator::Allocation vertexAllocation;
+    core::OffsetAllocator::Allocation indexAllocation;
+  };
+
+  // Shared with the deletions of removed meshes, which may run after the arena is gone
+  struct Storage
+  {
+    Storage(uint32_t maxVertices, uint32_t maxIndices) : vertexAllocator{ maxVertices }, indexAllocator{ maxIndices } {}
+
+    // In vertices and indices
+    core::OffsetAllocator vertexAllocator;
+    core::OffsetAllocator indexAllocator;
+
+    std::vector<Mesh> meshes;
+    std::queue<uint32_t> freeMeshIndices;
+  };
+
+  void upload(size_t dstBuffer, vk::DeviceSize dstOffset, std::span<const std::byte> data);
+
+private:
+  VulkanRenderer *m_renderer;
+  uint32_t m_vertexStride;
+  vk::DeviceSize m_stagingSize;
+
+  size_t m_vertexBuffer;
+  size_t m_indexBuffer;
+  size_t m_stagingBuffer;
+
+  std::shared_ptr<Storage> m_storage;
+};
+}// namespace engine::renderer
@@ -0,0 +1,493 @@
+#include "vulkan_image_manager.hpp"
+#include "vulkan_utils.hpp"
+#include <algorithm>
+#include <bit>
+#include <engine/core/assert.hpp>
+#include <engine/core/logger.hpp>
+#include <mutex>
+
+namespace engine {
+namespace renderer {
+  namespace {
+    // Size of one addressable unit of the format, a texel or a compressed block
+    struct FormatBlock {
+      uint32_t width = 1;
+      uint32_t height = 1;
+      uint32_t bytes = 0;
+    };
+
+    FormatBlock getFormatBlock(vk::Format format)
+    {
+      switch (format) {
+      case vk::Format::eR8Unorm:
+      case vk::Format::eR8Srgb:
+        return { 1, 1, 1 };
+      case vk::Format::eR8G8Unorm:
+      case vk::Format::eR16Sfloat:
+      case vk::Format::eD16Unorm:
+        return { 1, 1, 2 };
+      case vk::Format::eR8G8B8A8Unorm:
+      case vk::Format::eR8G8B8A8Srgb:
+      case vk::Format::eB8G8R8A8Unorm:
+      case vk::Format::eB8G8R8A8Srgb:
+      case vk::Format::eA2B10G10R10UnormPack32:
+      case vk::Format::eB10G11R11UfloatPack32:
+      case vk::Format::eR16G16Sfloat:
+      case vk::Format::eR32Sfloat:
+      case vk::Format::eD32Sfloat:
+        return { 1, 1, 4 };
+      case vk::Format::eR16G16B16A16Sfloat:
+      case vk::Format::eR32G32Sfloat:
+        return { 1, 1, 8 };
+      case vk::Format::eR32G32B32A32Sfloat:
+        return { 1, 1, 16 };
+      case vk::Format::eBc1RgbUnormBlock:
+      case vk::Format::eBc1RgbSrgbBlock:
+      case vk::Format::eBc1RgbaUnormBlock:
+      case vk::Format::eBc1RgbaSrgbBlock:
+      case vk::Format::eBc4UnormBlock:
+      case vk::Format::eBc4SnormBlock:
+      case vk::Format::eEtc2R8G8B8UnormBlock:
+      case vk::Format::eEtc2R8G8B8SrgbBlock:
+        return { 4, 4, 8 };
+      case vk::Format::eBc2UnormBlock:
+      case vk::Format::eBc2SrgbBlock:
+      case vk::Format::eBc3UnormBlock:
+      case vk::Format::eBc3SrgbBlock:
+      case vk::Format::eBc5UnormBlock:
+      case vk::Format::eBc5SnormBlock:
+      case vk::Format::eBc6HUfloatBlock:
+      case vk::Format::eBc6HSfloatBlock:
+      case vk::Format::eBc7UnormBlock:
+      case vk::Format::eBc7SrgbBlock:
+      case vk::Format::eEtc2R8G8B8A8UnormBlock:
+      case vk::Format::eEtc2R8G8B8A8SrgbBlock:
+      case vk::Format::eAstc4x4UnormBlock:
+      case vk::Format::eAstc4x4SrgbBlock:
+        return { 4, 4, 16 };
+      default:
+        core::panic("Image uploads don't support format {}", vk::to_string(format));
+        return {};
+      }
+    }
+
+    vk::ImageAspectFlags getAspect(vk::Format format)
+    {
+      switch (format) {
+      case vk::Format::eD16Unorm:
+      case vk::Format::eX8D24UnormPack32:
+      case vk::Format::eD32Sfloat:
+        return vk::ImageAspectFlagBits::eDepth;
+      case vk::Format::eS8Uint:
+        return vk::ImageAspectFlagBits::eStencil;
+      case vk::Format::eD16UnormS8Uint:
+      case vk::Format::eD24UnormS8Uint:
+      case vk::Format::eD32SfloatS8Uint:
+        return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+      default:
+        return vk::ImageAspectFlagBits::eColor;
+      }
+    }
+
+    vk::DeviceSize getMipSize(FormatBlock block, vk::Extent2D extent, uint32_t mip)
+    {
+      const uint32_t width = std::max(extent.width >> mip, 1u);
+      const uint32_t height = std::max(extent.height >> mip, 1u);
+      const uint32_t blocksX = (width + block.width - 1) / block.width;
+      const uint32_t blocksY = (height + block.height - 1) / block.height;
+      return static_cast<vk::DeviceSize>(blocksX) * blocksY * block.bytes;
+    }
+
+    vk::ImageMemoryBarrier2 createMipBarrier(vk::Image image,
+      uint32_t baseMip,
+      uint32_t mipCount,
+      vk::ImageLayout oldLayout,
+      vk::ImageLayout newLayout,
+      vk::PipelineStageFlags2 srcStages,
+      vk::AccessFlags2 srcAccess,
+      vk::PipelineStageFlags2 dstStages,
+      vk::AccessFlags2 dstAccess)
+    {
+      return { .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = dstStages,
+        .dstAccessMask = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = image,
+        .subresourceRange = { vk::ImageAspectFlagBits::eColor, baseMip, mipCount, 0, 1 } };
+    }
+
+    void recordBarriers(vk::CommandBuffer commandBuffer, std::span<const vk::ImageMemoryBarrier2> barriers)
+    {
+      vk::DependencyInfo dependencyInfo = {
+        .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+        .pImageMemoryBarriers = barriers.data(),
+      };
+      commandBuffer.pipelineBarrier2(dependencyInfo);
+    }
+
+    // Where uploaded images are read from
+    constexpr vk::PipelineStageFlags2 SHADER_STAGES =
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader;
+  }// namespace
+
+  VulkanImageManager::VulkanImageManager(VulkanDevice *device,
+    VulkanBufferManager *bufferManager,
+    VulkanBindlessHeap *bindlessHeap,
+    const VulkanTimeline *frameTimeline,
+    VulkanDeletionQueue *deletionQueue)
+    : m_device{ device }, m_bufferManager{ bufferManager }, m_bindlessHeap{ bindlessHeap },
+      m_frameTimeline{ frameTimeline }, m_deletionQueue{ deletionQueue }, m_samplerCache{ device, bindlessHeap }
+  {}
+
+  size_t VulkanImageManager::createImage(ImageDesc &desc, const ImageData *data)
+  {
+    const uint32_t fullChain = std::bit_width(std::max(desc.width, desc.height));
+    uint32_t mipLevels = desc.mipLevels == 0 ? fullChain : std::min(desc.mipLevels, fullChain);
+
+    // Block compressed mips can't be blitted, they have to come with the data. Only images getting data need a format
+    // the uploads know.
+    bool generateMips = data && data->generateMips && mipLevels > 1;
+    core::assertion(!(generateMips && getFormatBlock(desc.format).width > 1),
+      "Mips of compressed image {} can't be generated",
+      desc.name);
+    if (generateMips && !canGenerateMips(desc.format)) {
+      core::Logger::warn("Format {} can't be blitted with linear filtering, {} gets a single mip",
+        vk::to_string(desc.format),
+        desc.name);
+      mipLevels = 1;
+      generateMips = false;
+    }
+
+    vk::ImageUsageFlags usage = desc.usage;
+    const bool isWritten = data || desc.streamed;
+    // Host copies can't blit, images generating their mips stay on the staged path
+    const bool hostWritable =
+      isWritten && !generateMips && m_device->hasHostImageCopy() && canCopyFromHost(desc.format, usage);
+    if (hostWritable) {
+      usage |= vk::ImageUsageFlagBits::eHostTransferEXT;
+    } else if (isWritten) {
+      usage |= vk::ImageUsageFlagBits::eTransferDst;
+    }
+    if (generateMips) { usage |= vk::ImageUsageFlagBits::eTransferSrc; }
+
+    const size_t imageId = getNewImageId();
+    Image &image = m_images[imageId];
+    image.name = desc.name;
+    image.format = desc.format;
+    image.extent = { desc.width, desc.height };
+    image.mipLevels = mipLevels;
+    image.usage = usage;
+    image.hostWritable = hostWritable;
+
+    vk::ImageCreateInfo imageInfo = {
+      .imageType = vk::ImageType::e2D,
+      .format = desc.format,
+      .extent = { .width = desc.width, .height = desc.height, .depth = 1 },
+      .mipLevels = mipLevels,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    };
+    m_device->createImageWithInfo(imageInfo, VMA_MEMORY_USAGE_GPU_ONLY, image.image, image.allocation);
+
+    vk::ImageViewCreateInfo viewInfo = {
+      .image = image.image,
+      .viewType = vk::ImageViewType::e2D,
+      .format = desc.format,
+      .subresourceRange = { getAspect(desc.format), 0, mipLevels, 0, 1 },
+    };
+    image.view = m_device->getDevice().createImageView(viewInfo).value;
+
+    if (data && hostWritable) {
+      copyFromHost(image, *data);
+    } else if (data) {
+      upload(image, *data, generateMips);
+    }
+
+    if (usage & vk::ImageUsageFlagBits::eSampled) {
+      image.bindlessSlot = m_bindlessHeap->registerSampledImage(image.view);
+    }
+
+#ifndef NDEBUG
+    // VK_EXT_debug_utils is only enabled in debug builds
+    const vk::DebugUtilsObjectNameInfoEXT nameInfo = {
+      .objectType = vk::ObjectType::eImage,
+      .objectHandle = reinterpret_cast<uint64_t>(static_cast<VkImage>(image.image)),
+      .pObjectName = image.name.c_str(),
+    };
+    m_device->getDevice().setDebugUtilsObjectNameEXT(nameInfo);
+#endif
+
+    return imageId;
+  }
+
+  void VulkanImageManager::writeImage(size_t imageId, const ImageData &data)
+  {
+    // Not held while copying or waiting for the upload
+    std::shared_lock lock(m_imagesMutex);
+    const Image image = m_images[imageId];
+    lock.unlock();
+
+    core::assertion(image.hostWritable || bool(image.usage & vk::ImageUsageFlagBits::eTransferDst),
+      "{} wasn't created to be written",
+      image.name);
+
+    if (image.hostWritable) {
+      copyFromHost(image, data);
+    } else {
+      upload(image, data, false);
+    }
+  }
+
+  void VulkanImageManager::copyFromHost(const Image &image, const ImageData &data)
+  {
+    const FormatBlock block = getFormatBlock(image.format);
+
+    // The whole chain back to back, like the staged path without mip generation
+    std::vector<vk::MemoryToImageCopyEXT> regions;
+    vk::DeviceSize size = 0;
+    for (uint32_t mip = 0; mip < image.mipLevels; mip++) {
+      regions.push_back({
+        .pHostPointer = data.texels.data() + size,
+        .imageSubresource = { vk::ImageAspectFlagBits::eColor, mip, 0, 1 },
+        .imageExtent = { std::max(image.extent.width >> mip, 1u), std::max(image.extent.height >> mip, 1u), 1 },
+      });
+      size += getMipSize(block, image.extent, mip);
+    }
+    core::assertion(data.texels.size() >= size,
+      "{} needs {} bytes of texels for {} mips, got {}",
+      image.name,
+      size,
+      image.mipLevels,
+      data.texels.size());
+
+    // From undefined, the previous contents are replaced anyway
+    const vk::HostImageLayoutTransitionInfoEXT transition = {
+      .image = image.image,
+      .oldLayout = vk::ImageLayout::eUndefined,
+      .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+      .subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, image.mipLevels, 0, 1 },
+    };
+    vk::Result result = m_device->getDevice().transitionImageLayoutEXT(transition);
+    if (result != vk::Result::eSuccess) {
+      core::panic("Failed to transition {} on the host: {}", image.name, vk::to_string(result));
+    }
+
+    const vk::CopyMemoryToImageInfoEXT copyInfo = {
+      .dstImage = image.image,
+      .dstImageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+      .regionCount = static_cast<uint32_t>(regions.size()),
+      .pRegions = regions.data(),
+    };
+    result = m_device->getDevice().copyMemoryToImageEXT(copyInfo);
+    if (result != vk::Result::eSuccess) {
+      core::panic("Failed to copy {} from the host: {}", image.name, vk::to_string(result));
+    }
+  }
+
+  void VulkanImageManager::upload(const Image &image, const ImageData &data, bool generateMips)
+  {
+    const FormatBlock block = getFormatBlock(image.format);
+
+    // Either mip 0 alone or the whole chain back to back
+    const uint32_t providedMips = generateMips ? 1 : image.mipLevels;
+    std::vector<vk::BufferImageCopy> regions;
+    vk::DeviceSize stagingSize = 0;
+    for (uint32_t mip = 0; mip < providedMips; mip++) {
+      regions.push_back({
+        .bufferOffset = stagingSize,
+        .imageSubresource = { vk::ImageAspectFlagBits::eColor, mip, 0, 1 },
+        .imageExtent = { std::max(image.extent.width >> mip, 1u), std::max(image.extent.height >> mip, 1u), 1 },
+      });
+      stagingSize += getMipSize(block, image.extent, mip);
+    }
+    core::assertion(data.texels.size() >= stagingSize,
+      "{} needs {} bytes of texels for {} mips, got {}",
+      image.name,
+      stagingSize,
+      providedMips,
+      data.texels.size());
+
+    BufferDesc stagingDesc = {
+      .name = image.name + " staging",
+      .usage = BufferUsage::TRANSFER_SOURCE,
+      .cpuAccess = BufferCPUAccess::WriteOnly,
+      .size = stagingSize,
+    };
+    const size_t stagingBuffer = m_bufferManager->createBuffer(stagingDesc);
+    checkVkResult(vmaCopyMemoryToAllocation(m_device->getAllocator(),
+      data.texels.data(),
+      m_bufferManager->getBufferAllocation(stagingBuffer),
+      0,
+      stagingSize));
+
+    vk::CommandBuffer commandBuffer = m_device->beginSingleTimeCommands();
+
+    const vk::ImageMemoryBarrier2 toTransfer = createMipBarrier(image.image,
+      0,
+      image.mipLevels,
+      vk::ImageLayout::eUndefined,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::PipelineStageFlagBits2::eNone,
+      vk::AccessFlagBits2::eNone,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite);
+    recordBarriers(commandBuffer, { &toTransfer, 1 });
+
+    commandBuffer.copyBufferToImage(
+      m_bufferManager->getBuffer(stagingBuffer), image.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+    if (generateMips) {
+      // Each mip is blitted from the one above, which first turns into a transfer source
+      for (uint32_t mip = 1; mip < image.mipLevels; mip++) {
+        const vk::ImageMemoryBarrier2 toSource = createMipBarrier(image.image,
+          mip - 1,
+          1,
+          vk::ImageLayout::eTransferDstOptimal,
+          vk::ImageLayout::eTransferSrcOptimal,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferWrite,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead);
+        recordBarriers(commandBuffer, { &toSource, 1 });
+
+        vk::ImageBlit blit = {
+          .srcSubresource = { vk::ImageAspectFlagBits::eColor, mip - 1, 0, 1 },
+          .dstSubresource = { vk::ImageAspectFlagBits::eColor, mip, 0, 1 },
+        };
+        blit.srcOffsets[1] = vk::Offset3D{ .x = static_cast<int32_t>(std::max(image.extent.width >> (mip - 1), 1u)),
+          .y = static_cast<int32_t>(std::max(image.extent.height >> (mip - 1), 1u)),
+          .z = 1 };
+        blit.dstOffsets[1] = vk::Offset3D{ .x = static_cast<int32_t>(std::max(image.extent.width >> mip, 1u)),
+          .y = static_cast<int32_t>(std::max(image.extent.height >> mip, 1u)),
+          .z = 1 };
+        commandBuffer.blitImage(image.image,
+          vk::ImageLayout::eTransferSrcOptimal,
+          image.image,
+          vk::ImageLayout::eTransferDstOptimal,
+          blit,
+          vk::Filter::eLinear);
+      }
+
+      // Every mip but the last was a blit source
+      const std::array<vk::ImageMemoryBarrier2, 2> toShader = {
+        createMipBarrier(image.image,
+          0,
+          image.mipLevels - 1,
+          vk::ImageLayout::eTransferSrcOptimal,
+          vk::ImageLayout::eShaderReadOnlyOptimal,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferRead,
+          SHADER_STAGES,
+          vk::AccessFlagBits2::eShaderSampledRead),
+        createMipBarrier(image.image,
+          image.mipLevels - 1,
+          1,
+          vk::ImageLayout::eTransferDstOptimal,
+          vk::ImageLayout::eShaderReadOnlyOptimal,
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferWrite,
+          SHADER_STAGES,
+          vk::AccessFlagBits2::eShaderSampledRead),
+      };
+      recordBarriers(commandBuffer, toShader);
+    } else {
+      const vk::ImageMemoryBarrier2 toShader = createMipBarrier(image.image,
+        0,
+        image.mipLevels,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        SHADER_STAGES,
+        vk::AccessFlagBits2::eShaderSampledRead);
+      recordBarriers(commandBuffer, { &toShader, 1 });
+    }
+
+    // Waits for the queue, the staging buffer can go right away
+    m_device->endSingleTimeCommands(commandBuffer);
+    m_bufferManager->destroyBuffer(stagingBuffer);
+  }
+
+  bool VulkanImageManager::canGenerateMips(vk::Format format)
+  {
+    constexpr vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eBlitSrc
+                                                | vk::FormatFeatureFlagBits::eBlitDst
+                                                | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    const vk::FormatProperties properties = m_device->getPhysicalDevice().getFormatProperties(format);
+    return (properties.optimalTilingFeatures & required) == required;
+  }
+
+  bool VulkanImageManager::canCopyFromHost(vk::Format format, vk::ImageUsageFlags usage)
+  {
+    const uint64_t key = (static_cast<uint64_t>(format) << 32) | static_cast<uint32_t>(usage);
+    if (auto it = m_hostCopyFormats.find(key); it != m_hostCopyFormats.end()) { return it->second; }
+
+    const vk::PhysicalDeviceImageFormatInfo2 formatInfo = {
+      .format = format,
+      .type = vk::ImageType::e2D,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = usage | vk::ImageUsageFlagBits::eHostTransferEXT,
+    };
+    vk::HostImageCopyDevicePerformanceQueryEXT performance = {};
+    vk::ImageFormatProperties2 properties = { .pNext = &performance };
+    const bool canCopy =
+      m_device->getPhysicalDevice().getImageFormatProperties2(&formatInfo, &properties) == vk::Result::eSuccess
+      && performance.optimalDeviceAccess;
+
+    if (!canCopy) {
+      core::Logger::info("Format {} with usage {} is uploaded through staging buffers",
+        vk::to_string(format),
+        vk::to_string(usage));
+    }
+    m_hostCopyFormats.emplace(key, canCopy);
+    return canCopy;
+  }
+
+  void VulkanImageManager::destroyImage(size_t imageId)
+  {
+    std::unique_lock lock(m_imagesMutex);
+    Image &image = m_images[imageId];
+    if (image.bindlessSlot != VulkanBindlessHeap::INVALID_SLOT) {
+      m_bindlessHeap->releaseSampledImage(image.bindlessSlot);
+    }
+    m_deletionQueue->push(m_frameTimeline->getNextValue(),
+      [device = m_device, view = image.view, vkImage = image.image, allocation = image.allocation] {
+        device->getDevice().destroyImageView(view);
+        vmaDestroyImage(device->getAllocator(), vkImage, allocation);
+      });
+    image = {};
+    m_freeIds.push(imageId);
+  }
+
+  size_t VulkanImageManager::getNewImageId()
+  {
+    std::unique_lock lock(m_imagesMutex);
+    if (m_freeIds.empty()) {
+      size_t imageId = m_images.size();
+      m_images.emplace_back();
+      return imageId;
+    }
+
+    size_t imageId = m_freeIds.front();
+    m_freeIds.pop();
+    return imageId;
+  }
+
+  VulkanImageManager::~VulkanImageManager()
+  {
+    for (auto &image : m_images) {
+      if (!image.image) { continue; }
+      m_device->getDevice().destroyImageView(image.view);
+      vmaDestroyImage(m_device->getAllocator(), image.image, image.allocation);
+    }
+  }
+}// namespace renderer
+}// namespace engine
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_bindless_heap.hpp>
+#include <engine/renderer/vulkan/vulkan_buffer_manager.hpp>
+#include <engine/renderer/vulkan/vulkan_deletion_queue.hpp>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_sampler_cache.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <queue>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+namespace engine {
+namespace renderer {
+struct Image {
+  std::string name; // For debugging
+  VmaAllocation allocation = nullptr;
+  vk::Image image;
+  vk::ImageView view;
+  vk::Format format = vk::Format::eUndefined;
+  vk::Extent2D extent;
+  uint32_t mipLevels = 1;
+  vk::ImageUsageFlags usage; // Including what uploads need
+  uint32_t bindlessSlot = VulkanBindlessHeap::INVALID_SLOT; // Only sampled images get one
+  bool hostWritable = false; // Created for host image copies, see VulkanImageManager::writeImage
+};
+
+struct ImageDesc {
+  std::string name = ""; // For debugging
+  vk::Format format = vk::Format::eR8G8B8A8Unorm;
+  uint32_t width = 1;
+  uint32_t height = 1;
+  // 0 for the full chain down to 1x1
+  uint32_t mipLevels = 1;
+  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled;
+  // Contents come later through writeImage, e.g. from streaming
+  bool streamed = false;
+};
+
+// Texel data handed to createImage. With generateMips only mip 0 is provided and the others are blitted from it,
+// otherwise every mip is provided, tightly packed from mip 0 down (the layout of KTX/DDS payloads). Block compressed
+// formats can't be blitted and always provide their mips.
+struct ImageData {
+  std::span<const std::byte> texels;
+  bool generateMips = true;
+};
+
+class VulkanImageManager {
+public:
+  // Destroyed images go to the deletion queue, keyed by the frame timeline value being recorded
+  VulkanImageManager(VulkanDevice *device,
+    VulkanBufferManager *bufferManager,
+    VulkanBindlessHeap *bindlessHeap,
+    const VulkanTimeline *frameTimeline,
+    VulkanDeletionQueue *deletionQueue);
+  ~VulkanImageManager();
+
+  vk::Image getImage(size_t imageId) const { return m_images[imageId].image; }
+  vk::ImageView getImageView(size_t imageId) const { return m_images[imageId].view; }
+  vk::Extent2D getImageExtent(size_t imageId) const { return m_images[imageId].extent; }
+  uint32_t getImageMipLevels(size_t imageId) const { return m_images[imageId].mipLevels; }
+  std::string_view getImageName(size_t imageId) const { return m_images[imageId].name; }
+  uint32_t getImageBindlessSlot(size_t imageId) const { return m_images[imageId].bindlessSlot; }
+  // Streaming threads ask while images are created
+  bool isImageHostWritable(size_t imageId) const
+  {
+    std::shared_lock lock(m_imagesMutex);
+    return m_images[imageId].hostWritable;
+  }
+
+  // With data the image is uploaded and left in the shader read only layout. Without data its contents and layout
+  // are undefined, the first user (e.g. a render graph import or writeImage) has to transition it.
+  //
+  // Images that get data or are streamed are written with host image copies when the device has them, the format
+  // supports them without slowing down GPU access and no mips have to be generated: the texels go from CPU memory
+  // straight into the optimally tiled image, without staging buffer or queue submission. Otherwise through a staging
+  // buffer, waiting for the upload.
+  size_t createImage(ImageDesc &desc, const ImageData *data = nullptr);
+  // The image and its view live on until the frames in flight that may sample it are done
+  void destroyImage(size_t imageId);
+  // Replaces every mip of an image created with data or ImageDesc::streamed, leaving it in the shader read only layout.
+  // The GPU must not be using the image, e.g. it was just created or the caller retired it. Host writable images can
+  // be written from any thread (the copy is visible to queue submissions made after it returns), the staged fallback
+  // is limited to the render thread.
+  void writeImage(size_t imageId, const ImageData &data);
+
+  size_t getImageCount() const { return m_images.size(); }
+
+  VulkanSamplerCache &getSamplerCache() { return m_samplerCache; }
+
+private:
+  void upload(const Image &image, const ImageData &data, bool generateMips);
+  void copyFromHost(const Image &image, const ImageData &data);
+  bool canGenerateMips(vk::Format format);
+  // Whether host copies can write the format, and don't cost the GPU its optimal access (e.g. compression)
+  bool canCopyFromHost(vk::Format format, vk::ImageUsageFlags usage);
+  size_t getNewImageId();
+
+private:
+  VulkanDevice *m_device;
+  VulkanBufferManager *m_bufferManager;
+  VulkanBindlessHeap *m_bindlessHeap;
+  const VulkanTimeline *m_frameTimeline;
+  VulkanDeletionQueue *m_deletionQueue;
+  VulkanSamplerCache m_samplerCache;
+
+  std::vector<Image> m_images;
+  std::queue<size_t> m_freeIds;
+  // Held shared by host copies on other threads, exclusively while m_images grows
+  mutable std::shared_mutex m_imagesMutex;
+  // Keyed by format and usage
+  std::unordered_map<uint64_t, bool> m_hostCopyFormats;
+};
+} // namespace renderer
+} // namespace engine
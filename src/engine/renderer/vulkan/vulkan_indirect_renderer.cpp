@@ -0,0 +1,210 @@
+#include "vulkan_indirect_renderer.hpp"
+#include <engine/core/assert.hpp>
+
+namespace engine::renderer {
+VulkanIndirectRenderer::VulkanIndirectRenderer(VulkanRenderer *renderer, uint32_t maxObjects)
+  : m_renderer{ renderer }, m_maxObjects{ maxObjects }
+{
+  BufferDesc objectDesc = {
+    .name = "indirect objects",
+    .usage = BufferUsage::STORAGE_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+    .size = maxObjects * sizeof(IndirectDrawObject),
+  };
+  m_objectBuffer = m_renderer->createBuffer(objectDesc);
+
+  BufferDesc stagingDesc = {
+    .name = "indirect objects staging",
+    .usage = BufferUsage::TRANSFER_SOURCE,
+    .cpuAccess = BufferCPUAccess::WriteOnly,
+    .size = objectDesc.size,
+  };
+  m_objectStagingBuffer = m_renderer->createBuffer(stagingDesc);
+
+  BufferDesc viewDesc = {
+    .name = "indirect cull view",
+    .usage = BufferUsage::STORAGE_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+    .size = sizeof(CullView),
+  };
+  m_viewBuffer = m_renderer->createBuffer(viewDesc);
+
+  BufferDesc visibilityDesc = {
+    .name = "indirect visibility",
+    .usage = BufferUsage::STORAGE_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+    .size = maxObjects * sizeof(uint32_t),
+  };
+  m_visibilityBuffer = m_renderer->createBuffer(visibilityDesc);
+
+  for (DrawList &drawList : m_drawLists) {
+    BufferDesc drawCommandDesc = {
+      .name = "indirect draw commands",
+      .usage = BufferUsage::STORAGE_BUFFER | BufferUsage::INDIRECT_ARGUMENT_BUFFER,
+      .size = maxObjects * sizeof(vk::DrawIndexedIndirectCommand),
+    };
+    drawList.commandBuffer = m_renderer->createBuffer(drawCommandDesc);
+
+    BufferDesc drawCountDesc = {
+      .name = "indirect draw count",
+      .usage =
+        BufferUsage::STORAGE_BUFFER | BufferUsage::INDIRECT_ARGUMENT_BUFFER | BufferUsage::TRANSFER_DESTINATION,
+      .size = sizeof(uint32_t),
+    };
+    drawList.countBuffer = m_renderer->createBuffer(drawCountDesc);
+  }
+
+  m_cullProgram = m_renderer->createComputeProgram({ .computeShaderId = m_renderer->loadComputeShader("cull") });
+}
+
+void VulkanIndirectRenderer::setObjects(std::span<const IndirectDrawObject> objects)
+{
+  core::assertion(objects.size() <= m_maxObjects, "{} objects exceed the maximum of {}", objects.size(), m_maxObjects);
+
+  m_objectCount = static_cast<uint32_t>(objects.size());
+  if (objects.empty()) { return; }
+
+  const vk::DeviceSize size = objects.size_bytes();
+  m_renderer->writeToBuffer(m_objectStagingBuffer, const_cast<IndirectDrawObject *>(objects.data()), size);
+
+  // Waits for the graphics queue, so frames still reading the old objects are done before they're overwritten
+  VkCommandBuffer commandBuffer = m_renderer->beginSingleTimeCommands();
+  m_renderer->copyBuffer(commandBuffer, m_objectBuffer, 0, m_objectStagingBuffer, 0, size);
+  // Nothing counts as visible, the first late phase draws whatever passes the frustum
+  vk::CommandBuffer(commandBuffer).fillBuffer(m_renderer->getBuffer(m_visibilityBuffer), 0, vk::WholeSize, 0);
+  m_renderer->endSingleTimeCommands(commandBuffer);
+}
+
+void VulkanIndirectRenderer::addCullPasses(const glm::mat4 &viewProjection)
+{
+  addViewPass(viewProjection);
+  addCullPass("frustum cull", CullPhase::Frustum, IndirectDrawList::Early);
+}
+
+void VulkanIndirectRenderer::addEarlyCullPasses(const glm::mat4 &viewProjection)
+{
+  addViewPass(viewProjection);
+  addCullPass("early cull", CullPhase::Early, IndirectDrawList::Early);
+}
+
+void VulkanIndirectRenderer::addLateCullPasses(VulkanDepthPyramid &pyramid)
+{
+  RenderGraphResource pyramidImage = pyramid.addBuildPass(m_renderer->getDepthBuffer());
+  addCullPass("late cull", CullPhase::Late, IndirectDrawList::Late, &pyramid, pyramidImage);
+}
+
+void VulkanIndirectRenderer::readDrawCommands(VulkanRenderGraph::PassBuilder &builder, IndirectDrawList list) const
+{
+  const DrawList &drawList = m_drawLists[static_cast<size_t>(list)];
+  builder.read(drawList.commands, RenderGraphAccess::IndirectBuffer);
+  builder.read(drawList.count, RenderGraphAccess::IndirectBuffer);
+}
+
+void VulkanIndirectRenderer::draw(vk::CommandBuffer commandBuffer, IndirectDrawList list) const
+{
+  const DrawList &drawList = m_drawLists[static_cast<size_t>(list)];
+  m_renderer->drawIndexedIndirectCount(commandBuffer, drawList.commandBuffer, 0, drawList.countBuffer, 0, m_maxObjects);
+}
+
+void VulkanIndirectRenderer::addViewPass(const glm::mat4 &viewProjection)
+{
+  VulkanRenderGraph &graph = m_renderer->getRenderGraph();
+
+  // The previous frame's culling may still be reading the view and writing the visibility, which the next frame reads
+  m_view = graph.importBuffer("indirect cull view",
+    { .buffer = m_renderer->getBuffer(m_viewBuffer), .initialStages = vk::PipelineStageFlagBits2::eComputeShader });
+  m_visibility = graph.importBuffer("indirect visibility",
+    { .buffer = m_renderer->getBuffer(m_visibilityBuffer),
+      .initialStages = vk::PipelineStageFlagBits2::eComputeShader,
+      .initialAccess = vk::AccessFlagBits2::eShaderStorageWrite,
+      .exported = true });
+
+  CullView view = {
+    .viewProjection = viewProjection,
+    .frustumPlanes = extractFrustumPlanes(viewProjection),
+  };
+
+  graph.addPass(
+    "update cull view",
+    [&](VulkanRenderGraph::PassBuilder &builder) { builder.write(m_view, RenderGraphAccess::TransferDestination); },
+    [buffer = m_view, view](vk::CommandBuffer commandBuffer, const VulkanRenderGraph &graph) {
+      commandBuffer.updateBuffer(graph.getBuffer(buffer), 0, sizeof(view), &view);
+    });
+}
+
+void VulkanIndirectRenderer::addCullPass(std::string_view name,
+  CullPhase phase,
+  IndirectDrawList list,
+  const VulkanDepthPyramid *pyramid,
+  RenderGraphResource pyramidImage)
+{
+  VulkanRenderGraph &graph = m_renderer->getRenderGraph();
+  DrawList &drawList = m_drawLists[static_cast<size_t>(list)];
+
+  // The previous frame's draws may still be reading both buffers, the first write has to wait for them
+  constexpr vk::PipelineStageFlags2 previousReaders =
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader;
+  drawList.commands = graph.importBuffer("indirect draw commands",
+    { .buffer = m_renderer->getBuffer(drawList.commandBuffer), .initialStages = previousReaders });
+  drawList.count = graph.importBuffer(
+    "indirect draw count", { .buffer = m_renderer->getBuffer(drawList.countBuffer), .initialStages = previousReaders });
+
+  graph.addPass(
+    "reset draw count",
+    [&](VulkanRenderGraph::PassBuilder &builder) {
+      builder.write(drawList.count, RenderGraphAccess::TransferDestination);
+    },
+    [buffer = drawList.count](vk::CommandBuffer commandBuffer, const VulkanRenderGraph &graph) {
+      commandBuffer.fillBuffer(graph.getBuffer(buffer), 0, sizeof(uint32_t), 0);
+    });
+
+  CullConstants constants = {
+    .pyramidSize = pyramid ? glm::vec2(pyramid->getExtent().width, pyramid->getExtent().height) : glm::vec2(0.0f),
+    .objectCount = m_objectCount,
+    .objectBufferSlot = m_renderer->getBufferBindlessSlot(m_objectBuffer),
+    .viewBufferSlot = m_renderer->getBufferBindlessSlot(m_viewBuffer),
+    .visibilityBufferSlot = m_renderer->getBufferBindlessSlot(m_visibilityBuffer),
+    .drawCommandBufferSlot = m_renderer->getBufferBindlessSlot(drawList.commandBuffer),
+    .drawCountBufferSlot = m_renderer->getBufferBindlessSlot(drawList.countBuffer),
+    .pyramidSlot = pyramid ? pyramid->getSampledSlot() : VulkanBindlessHeap::INVALID_SLOT,
+    .pyramidSamplerSlot = pyramid ? pyramid->getSamplerSlot() : VulkanBindlessHeap::INVALID_SLOT,
+    .phase = phase,
+  };
+
+  graph.addPass(
+    name,
+    [&](VulkanRenderGraph::PassBuilder &builder) {
+      builder.read(m_view, RenderGraphAccess::StorageCompute);
+      if (phase == CullPhase::Late) {
+        builder.read(pyramidImage, RenderGraphAccess::SampledCompute);
+        builder.read(m_visibility, RenderGraphAccess::StorageCompute);
+        builder.write(m_visibility, RenderGraphAccess::StorageCompute);
+      } else if (phase == CullPhase::Early) {
+        builder.read(m_visibility, RenderGraphAccess::StorageCompute);
+      }
+      builder.read(drawList.count, RenderGraphAccess::StorageCompute);
+      builder.write(drawList.count, RenderGraphAccess::StorageCompute);
+      builder.write(drawList.commands, RenderGraphAccess::StorageCompute);
+    },
+    [this, constants](vk::CommandBuffer commandBuffer, const VulkanRenderGraph &) {
+      m_renderer->bindComputeProgram(commandBuffer, m_cullProgram);
+      m_renderer->pushConstant(commandBuffer, m_cullProgram, (void *)&constants, 0, sizeof(constants));
+      m_renderer->dispatchThreads(commandBuffer, m_cullProgram, constants.objectCount);
+    });
+}
+
+std::array<glm::vec4, 6> VulkanIndirectRenderer::extractFrustumPlanes(const glm::mat4 &viewProjection)
+{
+  // Gribb/Hartmann, rows of the matrix combined. The near plane uses w + z, which is also correct for a [-1, 1] depth
+  // range and only conservative for [0, 1].
+  const glm::mat4 m = glm::transpose(viewProjection);
+  std::array<glm::vec4, 6> planes = {
+    m[3] + m[0],
+    m[3] - m[0],
+    m[3] + m[1],
+    m[3] - m[1],
+    m[3] + m[2],
+    m[3] - m[2],
+  };
+
+  for (glm::vec4 &plane : planes) { plane /= glm::length(glm::vec3(plane)); }
+  return planes;
+}
+}// namespace engine::renderer
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_depth_pyramid.hpp>
+#include <engine/renderer/vulkan_renderer.hpp>
+#include <glm/glm.hpp>
+#include <span>
+
+namespace engine::renderer {
+// Matches DrawObject in indirect.glsl
+struct IndirectDrawObject
+{
+  // World space center and radius
+  glm::vec4 boundingSphere;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  // Passed as firstInstance, the vertex shader finds the object's data through gl_InstanceIndex
+  uint32_t instanceIndex;
+};
+static_assert(sizeof(IndirectDrawObject) == 32);
+
+// Draw lists filled by the culling passes. Frustum-only culling fills Early alone, two phase occlusion culling fills
+// Early with the objects visible last frame and Late with the ones that became visible.
+enum class IndirectDrawList {
+  Early,
+  Late,
+};
+
+// GPU driven drawing of a set of indexed objects sharing one program and one vertex/index buffer. A compute pass culls
+// every object against the camera frustum and compacts the survivors into VkDrawIndexedIndirectCommands, the draw pass
+// consumes them with a single vkCmdDrawIndexedIndirectCount. The CPU cost of a frame doesn't depend on the object
+// count, objects are only uploaded when the scene changes.
+//
+// With occlusion culling the frame is split in two:
+//   addEarlyCullPasses(viewProjection), a pass drawing IndirectDrawList::Early,
+//   addLateCullPasses(pyramid), a pass drawing IndirectDrawList::Late on top (beginRendering without clear).
+// The early draws produce the depth the pyramid is built from, the late phase tests every object against it and only
+// draws those the early phase missed, which also decides what the next frame's early phase draws.
+class VulkanIndirectRenderer
+{
+public:
+  VulkanIndirectRenderer(VulkanRenderer *renderer, uint32_t maxObjects);
+
+  VulkanIndirectRenderer(const VulkanIndirectRenderer &) = delete;
+  VulkanIndirectRenderer &operator=(const VulkanIndirectRenderer &) = delete;
+
+  // Replaces all objects and forgets which were visible. Waits for the upload, not meant to be called every frame.
+  void setObjects(std::span<const IndirectDrawObject> objects);
+
+  // Adds the frustum culling passes to the current frame's render graph, before the passes drawing the objects
+  void addCullPasses(const glm::mat4 &viewProjection);
+  // Two phase occlusion culling, see above
+  void addEarlyCullPasses(const glm::mat4 &viewProjection);
+  void addLateCullPasses(VulkanDepthPyramid &pyramid);
+
+  // Declares the indirect reads in the setup of a pass calling draw()
+  void readDrawCommands(VulkanRenderGraph::PassBuilder &builder,
+    IndirectDrawList list = IndirectDrawList::Early) const;
+  // Program, vertex and index buffers have to be bound already
+  void draw(vk::CommandBuffer commandBuffer, IndirectDrawList list = IndirectDrawList::Early) const;
+
+  inline uint32_t getObjectCount() const noexcept { return m_objectCount; }
+  inline size_t getObjectBuffer() const noexcept { return m_objectBuffer; }
+  inline size_t getDrawCommandBuffer(IndirectDrawList list = IndirectDrawList::Early) const noexcept
+  {
+    return m_drawLists[static_cast<size_t>(list)].commandBuffer;
+  }
+  inline size_t getDrawCountBuffer(IndirectDrawList list = IndirectDrawList::Early) const noexcept
+  {
+    return m_drawLists[static_cast<size_t>(list)].countBuffer;
+  }
+
+private:
+  // Matches the CULL_PHASE_ defines in cull.comp
+  enum class CullPhase : uint32_t {
+    Frustum,
+    Early,
+    Late,
+  };
+
+  // Matches CullView in indirect.glsl
+  struct CullView
+  {
+    glm::mat4 viewProjection;
+    std::array<glm::vec4, 6> frustumPlanes;
+  };
+
+  struct CullConstants
+  {
+    glm::vec2 pyramidSize;
+    uint32_t objectCount;
+    uint32_t objectBufferSlot;
+    uint32_t viewBufferSlot;
+    uint32_t visibilityBufferSlot;
+    uint32_t drawCommandBufferSlot;
+    uint32_t drawCountBufferSlot;
+    uint32_t pyramidSlot;
+    uint32_t pyramidSamplerSlot;
+    CullPhase phase;
+  };
+  static_assert(sizeof(CullConstants) <= VulkanBindlessHeap::PUSH_CONSTANT_SIZE);
+
+  struct DrawList
+  {
+    size_t commandBuffer;
+    size_t countBuffer;
+    // Imported into the current frame's graph by the culling passes
+    RenderGraphResource commands;
+    RenderGraphResource count;
+  };
+
+  void addViewPass(const glm::mat4 &viewProjection);
+  // The pyramid is only sampled by the late phase
+  void addCullPass(std::string_view name,
+    CullPhase phase,
+    IndirectDrawList list,
+    const VulkanDepthPyramid *pyramid = nullptr,
+    RenderGraphResource pyramidImage = {});
+
+  static std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4 &viewProjection);
+
+private:
+  VulkanRenderer *m_renderer;
+  uint32_t m_maxObjects;
+  uint32_t m_objectCount = 0;
+
+  size_t m_objectBuffer;
+  size_t m_objectStagingBuffer;
+  size_t m_viewBuffer;
+  size_t m_visibilityBuffer;
+  std::array<DrawList, 2> m_drawLists;
+
+  ShaderProgramId m_cullProgram;
+
+  // Imported into the current frame's graph by addViewPass
+  RenderGraphResource m_view;
+  RenderGraphResource m_visibility;
+};
+}// namespace engine::renderer
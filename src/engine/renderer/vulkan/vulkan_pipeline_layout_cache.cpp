@@ -0,0 +1,131 @@
+#include "vulkan_pipeline_layout_cache.hpp"
+#include "vulkan_utils.hpp"
+#include <algorithm>
+#include <engine/core/assert.hpp>
+#include <engine/core/exception.hpp>
+
+namespace engine::renderer {
+VulkanPipelineLayoutCache::VulkanPipelineLayoutCache(VulkanDevice *device,
+  VulkanBindlessHeap *bindlessHeap,
+  VulkanDescriptorSetLayoutCache *setLayoutCache)
+  : m_device{ device }, m_bindlessHeap{ bindlessHeap }, m_setLayoutCache{ setLayoutCache }
+{}
+
+VulkanPipelineLayoutCache::~VulkanPipelineLayoutCache()
+{
+  for (auto &[setLayouts, pipelineLayout] : m_pipelineLayouts) {
+    m_device->getDevice().destroyPipelineLayout(pipelineLayout);
+  }
+}
+
+ProgramLayout VulkanPipelineLayoutCache::getLayout(std::span<const BindReflection *const> stages)
+{
+  for (const BindReflection *stage : stages) {
+    for (const BindInfoPushConstant &pushConstant : stage->pushConstants) {
+      core::assertion(pushConstant.offset + pushConstant.size <= VulkanBindlessHeap::PUSH_CONSTANT_SIZE,
+        "Push constants exceed the {} bytes shared by all programs",
+        VulkanBindlessHeap::PUSH_CONSTANT_SIZE);
+    }
+  }
+
+  const std::vector<BindInfo> bindInfos = VulkanShaderManager::mergeBindInfos(stages);
+
+  uint32_t setCount = VulkanBindlessHeap::SET_INDEX + 1;
+  for (const BindInfo &bindInfo : bindInfos) { setCount = std::max(setCount, bindInfo.set + 1); }
+
+  std::vector<std::vector<VkDescriptorSetLayoutBinding>> setBindings(setCount);
+  for (const BindInfo &bindInfo : bindInfos) {
+    if (bindInfo.set == VulkanBindlessHeap::SET_INDEX) {
+      validateHeapBinding(bindInfo);
+      continue;
+    }
+
+    core::assertion(bindInfo.count > 0,
+      "Binding {} ({}) of set {} is a runtime array, only the bindless heap can hold those",
+      bindInfo.binding,
+      bindInfo.name,
+      bindInfo.set);
+    setBindings[bindInfo.set].push_back({
+      .binding = bindInfo.binding,
+      .descriptorType = static_cast<VkDescriptorType>(bindInfo.descriptorType),
+      .descriptorCount = bindInfo.count,
+      .stageFlags = static_cast<VkShaderStageFlags>(bindInfo.stageFlags),
+      .pImmutableSamplers = nullptr,
+    });
+  }
+
+  ProgramLayout layout;
+  layout.setLayouts.reserve(setCount);
+  layout.setLayouts.push_back(m_bindlessHeap->getSetLayout());
+  for (uint32_t set = VulkanBindlessHeap::SET_INDEX + 1; set < setCount; set++) {
+    layout.setLayouts.push_back(m_setLayoutCache->getLayout(setBindings[set])->getDescriptorSetLayout());
+  }
+  layout.pipelineLayout = getPipelineLayout(layout.setLayouts);
+  return layout;
+}
+
+vk::PipelineLayout VulkanPipelineLayoutCache::getPipelineLayout(std::span<const vk::DescriptorSetLayout> setLayouts)
+{
+  core::assertion(!setLayouts.empty() && setLayouts[0] == m_bindlessHeap->getSetLayout(),
+    "Set {} of every pipeline layout is the bindless heap",
+    VulkanBindlessHeap::SET_INDEX);
+
+  // Most programs only use the heap
+  if (setLayouts.size() == 1) { return m_bindlessHeap->getPipelineLayout(); }
+
+  std::vector<vk::DescriptorSetLayout> key{ setLayouts.begin(), setLayouts.end() };
+  if (auto it = m_pipelineLayouts.find(key); it != m_pipelineLayouts.end()) { return it->second; }
+
+  const vk::PushConstantRange pushConstantRange = m_bindlessHeap->getPushConstantRange();
+  vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {
+    .setLayoutCount = static_cast<uint32_t>(key.size()),
+    .pSetLayouts = key.data(),
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &pushConstantRange,
+  };
+
+  vk::PipelineLayout pipelineLayout = m_device->getDevice().createPipelineLayout(pipelineLayoutInfo).value;
+  m_pipelineLayouts.emplace(std::move(key), pipelineLayout);
+  return pipelineLayout;
+}
+
+void VulkanPipelineLayoutCache::validateHeapBinding(const BindInfo &bindInfo) const
+{
+  vk::DescriptorType heapType;
+  switch (bindInfo.binding) {
+  case VulkanBindlessHeap::SAMPLED_IMAGE_BINDING:
+    heapType = vk::DescriptorType::eSampledImage;
+    break;
+  case VulkanBindlessHeap::SAMPLER_BINDING:
+    heapType = vk::DescriptorType::eSampler;
+    break;
+  case VulkanBindlessHeap::STORAGE_BUFFER_BINDING:
+    heapType = vk::DescriptorType::eStorageBuffer;
+    break;
+  case VulkanBindlessHeap::STORAGE_IMAGE_BINDING:
+    heapType = vk::DescriptorType::eStorageImage;
+    break;
+  default:
+    core::panic("Binding {} ({}) isn't part of the bindless heap in set {}",
+      bindInfo.binding,
+      bindInfo.name,
+      VulkanBindlessHeap::SET_INDEX);
+    return;
+  }
+
+  core::assertion(bindInfo.descriptorType == heapType,
+    "Binding {} ({}) of the bindless heap holds {}, not {}",
+    bindInfo.binding,
+    bindInfo.name,
+    vk::to_string(heapType),
+    vk::to_string(bindInfo.descriptorType));
+}
+
+size_t VulkanPipelineLayoutCache::SetLayoutsHash::operator()(
+  const std::vector<vk::DescriptorSetLayout> &setLayouts) const
+{
+  size_t seed = setLayouts.size();
+  for (vk::DescriptorSetLayout setLayout : setLayouts) { hashCombine(seed, setLayout); }
+  return seed;
+}
+}// namespace engine::renderer
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_bindless_heap.hpp>
+#include <engine/renderer/vulkan/vulkan_descriptors.hpp>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_shader_manager.hpp>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace engine::renderer {
+struct ProgramLayout
+{
+  // Indexed by set, set 0 is always the bindless heap. Sets a program skips get an empty layout.
+  std::vector<vk::DescriptorSetLayout> setLayouts;
+  vk::PipelineLayout pipelineLayout;
+};
+
+// Derives pipeline layouts from the reflected bindings of a program's stages. Set 0 is the bindless heap and every
+// layout uses the heap's push constant range, so any two programs are compatible up to set 0 and the heap stays
+// bound across program switches. Sets above 0 come from the descriptor set layout cache, programs declaring the same
+// sets get the same VkPipelineLayout and keep those bound too.
+class VulkanPipelineLayoutCache
+{
+public:
+  VulkanPipelineLayoutCache(VulkanDevice *device,
+    VulkanBindlessHeap *bindlessHeap,
+    VulkanDescriptorSetLayoutCache *setLayoutCache);
+  ~VulkanPipelineLayoutCache();
+
+  VulkanPipelineLayoutCache(const VulkanPipelineLayoutCache &) = delete;
+  VulkanPipelineLayoutCache &operator=(const VulkanPipelineLayoutCache &) = delete;
+
+  ProgramLayout getLayout(std::span<const BindReflection *const> stages);
+  vk::PipelineLayout getPipelineLayout(std::span<const vk::DescriptorSetLayout> setLayouts);
+  // The one range of every layout
+  inline vk::PushConstantRange getPushConstantRange() const noexcept { return m_bindlessHeap->getPushConstantRange(); }
+
+  // Not counting the heap's own layout
+  inline size_t getPipelineLayoutCount() const noexcept { return m_pipelineLayouts.size(); }
+
+private:
+  void validateHeapBinding(const BindInfo &bindInfo) const;
+
+  struct SetLayoutsHash
+  {
+    size_t operator()(const std::vector<vk::DescriptorSetLayout> &setLayouts) const;
+  };
+
+private:
+  VulkanDevice *m_device;
+  VulkanBindlessHeap *m_bindlessHeap;
+  VulkanDescriptorSetLayoutCache *m_setLayoutCache;
+
+  std::unordered_map<std::vector<vk::DescriptorSetLayout>, vk::PipelineLayout, SetLayoutsHash> m_pipelineLayouts;
+};
+}// namespace engine::renderer
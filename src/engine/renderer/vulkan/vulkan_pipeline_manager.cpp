@@ -1,70 +1,295 @@
 #include "vulkan_pipeline_manager.hpp"
+#include "vulkan_utils.hpp"
+#include <engine/core/assert.hpp>
+#include <engine/core/filesystem.hpp>
+#include <cstring>
+#include <engine/core/logger.hpp>
 #include <vulkan/vulkan_enums.hpp>
 
 namespace engine {
 namespace renderer {
+constexpr const char *PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+struct VulkanPipelineManager::PipelineState {
+  vk::PipelineShaderStageCreateInfo vertexStage;
+  vk::PipelineShaderStageCreateInfo fragmentStage;
+  vk::PipelineVertexInputStateCreateInfo vertexInput;
+  vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+  vk::PipelineViewportStateCreateInfo viewport;
+  vk::PipelineRasterizationStateCreateInfo rasterization;
+  vk::PipelineMultisampleStateCreateInfo multisample;
+  vk::PipelineDepthStencilStateCreateInfo depthStencil;
+  std::vector<vk::PipelineColorBlendAttachmentState> colorBlendAttachments;
+  vk::PipelineColorBlendStateCreateInfo colorBlend;
+  std::array<vk::DynamicState, 3> dynamicStates;
+  vk::PipelineDynamicStateCreateInfo dynamicState;
+  vk::Format colorFormat;
+  vk::PipelineRenderingCreateInfoKHR rendering;
+};
+
+static void hashPipelineDesc(size_t &seed, const GraphicsPipelineDesc &desc) {
+  hashCombine(seed, desc.vertexShaderId);
+  hashCombine(seed, desc.fragmentShaderId);
+  hashCombine(seed, desc.primitiveTopology);
+  hashCombine(seed, desc.depthImageFormat);
+
+  const RasterizerState &rasterizer = desc.rasterizerState;
+  hashCombine(seed, rasterizer.fillMode);
+  hashCombine(seed, rasterizer.cullMode);
+  hashCombine(seed, rasterizer.frontFaceMode);
+  hashCombine(seed, rasterizer.depthBiasEnabled);
+  hashCombine(seed, rasterizer.depthBias);
+  hashCombine(seed, rasterizer.depthBiasClamp);
+  hashCombine(seed, rasterizer.depthBiasSlopeFactor);
+  hashCombine(seed, rasterizer.sampleCount);
+  hashCombine(seed, rasterizer.depthClampEnabled);
+
+  const DepthStencilState &depthStencil = desc.depthStencilState;
+  hashCombine(seed, depthStencil.depthEnable);
+  hashCombine(seed, depthStencil.depthWriteEnable);
+  hashCombine(seed, depthStencil.depthFunc);
+  hashCombine(seed, depthStencil.stencilEnable);
+  hashCombine(seed, depthStencil.stencilReadMask);
+  hashCombine(seed, depthStencil.stencilWriteMask);
+  for (const DepthStencilOpDesc &face : {depthStencil.frontFace, depthStencil.backFace}) {
+    hashCombine(seed, face.stencilFailOp);
+    hashCombine(seed, face.stencilDepthFailOp);
+    hashCombine(seed, face.stencilPassOp);
+    hashCombine(seed, face.stencilFunc);
+  }
+
+  hashCombine(seed, desc.blendState.alphaToCoverageEnable);
+  hashCombine(seed, desc.blendState.independentBlendEnable);
+  for (const RTBlendState &target : desc.blendState.renderTargets) {
+    hashCombine(seed, target.blendEnable);
+    hashCombine(seed, target.logicOpEnable);
+    hashCombine(seed, target.srcBlend);
+    hashCombine(seed, target.destBlend);
+    hashCombine(seed, target.blendOp);
+    hashCombine(seed, target.srcBlendAlpha);
+    hashCombine(seed, target.destBlendAlpha);
+    hashCombine(seed, target.blendOpAlpha);
+    hashCombine(seed, target.logicOp);
+    hashCombine(seed, target.renderTargetWriteMask);
+  }
+}
+
 VulkanPipelineManager::VulkanPipelineManager(VulkanDevice *device, VulkanShaderManager *shaderManager,
-                                             VulkanSwapchain *swapchain)
-    : m_device{device}, m_shaderManager{shaderManager}, m_swapchain{swapchain} {}
+                                             VulkanSwapchain *swapchain, VulkanPipelineLayoutCache *layoutCache,
+                                             VulkanAsyncCompiler *compiler)
+    : m_device{device}, m_shaderManager{shaderManager}, m_layoutCache{layoutCache}, m_compiler{compiler},
+      m_colorFormat{swapchain->getSwapChainImageFormat()},
+      m_useLibraries{device->hasGraphicsPipelineLibrary() && device->hasFastPipelineLinking()} {
+  loadPipelineCache();
+}
 
 VulkanPipelineManager::~VulkanPipelineManager() {
+  // Jobs still building would write to destroyed entries
+  m_compiler->waitIdle();
+  savePipelineCache();
   for (auto &pipeline : m_graphicsPipelines) {
     vkDestroyPipeline(m_device->getDevice(), pipeline.pipeline, nullptr);
-    vkDestroyPipelineLayout(m_device->getDevice(), pipeline.pipelineLayout, nullptr);
+    vkDestroyPipeline(m_device->getDevice(), pipeline.optimizedPipeline, nullptr);
   }
+  for (auto &[key, library] : m_libraries) {
+    m_device->getDevice().destroyPipeline(library);
+  }
+  m_device->getDevice().destroyPipelineCache(m_pipelineCache);
 }
 
-size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc) {
-  GraphicsPipeline pipeline;
+void VulkanPipelineManager::loadPipelineCache() {
+  std::vector<char> data = core::readBinaryFile(core::getCachePath(PIPELINE_CACHE_FILE));
+  if (!data.empty() && !isPipelineCacheCompatible(data)) {
+    core::Logger::warn("Pipeline cache was created by another device or driver, ignoring it");
+    data.clear();
+  }
 
-  std::vector<vk::VertexInputBindingDescription2EXT> inputBindingDescriptions;
-  std::vector<vk::VertexInputAttributeDescription2EXT> attributeDescriptions;
+  vk::PipelineCacheCreateInfo cacheInfo = {
+      .initialDataSize = data.size(),
+      .pInitialData = data.data(),
+  };
 
-  if (desc.vertexShaderId != INVALID_ID) {
-    auto bindReflection = m_shaderManager->getVertexBindReflection(desc.vertexShaderId);
-    inputBindingDescriptions.insert(inputBindingDescriptions.begin(), bindReflection.bindingDescriptions.begin(),
-                                    bindReflection.bindingDescriptions.end());
-    attributeDescriptions.insert(attributeDescriptions.begin(), bindReflection.attributeDescriptions.begin(),
-                                 bindReflection.attributeDescriptions.end());
-
-    for (BindInfoPushConstant &pushConstant : bindReflection.pushConstants) {
-      vk::PushConstantRange &range = pipeline.pushConstantRanges.emplace_back();
-      range.offset = pushConstant.offset;
-      range.size = pushConstant.size;
-      range.stageFlags = pushConstant.stageFlags;
+  m_pipelineCache = m_device->getDevice().createPipelineCache(cacheInfo).value;
+  core::Logger::info("Pipeline cache created ({} bytes loaded)", data.size());
+}
+
+bool VulkanPipelineManager::isPipelineCacheCompatible(const std::vector<char> &data) const {
+  VkPipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  auto properties = m_device->getPhysicalDevice().getProperties();
+  return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+void VulkanPipelineManager::savePipelineCache() {
+  auto cacheData = m_device->getDevice().getPipelineCacheData(m_pipelineCache);
+  if (cacheData.result != vk::Result::eSuccess || cacheData.value.empty()) {
+    return;
+  }
+  const std::vector<uint8_t> &data = cacheData.value;
+
+  std::span<const char> bytes{reinterpret_cast<const char *>(data.data()), data.size()};
+  if (!core::writeBinaryFile(core::getCachePath(PIPELINE_CACHE_FILE), bytes)) {
+    core::Logger::warn("Failed to write the pipeline cache");
+    return;
+  }
+  core::Logger::info("Pipeline cache saved ({} bytes)", data.size());
+}
+
+size_t VulkanPipelineManager::PipelineKeyHash::operator()(const PipelineKey &key) const {
+  size_t seed = 0;
+  hashPipelineDesc(seed, key.desc);
+  hashCombine(seed, key.colorFormat);
+  return seed;
+}
+
+size_t VulkanPipelineManager::LibraryKeyHash::operator()(const LibraryKey &key) const {
+  size_t seed = 0;
+  hashCombine(seed, key.part);
+  hashPipelineDesc(seed, key.desc);
+  hashCombine(seed, key.colorFormat);
+  hashCombine(seed, key.pipelineLayout);
+  return seed;
+}
+
+size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc) {
+  PipelineKey key{.desc = desc, .colorFormat = m_colorFormat};
+  if (auto it = m_pipelineLookup.find(key); it != m_pipelineLookup.end()) {
+    GraphicsPipeline &pipeline = m_graphicsPipelines[it->second];
+    // Requested asynchronously before and the caller needs it now. Built here unless the job already started, then
+    // only that job is waited for, not the ones queued before it.
+    if (!pipeline.isReady.load(std::memory_order_acquire)) {
+      if (!pipeline.isClaimed.exchange(true, std::memory_order_acq_rel)) {
+        buildPipeline(pipeline, preparePipeline(desc));
+      } else {
+        pipeline.isReady.wait(false, std::memory_order_acquire);
+      }
     }
+    return it->second;
   }
 
-  vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {
-      .setLayoutCount = 0,    // TODO
-      .pSetLayouts = nullptr, // TODO
-      .pushConstantRangeCount = static_cast<uint32_t>(pipeline.pushConstantRanges.size()),
-      .pPushConstantRanges = pipeline.pushConstantRanges.data(),
-  };
+  const PipelineBuildInfo build = preparePipeline(desc);
+  GraphicsPipeline &pipeline = addPipeline(std::move(key), build);
+  buildPipeline(pipeline, build);
+  return m_graphicsPipelines.size() - 1;
+}
 
-  std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
-  if (desc.vertexShaderId != INVALID_ID) {
-    vk::PipelineShaderStageCreateInfo vertShaderStageInfo = {};
-    vertShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
+size_t VulkanPipelineManager::createGraphicsPipelineAsync(GraphicsPipelineDesc &desc) {
+  PipelineKey key{.desc = desc, .colorFormat = m_colorFormat};
+  if (auto it = m_pipelineLookup.find(key); it != m_pipelineLookup.end()) {
+    return it->second;
+  }
 
-    vertShaderStageInfo.module = m_shaderManager->getVertexShaderModule(desc.vertexShaderId);
-    vertShaderStageInfo.pName = "main";
+  const PipelineBuildInfo build = preparePipeline(desc);
+  GraphicsPipeline &pipeline = addPipeline(std::move(key), build);
+  m_compiler->submit([this, &pipeline, build] {
+    if (!pipeline.isClaimed.exchange(true, std::memory_order_acq_rel)) {
+      buildPipeline(pipeline, build);
+    }
+  });
+  return m_graphicsPipelines.size() - 1;
+}
+
+void VulkanPipelineManager::setFallbackPipeline(size_t index) {
+  core::assertion(isPipelineReady(index), "The fallback pipeline has to be created synchronously");
+  m_fallbackPipeline = index;
+}
+
+vk::Pipeline VulkanPipelineManager::getGraphicsPipeline(size_t index) {
+  const GraphicsPipeline &pipeline = m_graphicsPipelines[index];
+  if (pipeline.isOptimized.load(std::memory_order_acquire)) {
+    return pipeline.optimizedPipeline;
+  }
+  if (pipeline.isReady.load(std::memory_order_acquire)) {
+    return pipeline.pipeline;
+  }
+  // The fallback has to read the same vertex input
+  if (m_fallbackPipeline != INVALID_ID &&
+      m_graphicsPipelines[m_fallbackPipeline].vertexShaderId == pipeline.vertexShaderId) {
+    return getGraphicsPipeline(m_fallbackPipeline);
+  }
+  return nullptr;
+}
 
-    shaderStages.push_back(vertShaderStageInfo);
+VulkanPipelineManager::PipelineBuildInfo VulkanPipelineManager::preparePipeline(const GraphicsPipelineDesc &desc) {
+  PipelineBuildInfo build{.desc = desc};
+  std::vector<const BindReflection *> stageReflections;
+
+  if (desc.vertexShaderId != INVALID_ID) {
+    const BindReflection &bindReflection = m_shaderManager->getVertexBindReflection(desc.vertexShaderId);
+    for (const vk::VertexInputBindingDescription2EXT &binding : bindReflection.bindingDescriptions) {
+      build.vertexBindings.push_back(
+          {.binding = binding.binding, .stride = binding.stride, .inputRate = binding.inputRate});
+    }
+    for (const vk::VertexInputAttributeDescription2EXT &attribute : bindReflection.attributeDescriptions) {
+      build.vertexAttributes.push_back({.location = attribute.location,
+                                        .binding = attribute.binding,
+                                        .format = attribute.format,
+                                        .offset = attribute.offset});
+    }
+    build.vertexModule = m_shaderManager->getVertexShaderModule(desc.vertexShaderId);
+    stageReflections.push_back(&bindReflection);
   }
   if (desc.fragmentShaderId != INVALID_ID) {
-    vk::PipelineShaderStageCreateInfo fragShaderStageInfo = {};
-    fragShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
+    build.fragmentModule = m_shaderManager->getFragmentShaderModule(desc.fragmentShaderId);
+    stageReflections.push_back(&m_shaderManager->getFragmentBindReflection(desc.fragmentShaderId));
+  }
 
-    fragShaderStageInfo.module = m_shaderManager->getFragmentShaderModule(desc.fragmentShaderId);
-    fragShaderStageInfo.pName = "main";
+  // Same layout as a shader program with these stages, so pipelines and programs can be mixed without rebinding
+  build.pipelineLayout = m_layoutCache->getLayout(stageReflections).pipelineLayout;
+  return build;
+}
 
-    shaderStages.push_back(fragShaderStageInfo);
+VulkanPipelineManager::GraphicsPipeline &VulkanPipelineManager::addPipeline(PipelineKey key,
+                                                                            const PipelineBuildInfo &build) {
+  GraphicsPipeline &pipeline = m_graphicsPipelines.emplace_back();
+  pipeline.pipelineLayout = build.pipelineLayout;
+  pipeline.pushConstantRanges = {m_layoutCache->getPushConstantRange()};
+  pipeline.vertexShaderId = build.desc.vertexShaderId;
+  m_pipelineLookup.emplace(std::move(key), m_graphicsPipelines.size() - 1);
+  return pipeline;
+}
+
+void VulkanPipelineManager::buildPipeline(GraphicsPipeline &pipeline, const PipelineBuildInfo &build) {
+  if (!m_useLibraries) {
+    pipeline.pipeline = compilePipeline(build);
+    pipeline.isReady.store(true, std::memory_order_release);
+    pipeline.isReady.notify_all();
+    return;
   }
 
-  pipeline.pipelineLayout = m_device->getDevice().createPipelineLayout(pipelineLayoutInfo).value;
+  pipeline.pipeline = linkPipeline(build, false);
+  pipeline.isReady.store(true, std::memory_order_release);
+  pipeline.isReady.notify_all();
 
-  vk::PipelineDepthStencilStateCreateInfo depthStencil = {};
+  // Draws use the fast link meanwhile. Both are kept until the manager is destroyed, frames in flight may still
+  // reference the fast one.
+  m_compiler->submit([this, &pipeline, build] {
+    pipeline.optimizedPipeline = linkPipeline(build, true);
+    pipeline.isOptimized.store(true, std::memory_order_release);
+  });
+}
+
+void VulkanPipelineManager::fillPipelineState(const PipelineBuildInfo &build, PipelineState &state) const {
+  const GraphicsPipelineDesc &desc = build.desc;
+
+  state.vertexStage = {};
+  state.vertexStage.stage = vk::ShaderStageFlagBits::eVertex;
+  state.vertexStage.module = build.vertexModule;
+  state.vertexStage.pName = "main";
+
+  state.fragmentStage = {};
+  state.fragmentStage.stage = vk::ShaderStageFlagBits::eFragment;
+  state.fragmentStage.module = build.fragmentModule;
+  state.fragmentStage.pName = "main";
+
+  vk::PipelineDepthStencilStateCreateInfo &depthStencil = state.depthStencil;
+  depthStencil = {};
   depthStencil.depthTestEnable = desc.depthStencilState.depthEnable;
   depthStencil.depthWriteEnable = desc.depthStencilState.depthWriteEnable;
   depthStencil.depthCompareOp = static_cast<vk::CompareOp>(desc.depthStencilState.depthFunc);
@@ -91,34 +316,32 @@ size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc)
   // depthStencil.back.writeMask;
   // depthStencil.back.reference;
 
-  vk::PipelineViewportStateCreateInfo viewportState = {
+  state.viewport = {
       .viewportCount = 1,
       .pViewports = nullptr,
       .scissorCount = 1,
       .pScissors = nullptr,
   };
 
-  vk::PipelineVertexInputStateCreateInfo vertexInputInfo = {};
-  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(inputBindingDescriptions.size());
-  // vertexInputInfo.pVertexBindingDescriptions = inputBindingDescriptions.data();
-  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-  // vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+  state.vertexInput = {};
+  state.vertexInput.setVertexBindingDescriptions(build.vertexBindings);
+  state.vertexInput.setVertexAttributeDescriptions(build.vertexAttributes);
 
-  vk::PipelineInputAssemblyStateCreateInfo inputAssembly = {
+  state.inputAssembly = {
       .topology = static_cast<vk::PrimitiveTopology>(desc.primitiveTopology),
       .primitiveRestartEnable = vk::False,
   };
 
-  auto dynamicStates = std::to_array({
+  state.dynamicStates = {
       vk::DynamicState::eViewport,
       vk::DynamicState::eScissor,
       vk::DynamicState::eDepthBias,
-  });
+  };
 
-  vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-  dynamicStateCreateInfo.setDynamicStates(dynamicStates);
+  state.dynamicState = {};
+  state.dynamicState.setDynamicStates(state.dynamicStates);
 
-  vk::PipelineRasterizationStateCreateInfo rasterizerState = {
+  state.rasterization = {
       .depthClampEnable = desc.rasterizerState.depthClampEnabled,
       .rasterizerDiscardEnable = VK_FALSE,
       .polygonMode = static_cast<vk::PolygonMode>(desc.rasterizerState.fillMode),
@@ -131,7 +354,7 @@ size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc)
       .lineWidth = 1.0f,
   };
 
-  vk::PipelineMultisampleStateCreateInfo multisamplingState = {
+  state.multisample = {
       .rasterizationSamples = static_cast<vk::SampleCountFlagBits>(desc.rasterizerState.sampleCount),
       .sampleShadingEnable = VK_FALSE,
       .minSampleShading = 1.0f,          // Optional
@@ -142,7 +365,8 @@ size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc)
 
   uint32_t numRenderTargets = 1; // TODO : support multiple render targets
 
-  std::vector<vk::PipelineColorBlendAttachmentState> colorBlendAttachments(numRenderTargets);
+  std::vector<vk::PipelineColorBlendAttachmentState> &colorBlendAttachments = state.colorBlendAttachments;
+  colorBlendAttachments.resize(numRenderTargets);
 
   for (uint32_t i = 0; i < numRenderTargets; i++) {
     colorBlendAttachments[i].blendEnable = desc.blendState.renderTargets[i].blendEnable;
@@ -160,7 +384,7 @@ size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc)
         static_cast<vk::ColorComponentFlags>(desc.blendState.renderTargets[i].renderTargetWriteMask);
   }
 
-  vk::PipelineColorBlendStateCreateInfo colorBlending = {
+  state.colorBlend = {
       .logicOpEnable = desc.blendState.renderTargets[0].logicOpEnable,
       .logicOp = static_cast<vk::LogicOp>(desc.blendState.renderTargets[0].logicOp),
       .attachmentCount = numRenderTargets,
@@ -168,39 +392,174 @@ size_t VulkanPipelineManager::createGraphicsPipeline(GraphicsPipelineDesc &desc)
       .blendConstants = std::array{0.0f, 0.0f, 0.0f, 0.0f},
   };
 
-  vk::Format swapChainFormat = vk::Format(m_swapchain->getSwapChainImageFormat());
-  vk::PipelineRenderingCreateInfoKHR pipelineRenderingCreateInfo = {
+  state.colorFormat = m_colorFormat;
+  state.rendering = {
       .viewMask = 0,
       .colorAttachmentCount = 1,
-      .pColorAttachmentFormats = &swapChainFormat,
+      .pColorAttachmentFormats = &state.colorFormat,
       .depthAttachmentFormat = static_cast<vk::Format>(desc.depthImageFormat),
       .stencilAttachmentFormat = vk::Format::eUndefined,
   };
+}
+
+vk::Pipeline VulkanPipelineManager::compilePipeline(const PipelineBuildInfo &build) const {
+  const GraphicsPipelineDesc &desc = build.desc;
+  PipelineState state;
+  fillPipelineState(build, state);
+
+  std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+  if (desc.vertexShaderId != INVALID_ID) {
+    shaderStages.push_back(state.vertexStage);
+  }
+  if (desc.fragmentShaderId != INVALID_ID) {
+    shaderStages.push_back(state.fragmentStage);
+  }
 
   vk::GraphicsPipelineCreateInfo pipelineInfo = {
-      .pNext = &pipelineRenderingCreateInfo,
+      .pNext = &state.rendering,
       .stageCount = static_cast<uint32_t>(shaderStages.size()),
       .pStages = shaderStages.data(),
-      .pVertexInputState = &vertexInputInfo,
-      .pInputAssemblyState = &inputAssembly,
+      .pVertexInputState = &state.vertexInput,
+      .pInputAssemblyState = &state.inputAssembly,
       .pTessellationState = nullptr,
-      .pViewportState = &viewportState,
-      .pRasterizationState = &rasterizerState,
-      .pMultisampleState = &multisamplingState,
-      .pDepthStencilState = &depthStencil,
-      .pColorBlendState = &colorBlending,
-      .pDynamicState = &dynamicStateCreateInfo,
-      .layout = pipeline.pipelineLayout,
+      .pViewportState = &state.viewport,
+      .pRasterizationState = &state.rasterization,
+      .pMultisampleState = &state.multisample,
+      .pDepthStencilState = &state.depthStencil,
+      .pColorBlendState = &state.colorBlend,
+      .pDynamicState = &state.dynamicState,
+      .layout = build.pipelineLayout,
       .renderPass = nullptr, // Maybe not
       .subpass = 0,
       .basePipelineHandle = VK_NULL_HANDLE,
       .basePipelineIndex = -1,
   };
 
-  pipeline.pipeline = m_device->getDevice().createGraphicsPipeline(nullptr, pipelineInfo).value;
-  m_graphicsPipelines.push_back(pipeline);
+  return m_device->getDevice().createGraphicsPipeline(m_pipelineCache, pipelineInfo).value;
+}
 
-  return m_graphicsPipelines.size() - 1;
+vk::Pipeline VulkanPipelineManager::linkPipeline(const PipelineBuildInfo &build, bool optimize) {
+  const auto libraries = std::to_array({
+      getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface, build),
+      getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders, build),
+      getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader, build),
+      getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface, build),
+  });
+
+  vk::PipelineLibraryCreateInfoKHR libraryInfo = {
+      .libraryCount = static_cast<uint32_t>(libraries.size()),
+      .pLibraries = libraries.data(),
+  };
+
+  vk::GraphicsPipelineCreateInfo pipelineInfo = {
+      .pNext = &libraryInfo,
+      .flags = optimize ? vk::PipelineCreateFlags(vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT)
+                        : vk::PipelineCreateFlags{},
+      .layout = build.pipelineLayout,
+  };
+
+  return m_device->getDevice().createGraphicsPipeline(m_pipelineCache, pipelineInfo).value;
+}
+
+vk::Pipeline VulkanPipelineManager::getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT part,
+                                               const PipelineBuildInfo &build) {
+  using Part = vk::GraphicsPipelineLibraryFlagBitsEXT;
+  const GraphicsPipelineDesc &desc = build.desc;
+
+  LibraryKey key{.part = part, .colorFormat = m_colorFormat, .pipelineLayout = build.pipelineLayout};
+  switch (part) {
+  case Part::eVertexInputInterface:
+    // The vertex input is reflected from the vertex shader
+    key.desc.vertexShaderId = desc.vertexShaderId;
+    key.desc.primitiveTopology = desc.primitiveTopology;
+    key.colorFormat = vk::Format::eUndefined;
+    key.pipelineLayout = nullptr;
+    break;
+  case Part::ePreRasterizationShaders:
+    key.desc.vertexShaderId = desc.vertexShaderId;
+    key.desc.rasterizerState = desc.rasterizerState;
+    key.desc.rasterizerState.sampleCount = RasterizerState{}.sampleCount;
+    key.colorFormat = vk::Format::eUndefined;
+    break;
+  case Part::eFragmentShader:
+    key.desc.fragmentShaderId = desc.fragmentShaderId;
+    key.desc.depthStencilState = desc.depthStencilState;
+    key.desc.rasterizerState.sampleCount = desc.rasterizerState.sampleCount;
+    key.desc.depthImageFormat = desc.depthImageFormat;
+    break;
+  case Part::eFragmentOutputInterface:
+    key.desc.blendState = desc.blendState;
+    key.desc.rasterizerState.sampleCount = desc.rasterizerState.sampleCount;
+    key.desc.depthImageFormat = desc.depthImageFormat;
+    key.pipelineLayout = nullptr;
+    break;
+  }
+
+  {
+    std::lock_guard lock{m_libraryMutex};
+    if (auto it = m_libraries.find(key); it != m_libraries.end()) {
+      return it->second;
+    }
+  }
+
+  // Compiled outside the lock. Another job may compile the same part meanwhile, the copy that loses is dropped.
+  vk::Pipeline library = compileLibrary(part, build);
+  std::lock_guard lock{m_libraryMutex};
+  auto [it, isInserted] = m_libraries.emplace(std::move(key), library);
+  if (!isInserted) {
+    m_device->getDevice().destroyPipeline(library);
+  }
+  return it->second;
+}
+
+vk::Pipeline VulkanPipelineManager::compileLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT part,
+                                                   const PipelineBuildInfo &build) const {
+  using Part = vk::GraphicsPipelineLibraryFlagBitsEXT;
+  const GraphicsPipelineDesc &desc = build.desc;
+  PipelineState state;
+  fillPipelineState(build, state);
+
+  vk::GraphicsPipelineLibraryCreateInfoEXT libraryInfo = {
+      .pNext = &state.rendering,
+      .flags = part,
+  };
+
+  // Retaining the link time optimization info lets the background link optimize across the parts
+  vk::GraphicsPipelineCreateInfo pipelineInfo = {
+      .pNext = &libraryInfo,
+      .flags = vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT,
+  };
+
+  switch (part) {
+  case Part::eVertexInputInterface:
+    libraryInfo.pNext = nullptr;
+    pipelineInfo.pVertexInputState = &state.vertexInput;
+    pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    break;
+  case Part::ePreRasterizationShaders:
+    if (desc.vertexShaderId != INVALID_ID) {
+      pipelineInfo.setStages(state.vertexStage);
+    }
+    pipelineInfo.pViewportState = &state.viewport;
+    pipelineInfo.pRasterizationState = &state.rasterization;
+    pipelineInfo.pDynamicState = &state.dynamicState;
+    pipelineInfo.layout = build.pipelineLayout;
+    break;
+  case Part::eFragmentShader:
+    if (desc.fragmentShaderId != INVALID_ID) {
+      pipelineInfo.setStages(state.fragmentStage);
+    }
+    pipelineInfo.pMultisampleState = &state.multisample;
+    pipelineInfo.pDepthStencilState = &state.depthStencil;
+    pipelineInfo.layout = build.pipelineLayout;
+    break;
+  case Part::eFragmentOutputInterface:
+    pipelineInfo.pMultisampleState = &state.multisample;
+    pipelineInfo.pColorBlendState = &state.colorBlend;
+    break;
+  }
+
+  return m_device->getDevice().createGraphicsPipeline(m_pipelineCache, pipelineInfo).value;
 }
 } // namespace renderer
 } // namespace engine
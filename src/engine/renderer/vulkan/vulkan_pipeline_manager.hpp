@@ -2,39 +2,133 @@
 
 #include "engine/renderer/vulkan/vulkan_swapchain.hpp"
 #include <engine/renderer/descriptors/pipeline_descriptors.hpp>
+#include <engine/renderer/vulkan/vulkan_async_compiler.hpp>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_pipeline_layout_cache.hpp>
 #include <engine/renderer/vulkan/vulkan_shader_manager.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
 namespace engine {
 namespace renderer {
 class VulkanPipelineManager {
 public:
-  struct DescriptorSetLayoutData {
-    vk::DescriptorSetLayoutCreateInfo createInfo;
-    std::vector<vk::DescriptorSetLayoutBinding> bindings;
-  };
-
   struct GraphicsPipeline {
+    // Owned by the layout cache
     vk::PipelineLayout pipelineLayout;
+    // Written by the compile job, only valid once isReady is set. With pipeline libraries this is the fast link.
     vk::Pipeline pipeline;
+    // Link time optimized replacement linked in the background, only valid once isOptimized is set
+    vk::Pipeline optimizedPipeline;
     std::vector<vk::PushConstantRange> pushConstantRanges;
+    size_t vertexShaderId = INVALID_ID;
+    std::atomic<bool> isReady = false;
+    // Taken by whoever builds the pipeline, the compile job or a synchronous request that can't wait for the queue
+    std::atomic<bool> isClaimed = false;
+    std::atomic<bool> isOptimized = false;
   };
 
 public:
-  VulkanPipelineManager(VulkanDevice *device, VulkanShaderManager *shaderManager, VulkanSwapchain *swapchain);
+  VulkanPipelineManager(VulkanDevice *device, VulkanShaderManager *shaderManager, VulkanSwapchain *swapchain,
+                        VulkanPipelineLayoutCache *layoutCache, VulkanAsyncCompiler *compiler);
   ~VulkanPipelineManager();
 
+  // Returns the existing pipeline when an equivalent description was already built, waiting for it when it was
+  // requested asynchronously and hasn't compiled yet.
+  // With VK_EXT_graphics_pipeline_library the vertex input, pre-rasterization, fragment shader and fragment output
+  // parts are compiled separately and cached, a new combination of cached parts only costs a fast link. The optimized
+  // link is then done on the compiler's threads and replaces the fast one once ready. Devices without fast linking
+  // compile whole pipelines, a link there costs about as much as the compile.
   size_t createGraphicsPipeline(GraphicsPipelineDesc &desc);
+  // Returns right away, the pipeline is built on the compiler's threads. Reflection and the layout are resolved here.
+  size_t createGraphicsPipelineAsync(GraphicsPipelineDesc &desc);
+  bool isPipelineReady(size_t index) const {
+    return m_graphicsPipelines[index].isReady.load(std::memory_order_acquire);
+  }
+
+  // Stands in for pipelines still compiling that use the same vertex shader. Created synchronously.
+  void setFallbackPipeline(size_t index);
 
-  vk::Pipeline getGraphicsPipeline(size_t index) { return m_graphicsPipelines[index].pipeline; }
+  // The fallback while the pipeline compiles, null when there is none to use and the draw has to be skipped
+  vk::Pipeline getGraphicsPipeline(size_t index);
   vk::PipelineLayout getGraphicsPipelineLayout(size_t index) { return m_graphicsPipelines[index].pipelineLayout; }
 
+  void savePipelineCache();
+
+private:
+  struct PipelineKey {
+    GraphicsPipelineDesc desc;
+    vk::Format colorFormat;
+
+    bool operator==(const PipelineKey &) const = default;
+  };
+
+  struct PipelineKeyHash {
+    size_t operator()(const PipelineKey &key) const;
+  };
+
+  // Everything a compile job needs, resolved on the calling thread
+  struct PipelineBuildInfo {
+    GraphicsPipelineDesc desc;
+    vk::PipelineLayout pipelineLayout;
+    vk::ShaderModule vertexModule;
+    vk::ShaderModule fragmentModule;
+    std::vector<vk::VertexInputBindingDescription> vertexBindings;
+    std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+  };
+
+  // The create infos of every pipeline state, filled in place as they point to each other
+  struct PipelineState;
+
+  // One part of a pipeline compiled as a library. The description only keeps the fields of its part, the others
+  // are left at their defaults so combinations sharing the part find the same library.
+  struct LibraryKey {
+    vk::GraphicsPipelineLibraryFlagBitsEXT part;
+    GraphicsPipelineDesc desc;
+    vk::Format colorFormat;
+    vk::PipelineLayout pipelineLayout;
+
+    bool operator==(const LibraryKey &) const = default;
+  };
+
+  struct LibraryKeyHash {
+    size_t operator()(const LibraryKey &key) const;
+  };
+
+  PipelineBuildInfo preparePipeline(const GraphicsPipelineDesc &desc);
+  GraphicsPipeline &addPipeline(PipelineKey key, const PipelineBuildInfo &build);
+  // Thread safe. Compiles the whole pipeline, or links it from libraries when they are supported, in which case the
+  // optimized link is queued as well.
+  void buildPipeline(GraphicsPipeline &pipeline, const PipelineBuildInfo &build);
+  void fillPipelineState(const PipelineBuildInfo &build, PipelineState &state) const;
+  vk::Pipeline compilePipeline(const PipelineBuildInfo &build) const;
+  vk::Pipeline linkPipeline(const PipelineBuildInfo &build, bool optimize);
+  vk::Pipeline getLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT part, const PipelineBuildInfo &build);
+  vk::Pipeline compileLibrary(vk::GraphicsPipelineLibraryFlagBitsEXT part, const PipelineBuildInfo &build) const;
+
+  void loadPipelineCache();
+  bool isPipelineCacheCompatible(const std::vector<char> &data) const;
+
 private:
   VulkanDevice *m_device;
   VulkanShaderManager *m_shaderManager;
-  VulkanSwapchain *m_swapchain;
+  VulkanPipelineLayoutCache *m_layoutCache;
+  VulkanAsyncCompiler *m_compiler;
+  vk::Format m_colorFormat;
+
+  vk::PipelineCache m_pipelineCache;
+
+  // Elements never move, compile jobs write to them
+  std::deque<GraphicsPipeline> m_graphicsPipelines;
+  std::unordered_map<PipelineKey, size_t, PipelineKeyHash> m_pipelineLookup;
+  size_t m_fallbackPipeline = INVALID_ID;
 
-  std::vector<GraphicsPipeline> m_graphicsPipelines;
+  bool m_useLibraries = false;
+  // Shared by the compile jobs
+  std::mutex m_libraryMutex;
+  std::unordered_map<LibraryKey, vk::Pipeline, LibraryKeyHash> m_libraries;
 };
 } // namespace renderer
 } // namespace engine
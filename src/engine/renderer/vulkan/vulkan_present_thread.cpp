@@ -0,0 +1,56 @@
+#include "vulkan_present_thread.hpp"
+#include <engine/core/logger.hpp>
+#include <engine/core/timer.hpp>
+
+namespace engine::renderer {
+VulkanPresentThread::VulkanPresentThread() : m_thread{ [this] { run(); } }
+{
+  core::Logger::info("Submitting and presenting on a dedicated thread");
+}
+
+VulkanPresentThread::~VulkanPresentThread()
+{
+  m_queue.push({ .isStop = true });
+  // The jthread joins once the stop item is reached, after the frames queued before it
+}
+
+void VulkanPresentThread::push(FrameSubmission submission)
+{
+  m_queue.push({ .submission = std::move(submission) });
+  m_pushedCount++;
+}
+
+float VulkanPresentThread::waitIdle()
+{
+  uint64_t executedCount = m_executedCount.load(std::memory_order_acquire);
+  if (executedCount == m_pushedCount) { return 0.0f; }
+
+  core::Timer timer;
+  while (executedCount != m_pushedCount) {
+    m_executedCount.wait(executedCount, std::memory_order_acquire);
+    executedCount = m_executedCount.load(std::memory_order_acquire);
+  }
+  return timer.getDeltaTime();
+}
+
+void VulkanPresentThread::run()
+{
+  while (true) {
+    Item item = m_queue.pop();
+    if (item.isStop) { return; }
+
+    auto [result, presentWait] = item.submission.swapChain->execute(item.submission);
+    m_lastPresentWait.store(presentWait, std::memory_order_relaxed);
+    if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR) {
+      m_isOutOfDate.store(true, std::memory_order_release);
+    } else if (result != vk::Result::eSuccess) {
+      // Can't panic from this thread, recreating the swapchain is the best shot at recovering
+      core::Logger::error("Failed to present swap chain image: {}", vk::to_string(result));
+      m_isOutOfDate.store(true, std::memory_order_release);
+    }
+
+    m_executedCount.fetch_add(1, std::memory_order_release);
+    m_executedCount.notify_all();
+  }
+}
+}// namespace engine::renderer
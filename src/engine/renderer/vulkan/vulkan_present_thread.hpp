@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <engine/core/spsc_queue.hpp>
+#include <engine/renderer/vulkan/vulkan_swapchain.hpp>
+#include <thread>
+
+namespace engine::renderer {
+// Executes prepared frames (queue submit and present) on its own thread, so drivers blocking in present no longer
+// stall the frame loop: the block overlaps with the game's update until the next frame is about to be acquired. The
+// frame loop hands frames over through a lock-free single producer single consumer queue.
+// An out of date or suboptimal swapchain is only reported, the frame loop recreates it since its images are what it
+// records into.
+class VulkanPresentThread
+{
+public:
+  VulkanPresentThread();
+  // Executes the frames still queued
+  ~VulkanPresentThread();
+
+  VulkanPresentThread(const VulkanPresentThread &) = delete;
+  VulkanPresentThread &operator=(const VulkanPresentThread &) = delete;
+
+  void push(FrameSubmission submission);
+  // Blocks until every pushed frame has been executed, returns the time spent blocked in seconds. Needed before the
+  // swapchain is acquired from, recreated or destroyed, and before waiting for the device to idle.
+  float waitIdle();
+
+  // Whether a present since the last call reported the swapchain out of date or suboptimal
+  inline bool consumeOutOfDate() noexcept { return m_isOutOfDate.exchange(false, std::memory_order_acq_rel); }
+  // Time the last present blocked this thread, in seconds
+  inline float getLastPresentWait() const noexcept { return m_lastPresentWait.load(std::memory_order_relaxed); }
+
+private:
+  struct Item
+  {
+    FrameSubmission submission;
+    bool isStop = false;
+  };
+
+  void run();
+
+private:
+  // A frame per slot at most, the frame loop waits for the slot's previous frame before preparing the next one. One
+  // more for the stop item.
+  core::SpscQueue<Item, VulkanSwapchain::MAX_FRAMES_IN_FLIGHT + 1> m_queue;
+  // Only touched by the frame loop
+  uint64_t m_pushedCount = 0;
+  std::atomic<uint64_t> m_executedCount = 0;
+  std::atomic<bool> m_isOutOfDate = false;
+  std::atomic<float> m_lastPresentWait = 0.0f;
+
+  // Last member, started once everything else is constructed
+  std::jthread m_thread;
+};
+}// namespace engine::renderer
@@ -0,0 +1,118 @@
+#include "vulkan_prewarm_list.hpp"
+#include <algorithm>
+#include <cstring>
+#include <engine/core/filesystem.hpp>
+#include <engine/core/logger.hpp>
+#include <type_traits>
+
+namespace engine::renderer {
+constexpr const char *PREWARM_LIST_FILE = "prewarm_list.bin";
+
+// Both are stored as raw bytes, the sizes in the header catch most layout changes
+static_assert(std::is_trivially_copyable_v<DynamicStateBlock>);
+static_assert(std::is_trivially_copyable_v<GraphicsPipelineDesc>);
+
+namespace {
+  template<typename T> void writeValue(std::vector<char> &data, const T &value)
+  {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+  template<typename T> bool readValue(const std::vector<char> &data, size_t &offset, T &value)
+  {
+    if (offset + sizeof(T) > data.size()) { return false; }
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  bool readString(const std::vector<char> &data, size_t &offset, std::string &value)
+  {
+    uint32_t size = 0;
+    if (!readValue(data, offset, size) || offset + size > data.size()) { return false; }
+    value.assign(data.data() + offset, size);
+    offset += size;
+    return true;
+  }
+}// namespace
+
+VulkanPrewarmList::VulkanPrewarmList() { load(); }
+
+VulkanPrewarmList::~VulkanPrewarmList()
+{
+  // A run that created nothing (a tool, a crash during startup) keeps the previous list
+  if (!m_entries.empty()) { save(); }
+}
+
+void VulkanPrewarmList::record(PrewarmEntry entry)
+{
+  if (std::find(m_entries.begin(), m_entries.end(), entry) != m_entries.end()) { return; }
+  m_entries.push_back(std::move(entry));
+}
+
+void VulkanPrewarmList::load()
+{
+  const std::vector<char> data = core::readBinaryFile(core::getCachePath(PREWARM_LIST_FILE));
+  if (data.empty()) { return; }
+
+  size_t offset = 0;
+  FileHeader header;
+  if (!readValue(data, offset, header) || header.magic != FILE_MAGIC
+      || header.programStateSize != sizeof(DynamicStateBlock)
+      || header.pipelineDescSize != sizeof(GraphicsPipelineDesc)) {
+    core::Logger::warn("Prewarm list was written by another build, ignoring it");
+    return;
+  }
+
+  std::vector<PrewarmEntry> entries(header.entryCount);
+  for (PrewarmEntry &entry : entries) {
+    bool isValid = readValue(data, offset, entry.kind) && readString(data, offset, entry.shaderPaths[0])
+                   && readString(data, offset, entry.shaderPaths[1]);
+    if (isValid && entry.kind == PrewarmEntry::Kind::ShaderProgram) {
+      isValid = readValue(data, offset, entry.programState);
+    } else if (isValid && entry.kind == PrewarmEntry::Kind::GraphicsPipeline) {
+      isValid = readValue(data, offset, entry.pipelineDesc);
+    }
+
+    if (!isValid || entry.kind > PrewarmEntry::Kind::GraphicsPipeline) {
+      core::Logger::warn("Prewarm list is truncated or corrupted, ignoring it");
+      return;
+    }
+  }
+
+  m_previousEntries = std::move(entries);
+  core::Logger::info("Prewarm list loaded ({} programs and pipelines)", m_previousEntries.size());
+}
+
+void VulkanPrewarmList::save() const
+{
+  std::vector<char> data;
+  writeValue(data,
+    FileHeader{
+      .magic = FILE_MAGIC,
+      .programStateSize = sizeof(DynamicStateBlock),
+      .pipelineDescSize = sizeof(GraphicsPipelineDesc),
+      .entryCount = static_cast<uint32_t>(m_entries.size()),
+    });
+
+  for (const PrewarmEntry &entry : m_entries) {
+    writeValue(data, entry.kind);
+    for (const std::string &path : entry.shaderPaths) {
+      writeValue(data, static_cast<uint32_t>(path.size()));
+      data.insert(data.end(), path.begin(), path.end());
+    }
+    if (entry.kind == PrewarmEntry::Kind::ShaderProgram) {
+      writeValue(data, entry.programState);
+    } else if (entry.kind == PrewarmEntry::Kind::GraphicsPipeline) {
+      writeValue(data, entry.pipelineDesc);
+    }
+  }
+
+  if (!core::writeBinaryFile(core::getCachePath(PREWARM_LIST_FILE), data)) {
+    core::Logger::warn("Failed to write the prewarm list");
+    return;
+  }
+  core::Logger::info("Prewarm list saved ({} programs and pipelines)", m_entries.size());
+}
+}// namespace engine::renderer
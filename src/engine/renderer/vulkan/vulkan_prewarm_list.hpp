@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <engine/renderer/descriptors/pipeline_descriptors.hpp>
+#include <engine/renderer/vulkan/vulkan_dynamic_state.hpp>
+#include <string>
+#include <vector>
+
+namespace engine::renderer {
+struct PrewarmEntry
+{
+  enum class Kind : uint32_t { ShaderProgram, ComputeProgram, GraphicsPipeline };
+
+  Kind kind = Kind::ShaderProgram;
+  // As given to the shader loads, shader ids don't carry over between runs. Vertex and fragment shader, or the
+  // compute shader alone.
+  std::array<std::string, 2> shaderPaths;
+  // Shader programs only
+  DynamicStateBlock programState;
+  // Graphics pipelines only, the shader ids in it are meaningless
+  GraphicsPipelineDesc pipelineDesc;
+
+  bool operator==(const PrewarmEntry &) const = default;
+};
+
+// Programs and pipelines created during a run, saved when the renderer shuts down. The next run replays the list on
+// the async compiler at startup (VulkanRenderer::prewarm) so they are ready before gameplay asks for them, which
+// matters most after a driver update invalidated the shader binary and pipeline caches. A list written by another
+// build with different state structs is ignored.
+class VulkanPrewarmList
+{
+public:
+  VulkanPrewarmList();
+  ~VulkanPrewarmList();
+
+  VulkanPrewarmList(const VulkanPrewarmList &) = delete;
+  VulkanPrewarmList &operator=(const VulkanPrewarmList &) = delete;
+
+  // What the previous run saved
+  inline const std::vector<PrewarmEntry> &getPreviousEntries() const noexcept { return m_previousEntries; }
+  void record(PrewarmEntry entry);
+
+private:
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t programStateSize;
+    uint32_t pipelineDescSize;
+    uint32_t entryCount;
+  };
+
+  void load();
+  void save() const;
+
+private:
+  static constexpr uint32_t FILE_MAGIC = 0x4C575250;// "PRWL"
+
+  std::vector<PrewarmEntry> m_previousEntries;
+  std::vector<PrewarmEntry> m_entries;
+};
+}// namespace engine::renderer
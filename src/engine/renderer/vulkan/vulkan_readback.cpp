@@ -0,0 +1,152 @@
+#include "vulkan_readback.hpp"
+#include "vulkan_utils.hpp"
+#include <engine/core/assert.hpp>
+#include <engine/core/exception.hpp>
+
+namespace engine::renderer {
+VulkanReadback::VulkanReadback(VulkanRenderer *renderer) : m_renderer{ renderer } {}
+
+VulkanReadback::~VulkanReadback()
+{
+  for (const Request &request : m_requests) {
+    // A frame still copying into the buffer would write freed memory
+    if (request.pending) { m_renderer->waitForTimelineValue(request.timelineValue); }
+    m_renderer->destroyBuffer(request.bufferId);
+  }
+}
+
+ReadbackHandle VulkanReadback::addReadbackPass(RenderGraphResource image, vk::Format format)
+{
+  VulkanRenderGraph &graph = m_renderer->getRenderGraph();
+  const vk::Extent2D extent = graph.getImageExtent(image);
+  const vk::DeviceSize size = vk::DeviceSize{ extent.width } * extent.height * getTexelSize(format);
+
+  const uint32_t index = acquireRequest(size);
+  Request &request = m_requests[index];
+  request.timelineValue = m_renderer->getFrameTimelineValue();
+  request.extent = extent;
+  request.format = format;
+  request.pending = true;
+
+  const size_t bufferId = request.bufferId;
+  graph.addPass(
+    "Readback",
+    [image](VulkanRenderGraph::PassBuilder &builder) {
+      builder.read(image, RenderGraphAccess::TransferSource);
+      builder.setSideEffects();
+    },
+    [this, image, bufferId, extent](vk::CommandBuffer commandBuffer, const VulkanRenderGraph &graph) {
+      vk::BufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .mipLevel = 0,
+          .baseArrayLayer = 0,
+          .layerCount = 1 },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { .width = extent.width, .height = extent.height, .depth = 1 },
+      };
+      commandBuffer.copyImageToBuffer(
+        graph.getImage(image), vk::ImageLayout::eTransferSrcOptimal, m_renderer->getBuffer(bufferId), region);
+      // Waiting on the timeline only makes the copy available to the device, the host needs its own barrier
+      m_renderer->bufferBarrier(commandBuffer, bufferId, BufferAccess::transferWrite(), BufferAccess::hostRead());
+    });
+
+  return { .index = index };
+}
+
+ReadbackHandle VulkanReadback::addBackbufferReadback()
+{
+  core::assertion(m_renderer->canReadBackbuffer(), "The surface doesn't allow copying from the backbuffer");
+  return addReadbackPass(m_renderer->getBackbuffer(), m_renderer->getBackbufferFormat());
+}
+
+bool VulkanReadback::isReady(ReadbackHandle handle) const
+{
+  core::assertion(handle.isValid() && m_requests[handle.index].pending, "Invalid readback handle");
+  return m_renderer->isTimelineValueReached(m_requests[handle.index].timelineValue);
+}
+
+bool VulkanReadback::tryGetResult(ReadbackHandle handle, ReadbackResult &result)
+{
+  if (!isReady(handle)) { return false; }
+
+  readResult(m_requests[handle.index], result);
+  return true;
+}
+
+ReadbackResult VulkanReadback::getResult(ReadbackHandle handle)
+{
+  core::assertion(handle.isValid() && m_requests[handle.index].pending, "Invalid readback handle");
+
+  Request &request = m_requests[handle.index];
+  m_renderer->waitForTimelineValue(request.timelineValue);
+
+  ReadbackResult result;
+  readResult(request, result);
+  return result;
+}
+
+uint32_t VulkanReadback::getTexelSize(vk::Format format)
+{
+  switch (format) {
+  case vk::Format::eB8G8R8A8Unorm:
+  case vk::Format::eB8G8R8A8Srgb:
+  case vk::Format::eR8G8B8A8Unorm:
+  case vk::Format::eR8G8B8A8Srgb:
+  case vk::Format::eA2B10G10R10UnormPack32:
+  case vk::Format::eB10G11R11UfloatPack32:
+  case vk::Format::eR32Sfloat:
+  case vk::Format::eR32Uint:
+    return 4;
+  case vk::Format::eR16G16B16A16Sfloat:
+  case vk::Format::eR32G32Sfloat:
+    return 8;
+  case vk::Format::eR32G32B32A32Sfloat:
+    return 16;
+  default:
+    core::panic("Can't read back images of format {}", vk::to_string(format));
+    return 0;
+  }
+}
+
+uint32_t VulkanReadback::acquireRequest(vk::DeviceSize size)
+{
+  uint32_t reusable = ReadbackHandle::INVALID_INDEX;
+  for (uint32_t i = 0; i < m_requests.size(); i++) {
+    if (m_requests[i].pending) { continue; }
+    if (m_requests[i].capacity >= size) { return i; }
+    reusable = i;
+  }
+
+  if (reusable == ReadbackHandle::INVALID_INDEX) {
+    reusable = static_cast<uint32_t>(m_requests.size());
+    m_requests.emplace_back();
+  } else {
+    // Too small, nothing is copying into it anymore
+    m_renderer->destroyBuffer(m_requests[reusable].bufferId);
+  }
+
+  BufferDesc desc = {
+    .name = "Readback",
+    .usage = BufferUsage::TRANSFER_DESTINATION,
+    .cpuAccess = BufferCPUAccess::ReadOnly,
+    .size = size,
+  };
+  m_requests[reusable].bufferId = m_renderer->createBuffer(desc);
+  m_requests[reusable].capacity = size;
+  return reusable;
+}
+
+void VulkanReadback::readResult(Request &request, ReadbackResult &result)
+{
+  const vk::DeviceSize size =
+    vk::DeviceSize{ request.extent.width } * request.extent.height * getTexelSize(request.format);
+  result.texels.resize(size);
+  result.extent = request.extent;
+  result.format = request.format;
+  m_renderer->readFromBuffer(request.bufferId, result.texels.data(), size);
+  request.pending = false;
+}
+}// namespace engine::renderer
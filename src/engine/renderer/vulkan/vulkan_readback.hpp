@@ -0,0 +1,70 @@
+#pragma once
+
+#include <engine/renderer/vulkan_renderer.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace engine::renderer {
+struct ReadbackHandle
+{
+  static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+  uint32_t index = INVALID_INDEX;
+
+  inline bool isValid() const noexcept { return index != INVALID_INDEX; }
+  bool operator==(const ReadbackHandle &) const = default;
+};
+
+struct ReadbackResult
+{
+  // Tightly packed rows
+  std::vector<std::byte> texels;
+  vk::Extent2D extent;
+  vk::Format format = vk::Format::eUndefined;
+};
+
+// Copies render graph images into host visible buffers without stalling the frame loop. The copy is a pass of the
+// frame it is requested in and lands when that frame finishes on the GPU, usually a couple of frames later: poll
+// tryGetResult every frame, or block in getResult. Readback buffers are recycled between requests. Meant for
+// screenshots and the image comparisons of headless regression runs.
+class VulkanReadback
+{
+public:
+  VulkanReadback(VulkanRenderer *renderer);
+  ~VulkanReadback();
+
+  VulkanReadback(const VulkanReadback &) = delete;
+  VulkanReadback &operator=(const VulkanReadback &) = delete;
+
+  // Mip 0 of the image, which is read as TransferSource by the pass. Uncompressed color formats only.
+  [[nodiscard]] ReadbackHandle addReadbackPass(RenderGraphResource image, vk::Format format);
+  // What the frame being recorded ends up presenting (or leaves in the offscreen image when headless)
+  [[nodiscard]] ReadbackHandle addBackbufferReadback();
+
+  bool isReady(ReadbackHandle handle) const;
+  // Returns false while the frame is still executing. On success the handle is released.
+  bool tryGetResult(ReadbackHandle handle, ReadbackResult &result);
+  // Waits for the frame, then releases the handle
+  ReadbackResult getResult(ReadbackHandle handle);
+
+private:
+  struct Request
+  {
+    size_t bufferId = 0;
+    vk::DeviceSize capacity = 0;
+    uint64_t timelineValue = 0;
+    vk::Extent2D extent;
+    vk::Format format = vk::Format::eUndefined;
+    bool pending = false;
+  };
+
+  static uint32_t getTexelSize(vk::Format format);
+  uint32_t acquireRequest(vk::DeviceSize size);
+  void readResult(Request &request, ReadbackResult &result);
+
+private:
+  VulkanRenderer *m_renderer;
+  // Requests that aren't pending keep their buffer for the next one
+  std::vector<Request> m_requests;
+};
+}// namespace engine::renderer
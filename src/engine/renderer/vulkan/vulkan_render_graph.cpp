@@ -0,0 +1,627 @@
+#include "vulkan_render_graph.hpp"
+#include "vulkan_utils.hpp"
+#include <algorithm>
+#include <engine/core/assert.hpp>
+#include <engine/core/logger.hpp>
+#include <numeric>
+
+namespace engine::renderer {
+namespace {
+  struct AccessInfo
+  {
+    vk::ImageLayout layout;
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 readAccess;
+    vk::AccessFlags2 writeAccess;
+    vk::ImageUsageFlags usage;
+  };
+
+  AccessInfo getAccessInfo(RenderGraphAccess access)
+  {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    using Usage = vk::ImageUsageFlagBits;
+
+    constexpr vk::PipelineStageFlags2 graphicsShaders = Stage::eVertexShader | Stage::eFragmentShader;
+    constexpr vk::PipelineStageFlags2 fragmentTests = Stage::eEarlyFragmentTests | Stage::eLateFragmentTests;
+
+    switch (access) {
+    case RenderGraphAccess::ColorAttachment:
+      return { vk::ImageLayout::eColorAttachmentOptimal,
+        Stage::eColorAttachmentOutput,
+        Access::eColorAttachmentRead,
+        Access::eColorAttachmentWrite,
+        Usage::eColorAttachment };
+    case RenderGraphAccess::DepthStencilAttachment:
+      return { vk::ImageLayout::eDepthStencilAttachmentOptimal,
+        fragmentTests,
+        Access::eDepthStencilAttachmentRead,
+        Access::eDepthStencilAttachmentWrite,
+        Usage::eDepthStencilAttachment };
+    case RenderGraphAccess::DepthStencilReadOnly:
+      return { vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+        fragmentTests,
+        Access::eDepthStencilAttachmentRead,
+        Access::eNone,
+        Usage::eDepthStencilAttachment };
+    case RenderGraphAccess::SampledGraphics:
+      return { vk::ImageLayout::eShaderReadOnlyOptimal,
+        graphicsShaders,
+        Access::eShaderSampledRead,
+        Access::eNone,
+        Usage::eSampled };
+    case RenderGraphAccess::SampledCompute:
+      return { vk::ImageLayout::eShaderReadOnlyOptimal,
+        Stage::eComputeShader,
+        Access::eShaderSampledRead,
+        Access::eNone,
+        Usage::eSampled };
+    case RenderGraphAccess::StorageGraphics:
+      return { vk::ImageLayout::eGeneral,
+        graphicsShaders,
+        Access::eShaderStorageRead,
+        Access::eShaderStorageWrite,
+        Usage::eStorage };
+    case RenderGraphAccess::StorageCompute:
+      return { vk::ImageLayout::eGeneral,
+        Stage::eComputeShader,
+        Access::eShaderStorageRead,
+        Access::eShaderStorageWrite,
+        Usage::eStorage };
+    case RenderGraphAccess::TransferSource:
+      return { vk::ImageLayout::eTransferSrcOptimal,
+        Stage::eAllTransfer,
+        Access::eTransferRead,
+        Access::eNone,
+        Usage::eTransferSrc };
+    case RenderGraphAccess::TransferDestination:
+      return { vk::ImageLayout::eTransferDstOptimal,
+        Stage::eAllTransfer,
+        Access::eNone,
+        Access::eTransferWrite,
+        Usage::eTransferDst };
+    case RenderGraphAccess::VertexBuffer:
+      return { vk::ImageLayout::eUndefined, Stage::eVertexAttributeInput, Access::eVertexAttributeRead, Access::eNone, {} };
+    case RenderGraphAccess::IndexBuffer:
+      return { vk::ImageLayout::eUndefined, Stage::eIndexInput, Access::eIndexRead, Access::eNone, {} };
+    case RenderGraphAccess::IndirectBuffer:
+      return { vk::ImageLayout::eUndefined, Stage::eDrawIndirect, Access::eIndirectCommandRead, Access::eNone, {} };
+    }
+
+    core::panic("Unknown render graph access {}", static_cast<int>(access));
+  }
+
+  bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+  {
+    return firstA <= lastB && firstB <= lastA;
+  }
+}// namespace
+
+RenderGraphResource VulkanRenderGraph::PassBuilder::read(RenderGraphResource resource, RenderGraphAccess access)
+{
+  core::assertion(getAccessInfo(access).readAccess != vk::AccessFlags2{}, "Access can't be used to read");
+  m_graph->addUse(m_passIndex, resource, access, false);
+  return resource;
+}
+
+RenderGraphResource VulkanRenderGraph::PassBuilder::write(RenderGraphResource resource, RenderGraphAccess access)
+{
+  core::assertion(getAccessInfo(access).writeAccess != vk::AccessFlags2{}, "Access can't be used to write");
+  m_graph->addUse(m_passIndex, resource, access, true);
+  return resource;
+}
+
+void VulkanRenderGraph::PassBuilder::setSideEffects() { m_graph->m_passes[m_passIndex].sideEffects = true; }
+
+VulkanRenderGraph::VulkanRenderGraph(VulkanDevice *device,
+  const VulkanTimeline *frameTimeline,
+  VulkanDeletionQueue *deletionQueue)
+  : m_device{ device }, m_frameTimeline{ frameTimeline }, m_deletionQueue{ deletionQueue }
+{}
+
+VulkanRenderGraph::~VulkanRenderGraph() { destroyTransients(m_device, m_transients); }
+
+void VulkanRenderGraph::reset()
+{
+  m_resources.clear();
+  m_passes.clear();
+
+  m_stats.passCount = 0;
+  m_stats.culledPassCount = 0;
+  m_stats.barrierBatchCount = 0;
+  m_stats.imageBarrierCount = 0;
+  m_stats.bufferBarrierCount = 0;
+}
+
+RenderGraphResource VulkanRenderGraph::importImage(std::string_view name, const RenderGraphImportedImage &image)
+{
+  Resource &resource = m_resources.emplace_back();
+  resource.name = name;
+  resource.type = ResourceType::Image;
+  resource.imported = true;
+  resource.exported = image.finalLayout.has_value();
+  resource.desc.extent = image.extent;
+  resource.desc.aspect = image.range.aspectMask;
+  resource.image = image.image;
+  resource.view = image.view;
+  resource.range = image.range;
+  resource.finalLayout = image.finalLayout;
+  resource.initialState = {
+    .layout = image.initialLayout,
+    .writeStages = image.initialStages,
+    .writeAccess = image.initialAccess,
+  };
+
+  return { static_cast<uint32_t>(m_resources.size() - 1) };
+}
+
+RenderGraphResource VulkanRenderGraph::importBuffer(std::string_view name, const RenderGraphImportedBuffer &buffer)
+{
+  Resource &resource = m_resources.emplace_back();
+  resource.name = name;
+  resource.type = ResourceType::Buffer;
+  resource.imported = true;
+  resource.exported = buffer.exported;
+  resource.buffer = buffer.buffer;
+  resource.offset = buffer.offset;
+  resource.size = buffer.size;
+  resource.initialState = {
+    .writeStages = buffer.initialStages,
+    .writeAccess = buffer.initialAccess,
+  };
+
+  return { static_cast<uint32_t>(m_resources.size() - 1) };
+}
+
+RenderGraphResource VulkanRenderGraph::createImage(std::string_view name, const RenderGraphImageDesc &desc)
+{
+  Resource &resource = m_resources.emplace_back();
+  resource.name = name;
+  resource.type = ResourceType::Image;
+  resource.desc = desc;
+  resource.range = { .aspectMask = desc.aspect,
+    .baseMipLevel = 0,
+    .levelCount = desc.mipLevels,
+    .baseArrayLayer = 0,
+    .layerCount = 1 };
+
+  return { static_cast<uint32_t>(m_resources.size() - 1) };
+}
+
+void VulkanRenderGraph::addPass(std::string_view name, const SetupCallback &setup, ExecuteCallback execute)
+{
+  Pass &pass = m_passes.emplace_back();
+  pass.name = name;
+  pass.execute = std::move(execute);
+
+  PassBuilder builder(this, static_cast<uint32_t>(m_passes.size() - 1));
+  setup(builder);
+}
+
+void VulkanRenderGraph::addUse(uint32_t passIndex, RenderGraphResource resource, RenderGraphAccess access, bool write)
+{
+  core::assertion(resource.index < m_resources.size(), "Invalid render graph resource");
+
+  Pass &pass = m_passes[passIndex];
+  for (ResourceUse &use : pass.uses) {
+    if (use.resource != resource.index) { continue; }
+
+    core::assertion(use.access == access,
+      "Pass {} uses {} with two different accesses",
+      pass.name,
+      m_resources[resource.index].name);
+    use.read |= !write;
+    use.write |= write;
+    return;
+  }
+
+  pass.uses.push_back({ .resource = resource.index, .access = access, .read = !write, .write = write });
+}
+
+void VulkanRenderGraph::execute(vk::CommandBuffer commandBuffer)
+{
+  cullPasses();
+  computeLifetimes();
+  allocateTransients();
+
+  for (Resource &resource : m_resources) { resource.state = resource.initialState; }
+
+  for (m_currentPass = 0; m_currentPass < m_passes.size(); m_currentPass++) {
+    const Pass &pass = m_passes[m_currentPass];
+    if (pass.culled) { continue; }
+
+    recordBarriers(pass);
+    flushBarriers(commandBuffer);
+    pass.execute(commandBuffer, *this);
+  }
+
+  recordFinalBarriers();
+  flushBarriers(commandBuffer);
+}
+
+bool VulkanRenderGraph::isReadAfterCurrentPass(RenderGraphResource resource) const
+{
+  for (uint32_t passIndex = m_currentPass + 1; passIndex < m_passes.size(); passIndex++) {
+    const Pass &pass = m_passes[passIndex];
+    if (pass.culled) { continue; }
+
+    auto use = std::ranges::find(pass.uses, resource.index, &ResourceUse::resource);
+    if (use == pass.uses.end()) { continue; }
+    if (use->read) { return true; }
+    if (use->write) { return false; }
+  }
+
+  return m_resources[resource.index].exported;
+}
+
+void VulkanRenderGraph::cullPasses()
+{
+  // Walk backwards from what leaves the graph, a pass is live when it writes something a later live pass (or the
+  // outside world) still needs
+  std::vector<bool> needed(m_resources.size());
+  for (size_t i = 0; i < m_resources.size(); i++) { needed[i] = m_resources[i].exported; }
+
+  m_stats.passCount = static_cast<uint32_t>(m_passes.size());
+  m_stats.culledPassCount = 0;
+
+  for (auto it = m_passes.rbegin(); it != m_passes.rend(); ++it) {
+    Pass &pass = *it;
+    pass.culled =
+      !pass.sideEffects && std::ranges::none_of(pass.uses, [&](const ResourceUse &use) {
+        return use.write && needed[use.resource];
+      });
+
+    if (pass.culled) {
+      m_stats.culledPassCount++;
+      continue;
+    }
+
+    // A plain write replaces the contents, so whatever produced them before doesn't matter anymore
+    for (const ResourceUse &use : pass.uses) {
+      if (use.write && !use.read) { needed[use.resource] = false; }
+    }
+    for (const ResourceUse &use : pass.uses) {
+      if (use.read) { needed[use.resource] = true; }
+    }
+  }
+}
+
+void VulkanRenderGraph::computeLifetimes()
+{
+  for (uint32_t passIndex = 0; passIndex < m_passes.size(); passIndex++) {
+    const Pass &pass = m_passes[passIndex];
+    if (pass.culled) { continue; }
+
+    for (const ResourceUse &use : pass.uses) {
+      Resource &resource = m_resources[use.resource];
+      const AccessInfo info = getAccessInfo(use.access);
+
+      if (resource.firstPass == std::numeric_limits<uint32_t>::max()) {
+        resource.firstPass = passIndex;
+        resource.lastUseStages = info.stages;
+      } else if (resource.lastPass != passIndex) {
+        resource.lastUseStages = info.stages;
+      } else {
+        resource.lastUseStages |= info.stages;
+      }
+      resource.lastPass = passIndex;
+      resource.usage |= info.usage;
+
+      if (!use.write) { continue; }
+      if (resource.lastWritePass != passIndex) {
+        resource.lastWriteStages = info.stages;
+        resource.lastWriteAccess = info.writeAccess;
+      } else {
+        resource.lastWriteStages |= info.stages;
+        resource.lastWriteAccess |= info.writeAccess;
+      }
+      resource.lastWritePass = passIndex;
+    }
+  }
+}
+
+void VulkanRenderGraph::allocateTransients()
+{
+  std::vector<uint32_t> transientResources;
+  std::vector<TransientKey> keys;
+  for (uint32_t i = 0; i < m_resources.size(); i++) {
+    Resource &resource = m_resources[i];
+    if (resource.imported || resource.firstPass == std::numeric_limits<uint32_t>::max()) { continue; }
+
+    resource.transientIndex = static_cast<uint32_t>(keys.size());
+    transientResources.push_back(i);
+    keys.push_back({ .desc = resource.desc,
+      .usage = resource.usage,
+      .firstPass = resource.firstPass,
+      .lastPass = resource.lastPass });
+  }
+
+  if (keys != m_transientKeys) {
+    createTransients(keys);
+    m_transientKeys = std::move(keys);
+  }
+
+  for (uint32_t transientIndex = 0; transientIndex < transientResources.size(); transientIndex++) {
+    Resource &resource = m_resources[transientResources[transientIndex]];
+    resource.image = m_transients.images[transientIndex].image;
+    resource.view = m_transients.images[transientIndex].view;
+
+    // The previous occupant of the memory (this frame's, or the last one of the previous frame) has to be done with
+    // it before the contents get discarded, and its writes have to be available before new ones land in the memory
+    const Resource &predecessor = m_resources[transientResources[m_transients.images[transientIndex].predecessor]];
+    resource.initialState = {
+      .layout = vk::ImageLayout::eUndefined,
+      .writeStages = predecessor.lastUseStages | predecessor.lastWriteStages,
+      .writeAccess = predecessor.lastWriteAccess,
+    };
+  }
+}
+
+void VulkanRenderGraph::createTransients(const std::vector<TransientKey> &keys)
+{
+  if (!m_transients.images.empty()) {
+    // Frames in flight may still use the images
+    m_deletionQueue->push(m_frameTimeline->getNextValue(),
+      [device = m_device, allocation = std::move(m_transients)]() mutable { destroyTransients(device, allocation); });
+    m_transients = {};
+  }
+
+  vk::Device device = m_device->getDevice();
+  std::vector<vk::MemoryRequirements> requirements(keys.size());
+  m_transients.images.resize(keys.size());
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    const RenderGraphImageDesc &desc = keys[i].desc;
+    vk::ImageCreateInfo imageInfo = {
+      .imageType = vk::ImageType::e2D,
+      .format = desc.format,
+      .extent = { .width = desc.extent.width, .height = desc.extent.height, .depth = 1 },
+      .mipLevels = desc.mipLevels,
+      .arrayLayers = 1,
+      .samples = desc.samples,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = keys[i].usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    };
+
+    m_transients.images[i].image = device.createImage(imageInfo).value;
+    requirements[i] = device.getImageMemoryRequirements(m_transients.images[i].image);
+  }
+
+  // Largest images first, each goes into the first block none of whose occupants is alive at the same time
+  struct Block
+  {
+    vk::MemoryRequirements requirements;
+    std::vector<uint32_t> occupants;
+  };
+  std::vector<Block> blocks;
+
+  std::vector<uint32_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::stable_sort(order, [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+  std::vector<uint32_t> blockOf(keys.size());
+  for (uint32_t image : order) {
+    const vk::MemoryRequirements &imageRequirements = requirements[image];
+
+    auto it = std::ranges::find_if(blocks, [&](const Block &block) {
+      if ((block.requirements.memoryTypeBits & imageRequirements.memoryTypeBits) == 0) { return false; }
+      return std::ranges::none_of(block.occupants, [&](uint32_t occupant) {
+        return overlaps(keys[occupant].firstPass, keys[occupant].lastPass, keys[image].firstPass, keys[image].lastPass);
+      });
+    });
+
+    if (it == blocks.end()) {
+      blocks.push_back({ .requirements = imageRequirements });
+      it = blocks.end() - 1;
+    }
+
+    it->requirements.size = std::max(it->requirements.size, imageRequirements.size);
+    it->requirements.alignment = std::max(it->requirements.alignment, imageRequirements.alignment);
+    it->requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+    it->occupants.push_back(image);
+    blockOf[image] = static_cast<uint32_t>(it - blocks.begin());
+  }
+
+  m_stats.transientImageCount = static_cast<uint32_t>(keys.size());
+  m_stats.transientMemoryBlockCount = static_cast<uint32_t>(blocks.size());
+  m_stats.transientMemorySize = 0;
+  m_stats.transientMemorySizeWithoutAliasing = 0;
+
+  for (Block &block : blocks) {
+    VkMemoryRequirements blockRequirements = block.requirements;
+    VmaAllocationCreateInfo allocationInfo = {
+      .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    checkVkResult(
+      vmaAllocateMemory(m_device->getAllocator(), &blockRequirements, &allocationInfo, &allocation, nullptr));
+    m_transients.blocks.push_back(allocation);
+    m_stats.transientMemorySize += block.requirements.size;
+
+    // Occupants alias in order of first use, each one waits for the previous one (the first for the last one of
+    // the previous frame)
+    std::ranges::sort(block.occupants, {}, [&](uint32_t occupant) { return keys[occupant].firstPass; });
+    for (size_t i = 0; i < block.occupants.size(); i++) {
+      const size_t previous = (i + block.occupants.size() - 1) % block.occupants.size();
+      m_transients.images[block.occupants[i]].predecessor = block.occupants[previous];
+    }
+  }
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    TransientImage &image = m_transients.images[i];
+    checkVkResult(vmaBindImageMemory(m_device->getAllocator(), m_transients.blocks[blockOf[i]], image.image));
+
+    vk::ImageViewCreateInfo viewInfo = {
+      .image = image.image,
+      .viewType = vk::ImageViewType::e2D,
+      .format = keys[i].desc.format,
+      .subresourceRange = { .aspectMask = keys[i].desc.aspect,
+        .baseMipLevel = 0,
+        .levelCount = keys[i].desc.mipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = 1 },
+    };
+    image.view = device.createImageView(viewInfo).value;
+
+    m_stats.transientMemorySizeWithoutAliasing += requirements[i].size;
+  }
+
+  core::Logger::info("Render graph transients: {} images in {} blocks, {} KiB ({} KiB without aliasing)",
+    m_stats.transientImageCount,
+    m_stats.transientMemoryBlockCount,
+    m_stats.transientMemorySize / 1024,
+    m_stats.transientMemorySizeWithoutAliasing / 1024);
+}
+
+void VulkanRenderGraph::destroyTransients(VulkanDevice *device, TransientAllocation &allocation)
+{
+  for (TransientImage &image : allocation.images) {
+    device->getDevice().destroyImageView(image.view);
+    device->getDevice().destroyImage(image.image);
+  }
+  for (VmaAllocation block : allocation.blocks) { vmaFreeMemory(device->getAllocator(), block); }
+
+  allocation.images.clear();
+  allocation.blocks.clear();
+}
+
+void VulkanRenderGraph::recordBarriers(const Pass &pass)
+{
+  for (const ResourceUse &use : pass.uses) {
+    Resource &resource = m_resources[use.resource];
+    ResourceState &state = resource.state;
+    const AccessInfo info = getAccessInfo(use.access);
+
+    const bool isImage = resource.type == ResourceType::Image;
+    const bool transition = isImage && state.layout != info.layout;
+    const vk::AccessFlags2 dstAccess =
+      (use.read ? info.readAccess : vk::AccessFlags2{}) | (use.write ? info.writeAccess : vk::AccessFlags2{});
+
+    vk::PipelineStageFlags2 srcStages;
+    vk::AccessFlags2 srcAccess;
+    bool needsBarrier = false;
+
+    if (transition || use.write) {
+      // Layout transitions and writes wait for every earlier access, reads included
+      srcStages = state.writeStages | state.readStages;
+      srcAccess = state.writeAccess;
+      needsBarrier = transition || srcStages != vk::PipelineStageFlags2{};
+
+      state.writeStages = info.stages;
+      state.writeAccess = use.write ? info.writeAccess : vk::AccessFlags2{};
+      state.visibleStages = info.stages;
+      state.visibleAccess = dstAccess;
+      state.readStages = use.read ? info.stages : vk::PipelineStageFlags2{};
+    } else {
+      // Reads after reads need nothing, a read after a write only needs the write made visible to its stages once
+      const bool visible =
+        !(info.stages & ~state.visibleStages) && !(dstAccess & ~state.visibleAccess);
+      srcStages = state.writeStages;
+      srcAccess = state.writeAccess;
+      needsBarrier = state.writeStages != vk::PipelineStageFlags2{} && !visible;
+
+      if (needsBarrier) {
+        state.visibleStages |= info.stages;
+        state.visibleAccess |= dstAccess;
+      }
+      state.readStages |= info.stages;
+    }
+
+    if (!needsBarrier) { continue; }
+
+    if (isImage) {
+      m_imageBarriers.push_back({
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = info.stages,
+        .dstAccessMask = dstAccess,
+        .oldLayout = state.layout,
+        .newLayout = info.layout,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = resource.image,
+        .subresourceRange = resource.range,
+      });
+      state.layout = info.layout;
+    } else {
+      m_bufferBarriers.push_back({
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = info.stages,
+        .dstAccessMask = dstAccess,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .buffer = resource.buffer,
+        .offset = resource.offset,
+        .size = resource.size,
+      });
+    }
+  }
+}
+
+void VulkanRenderGraph::recordFinalBarriers()
+{
+  for (Resource &resource : m_resources) {
+    if (!resource.finalLayout.has_value() || resource.state.layout == resource.finalLayout.value()) { continue; }
+
+    m_imageBarriers.push_back({
+      .srcStageMask = resource.state.writeStages | resource.state.readStages,
+      .srcAccessMask = resource.state.writeAccess,
+      .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+      .dstAccessMask = vk::AccessFlagBits2::eNone,
+      .oldLayout = resource.state.layout,
+      .newLayout = resource.finalLayout.value(),
+      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .image = resource.image,
+      .subresourceRange = resource.range,
+    });
+    resource.state.layout = resource.finalLayout.value();
+  }
+}
+
+void VulkanRenderGraph::flushBarriers(vk::CommandBuffer commandBuffer)
+{
+  if (m_imageBarriers.empty() && m_bufferBarriers.empty()) { return; }
+
+  vk::DependencyInfo dependencyInfo = {};
+  dependencyInfo.setImageMemoryBarriers(m_imageBarriers);
+  dependencyInfo.setBufferMemoryBarriers(m_bufferBarriers);
+  commandBuffer.pipelineBarrier2(dependencyInfo);
+
+  m_stats.barrierBatchCount++;
+  m_stats.imageBarrierCount += static_cast<uint32_t>(m_imageBarriers.size());
+  m_stats.bufferBarrierCount += static_cast<uint32_t>(m_bufferBarriers.size());
+  m_imageBarriers.clear();
+  m_bufferBarriers.clear();
+}
+
+vk::Image VulkanRenderGraph::getImage(RenderGraphResource resource) const
+{
+  const Resource &entry = m_resources[resource.index];
+  core::assertion(entry.type == ResourceType::Image && entry.image, "{} isn't an allocated image", entry.name);
+  return entry.image;
+}
+
+vk::ImageView VulkanRenderGraph::getImageView(RenderGraphResource resource) const
+{
+  const Resource &entry = m_resources[resource.index];
+  core::assertion(entry.type == ResourceType::Image && entry.view, "{} isn't an allocated image", entry.name);
+  return entry.view;
+}
+
+vk::Extent2D VulkanRenderGraph::getImageExtent(RenderGraphResource resource) const
+{
+  return m_resources[resource.index].desc.extent;
+}
+
+vk::Buffer VulkanRenderGraph::getBuffer(RenderGraphResource resource) const
+{
+  const Resource &entry = m_resources[resource.index];
+  core::assertion(entry.type == ResourceType::Buffer, "{} isn't a buffer", entry.name);
+  return entry.buffer;
+}
+}// namespace engine::renderer
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_deletion_queue.hpp>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace engine::renderer {
+struct RenderGraphResource
+{
+  static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+  uint32_t index = INVALID_INDEX;
+
+  inline bool isValid() const noexcept { return index != INVALID_INDEX; }
+  bool operator==(const RenderGraphResource &) const = default;
+};
+
+// How a pass uses a resource. Every access maps to the layout, stages and access flags the barriers are built from.
+enum class RenderGraphAccess {
+  ColorAttachment,
+  DepthStencilAttachment,
+  DepthStencilReadOnly,
+  SampledGraphics,
+  SampledCompute,
+  StorageGraphics,
+  StorageCompute,
+  TransferSource,
+  TransferDestination,
+  VertexBuffer,
+  IndexBuffer,
+  IndirectBuffer,
+};
+
+// Image owned by the graph. It only lives for the passes that use it and may share memory with other transient
+// images whose lifetimes don't overlap, so its contents are undefined at the start of every frame.
+struct RenderGraphImageDesc
+{
+  vk::Format format = vk::Format::eUndefined;
+  vk::Extent2D extent;
+  vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+  uint32_t mipLevels = 1;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+  bool operator==(const RenderGraphImageDesc &) const = default;
+};
+
+struct RenderGraphImportedImage
+{
+  vk::Image image;
+  vk::ImageView view;
+  vk::ImageSubresourceRange range;
+  vk::Extent2D extent;
+  // State the image is in when the graph starts. An undefined layout discards the contents, the stages and access are
+  // what the first use has to wait for (e.g. the stage the swapchain acquire semaphore is waited on).
+  vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+  vk::PipelineStageFlags2 initialStages = vk::PipelineStageFlagBits2::eNone;
+  vk::AccessFlags2 initialAccess = vk::AccessFlagBits2::eNone;
+  // Layout the image is left in. Setting it means the contents are used after the graph, so the passes producing
+  // them are never culled.
+  std::optional<vk::ImageLayout> finalLayout;
+};
+
+struct RenderGraphImportedBuffer
+{
+  vk::Buffer buffer;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = vk::WholeSize;
+  vk::PipelineStageFlags2 initialStages = vk::PipelineStageFlagBits2::eNone;
+  vk::AccessFlags2 initialAccess = vk::AccessFlagBits2::eNone;
+  // The contents are used after the graph, passes writing the buffer are never culled
+  bool exported = false;
+};
+
+// Frame graph rebuilt every frame. Passes declare what they read and write, and execute() turns that into a schedule:
+// passes that don't contribute to an exported resource (or have side effects) are culled, the barriers in front of
+// each pass are batched into a single vkCmdPipelineBarrier2, and transient images with disjoint lifetimes are
+// placed in the same memory.
+class VulkanRenderGraph
+{
+public:
+  class PassBuilder
+  {
+  public:
+    RenderGraphResource read(RenderGraphResource resource, RenderGraphAccess access);
+    RenderGraphResource write(RenderGraphResource resource, RenderGraphAccess access);
+    // Keeps the pass even when nothing reads what it writes (readbacks, queries, UI)
+    void setSideEffects();
+
+  private:
+    friend class VulkanRenderGraph;
+    PassBuilder(VulkanRenderGraph *graph, uint32_t passIndex) : m_graph{ graph }, m_passIndex{ passIndex } {}
+
+    VulkanRenderGraph *m_graph;
+    uint32_t m_passIndex;
+  };
+
+  using SetupCallback = std::function<void(PassBuilder &builder)>;
+  using ExecuteCallback = std::function<void(vk::CommandBuffer commandBuffer, const VulkanRenderGraph &graph)>;
+
+  struct Stats
+  {
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    uint32_t barrierBatchCount = 0;
+    uint32_t imageBarrierCount = 0;
+    uint32_t bufferBarrierCount = 0;
+    uint32_t transientImageCount = 0;
+    uint32_t transientMemoryBlockCount = 0;
+    vk::DeviceSize transientMemorySize = 0;
+    vk::DeviceSize transientMemorySizeWithoutAliasing = 0;
+  };
+
+public:
+  // Replaced transient images are destroyed once the frame timeline reaches the last frame that may use them
+  VulkanRenderGraph(VulkanDevice *device, const VulkanTimeline *frameTimeline, VulkanDeletionQueue *deletionQueue);
+  ~VulkanRenderGraph();
+
+  VulkanRenderGraph(const VulkanRenderGraph &) = delete;
+  VulkanRenderGraph &operator=(const VulkanRenderGraph &) = delete;
+
+  // Drops every pass and resource, called before the graph of a new frame is declared
+  void reset();
+
+  [[nodiscard]] RenderGraphResource importImage(std::string_view name, const RenderGraphImportedImage &image);
+  [[nodiscard]] RenderGraphResource importBuffer(std::string_view name, const RenderGraphImportedBuffer &buffer);
+  [[nodiscard]] RenderGraphResource createImage(std::string_view name, const RenderGraphImageDesc &desc);
+
+  void addPass(std::string_view name, const SetupCallback &setup, ExecuteCallback execute);
+
+  // Compiles the graph and records every live pass, preceded by its barriers, into commandBuffer
+  void execute(vk::CommandBuffer commandBuffer);
+
+  vk::Image getImage(RenderGraphResource resource) const;
+  vk::ImageView getImageView(RenderGraphResource resource) const;
+  vk::Extent2D getImageExtent(RenderGraphResource resource) const;
+  vk::Buffer getBuffer(RenderGraphResource resource) const;
+
+  // Whether what the executing pass leaves in the resource is read by a later pass or after the graph. Attachments
+  // that aren't can be stored with eDontCare.
+  bool isReadAfterCurrentPass(RenderGraphResource resource) const;
+
+  inline const Stats &getStats() const noexcept { return m_stats; }
+
+private:
+  enum class ResourceType { Image, Buffer };
+
+  struct ResourceState
+  {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    // Last write (or layout transition) and everything that has been made visible since
+    vk::PipelineStageFlags2 writeStages;
+    vk::AccessFlags2 writeAccess;
+    vk::PipelineStageFlags2 visibleStages;
+    vk::AccessFlags2 visibleAccess;
+    // Reads since the last write, a later write has to wait for them
+    vk::PipelineStageFlags2 readStages;
+  };
+
+  struct Resource
+  {
+    std::string name;
+    ResourceType type = ResourceType::Image;
+    bool imported = false;
+    bool exported = false;
+
+    RenderGraphImageDesc desc;
+    vk::ImageUsageFlags usage;
+    vk::Image image;
+    vk::ImageView view;
+    vk::ImageSubresourceRange range;
+    std::optional<vk::ImageLayout> finalLayout;
+
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+
+    ResourceState initialState;
+    ResourceState state;
+
+    // Live passes using the resource, in execution order
+    uint32_t firstPass = std::numeric_limits<uint32_t>::max();
+    uint32_t lastPass = 0;
+    vk::PipelineStageFlags2 lastUseStages;
+    // Last live pass writing the resource
+    uint32_t lastWritePass = std::numeric_limits<uint32_t>::max();
+    vk::PipelineStageFlags2 lastWriteStages;
+    vk::AccessFlags2 lastWriteAccess;
+    uint32_t transientIndex = std::numeric_limits<uint32_t>::max();
+  };
+
+  struct ResourceUse
+  {
+    uint32_t resource;
+    RenderGraphAccess access;
+    bool read = false;
+    bool write = false;
+  };
+
+  struct Pass
+  {
+    std::string name;
+    std::vector<ResourceUse> uses;
+    ExecuteCallback execute;
+    bool sideEffects = false;
+    bool culled = false;
+  };
+
+  // What the transient images were created for, they are only recreated when this changes
+  struct TransientKey
+  {
+    RenderGraphImageDesc desc;
+    vk::ImageUsageFlags usage;
+    uint32_t firstPass;
+    uint32_t lastPass;
+
+    bool operator==(const TransientKey &) const = default;
+  };
+
+  struct TransientImage
+  {
+    vk::Image image;
+    vk::ImageView view;
+    // Image that used the memory before this one
+    uint32_t predecessor = 0;
+  };
+
+  struct TransientAllocation
+  {
+    std::vector<TransientImage> images;
+    std::vector<VmaAllocation> blocks;
+  };
+
+  void addUse(uint32_t passIndex, RenderGraphResource resource, RenderGraphAccess access, bool write);
+
+  void cullPasses();
+  void computeLifetimes();
+  void allocateTransients();
+  void createTransients(const std::vector<TransientKey> &keys);
+  static void destroyTransients(VulkanDevice *device, TransientAllocation &allocation);
+
+  void recordBarriers(const Pass &pass);
+  void recordFinalBarriers();
+  void flushBarriers(vk::CommandBuffer commandBuffer);
+
+private:
+  VulkanDevice *m_device;
+  const VulkanTimeline *m_frameTimeline;
+  VulkanDeletionQueue *m_deletionQueue;
+
+  std::vector<Resource> m_resources;
+  std::vector<Pass> m_passes;
+  uint32_t m_currentPass = 0;
+
+  std::vector<vk::ImageMemoryBarrier2> m_imageBarriers;
+  std::vector<vk::BufferMemoryBarrier2> m_bufferBarriers;
+
+  std::vector<TransientKey> m_transientKeys;
+  TransientAllocation m_transients;
+
+  Stats m_stats;
+};
+}// namespace engine::renderer
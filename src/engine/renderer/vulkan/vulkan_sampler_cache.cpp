@@ -0,0 +1,64 @@
+#include "vulkan_sampler_cache.hpp"
+#include <engine/core/assert.hpp>
+#include <engine/renderer/vulkan/vulkan_utils.hpp>
+
+namespace engine::renderer {
+VulkanSamplerCache::VulkanSamplerCache(VulkanDevice *device, VulkanBindlessHeap *bindlessHeap)
+  : m_device{ device }, m_bindlessHeap{ bindlessHeap }
+{}
+
+VulkanSamplerCache::~VulkanSamplerCache()
+{
+  for (auto &[createInfo, cached] : m_samplers) {
+    m_bindlessHeap->releaseSampler(cached.bindlessSlot);
+    m_device->getDevice().destroySampler(cached.sampler);
+  }
+}
+
+const CachedSampler &VulkanSamplerCache::getSampler(const vk::SamplerCreateInfo &createInfo)
+{
+  core::assertion(createInfo.pNext == nullptr, "Cached samplers can't have a pNext chain");
+
+  auto it = m_samplers.find(createInfo);
+  if (it != m_samplers.end()) { return it->second; }
+
+  CachedSampler cached;
+  cached.sampler = m_device->getDevice().createSampler(createInfo).value;
+  cached.bindlessSlot = m_bindlessHeap->registerSampler(cached.sampler);
+  return m_samplers.emplace(createInfo, cached).first->second;
+}
+
+size_t VulkanSamplerCache::CreateInfoHash::operator()(const vk::SamplerCreateInfo &createInfo) const
+{
+  size_t seed = 0;
+  hashCombine(seed, static_cast<uint32_t>(createInfo.flags));
+  hashCombine(seed, createInfo.magFilter);
+  hashCombine(seed, createInfo.minFilter);
+  hashCombine(seed, createInfo.mipmapMode);
+  hashCombine(seed, createInfo.addressModeU);
+  hashCombine(seed, createInfo.addressModeV);
+  hashCombine(seed, createInfo.addressModeW);
+  hashCombine(seed, createInfo.mipLodBias);
+  hashCombine(seed, createInfo.anisotropyEnable);
+  hashCombine(seed, createInfo.maxAnisotropy);
+  hashCombine(seed, createInfo.compareEnable);
+  hashCombine(seed, createInfo.compareOp);
+  hashCombine(seed, createInfo.minLod);
+  hashCombine(seed, createInfo.maxLod);
+  hashCombine(seed, createInfo.borderColor);
+  hashCombine(seed, createInfo.unnormalizedCoordinates);
+  return seed;
+}
+
+bool VulkanSamplerCache::CreateInfoEqual::operator()(const vk::SamplerCreateInfo &a,
+  const vk::SamplerCreateInfo &b) const
+{
+  return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter
+         && a.mipmapMode == b.mipmapMode && a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV
+         && a.addressModeW == b.addressModeW && a.mipLodBias == b.mipLodBias
+         && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy
+         && a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod
+         && a.maxLod == b.maxLod && a.borderColor == b.borderColor
+         && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+}// namespace engine::renderer
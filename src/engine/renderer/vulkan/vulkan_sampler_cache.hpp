@@ -0,0 +1,48 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_bindless_heap.hpp>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <unordered_map>
+
+namespace engine::renderer {
+struct CachedSampler
+{
+  vk::Sampler sampler;
+  uint32_t bindlessSlot = VulkanBindlessHeap::INVALID_SLOT;
+};
+
+// Samplers are deduplicated by their create info: a scene with thousands of textures typically needs a handful of
+// distinct samplers, and devices may limit them to as few as 4000. Each one is registered in the bindless heap once
+// and lives until the cache is destroyed.
+class VulkanSamplerCache
+{
+public:
+  VulkanSamplerCache(VulkanDevice *device, VulkanBindlessHeap *bindlessHeap);
+  ~VulkanSamplerCache();
+
+  VulkanSamplerCache(const VulkanSamplerCache &) = delete;
+  VulkanSamplerCache &operator=(const VulkanSamplerCache &) = delete;
+
+  // Create infos with a pNext chain aren't supported, their chain would have to be part of the key
+  const CachedSampler &getSampler(const vk::SamplerCreateInfo &createInfo);
+
+  inline size_t getSamplerCount() const noexcept { return m_samplers.size(); }
+
+private:
+  struct CreateInfoHash
+  {
+    size_t operator()(const vk::SamplerCreateInfo &createInfo) const;
+  };
+
+  struct CreateInfoEqual
+  {
+    bool operator()(const vk::SamplerCreateInfo &a, const vk::SamplerCreateInfo &b) const;
+  };
+
+private:
+  VulkanDevice *m_device;
+  VulkanBindlessHeap *m_bindlessHeap;
+
+  std::unordered_map<vk::SamplerCreateInfo, CachedSampler, CreateInfoHash, CreateInfoEqual> m_samplers;
+};
+}// namespace engine::renderer
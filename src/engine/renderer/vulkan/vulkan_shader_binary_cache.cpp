@@ -0,0 +1,166 @@
+#include "vulkan_shader_binary_cache.hpp"
+#include "vulkan_utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <engine/core/filesystem.hpp>
+#include <engine/core/logger.hpp>
+
+namespace engine::renderer {
+VulkanShaderBinaryCache::VulkanShaderBinaryCache(VulkanDevice *device) : m_device{ device }
+{
+  auto properties = m_device->getPhysicalDevice()
+                      .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceShaderObjectPropertiesEXT>();
+  const auto &shaderObjectProperties = properties.get<vk::PhysicalDeviceShaderObjectPropertiesEXT>();
+
+  std::copy(shaderObjectProperties.shaderBinaryUUID.begin(),
+    shaderObjectProperties.shaderBinaryUUID.end(),
+    m_shaderBinaryUUID.begin());
+  m_shaderBinaryVersion = shaderObjectProperties.shaderBinaryVersion;
+}
+
+std::vector<vk::ShaderEXT> VulkanShaderBinaryCache::createShaders(const std::vector<vk::ShaderCreateInfoEXT> &infos)
+{
+  const uint64_t key = computeKey(infos);
+
+  std::vector<std::vector<uint8_t>> binaries;
+  if (loadBinaries(key, infos.size(), binaries)) {
+    std::vector<vk::ShaderEXT> shaders;
+    if (createFromBinaries(infos, binaries, shaders)) { return shaders; }
+    core::Logger::warn("Shader binary {:016x} was rejected by the driver, recompiling from SPIR-V", key);
+  }
+
+  std::vector<vk::ShaderEXT> shaders = createFromSpirv(infos);
+  storeBinaries(key, shaders);
+  return shaders;
+}
+
+uint64_t VulkanShaderBinaryCache::computeKey(const std::vector<vk::ShaderCreateInfoEXT> &infos) const
+{
+  uint64_t key = hashBytes(&m_shaderBinaryVersion, sizeof(m_shaderBinaryVersion));
+  for (const vk::ShaderCreateInfoEXT &info : infos) {
+    const auto stage = static_cast<VkShaderStageFlags>(info.stage);
+    const auto nextStage = static_cast<VkShaderStageFlags>(info.nextStage);
+    const auto flags = static_cast<VkShaderCreateFlagsEXT>(info.flags);
+    key = hashBytes(&stage, sizeof(stage), key);
+    key = hashBytes(&nextStage, sizeof(nextStage), key);
+    key = hashBytes(&flags, sizeof(flags), key);
+    key = hashBytes(info.pCode, info.codeSize, key);
+    key = hashBytes(info.pName, std::strlen(info.pName), key);
+    // Layout handles change between runs, but the layouts themselves are created from the same code
+    key = hashBytes(&info.setLayoutCount, sizeof(info.setLayoutCount), key);
+    key = hashBytes(info.pPushConstantRanges, info.pushConstantRangeCount * sizeof(vk::PushConstantRange), key);
+  }
+  return key;
+}
+
+std::filesystem::path VulkanShaderBinaryCache::getPath(uint64_t key) const
+{
+  return core::getCachePath(std::filesystem::path("shaders") / fmt::format("{:016x}.bin", key));
+}
+
+bool VulkanShaderBinaryCache::loadBinaries(uint64_t key,
+  size_t shaderCount,
+  std::vector<std::vector<uint8_t>> &binaries) const
+{
+  std::vector<char> data = core::readBinaryFile(getPath(key));
+  if (data.size() < sizeof(FileHeader) + shaderCount * sizeof(uint64_t)) { return false; }
+
+  FileHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != FILE_MAGIC || header.shaderBinaryVersion != m_shaderBinaryVersion
+      || header.shaderBinaryUUID != m_shaderBinaryUUID || header.shaderCount != shaderCount) {
+    return false;
+  }
+
+  size_t offset = sizeof(FileHeader) + shaderCount * sizeof(uint64_t);
+  binaries.resize(shaderCount);
+  for (size_t i = 0; i < shaderCount; i++) {
+    uint64_t size = 0;
+    std::memcpy(&size, data.data() + sizeof(FileHeader) + i * sizeof(uint64_t), sizeof(size));
+    if (size == 0 || offset + size > data.size()) { return false; }
+
+    // Separate allocations keep every binary 16 byte aligned as the spec requires
+    binaries[i].assign(data.begin() + static_cast<std::ptrdiff_t>(offset),
+      data.begin() + static_cast<std::ptrdiff_t>(offset + size));
+    offset += size;
+  }
+
+  return true;
+}
+
+void VulkanShaderBinaryCache::storeBinaries(uint64_t key, const std::vector<vk::ShaderEXT> &shaders) const
+{
+  FileHeader header = {
+    .magic = FILE_MAGIC,
+    .shaderBinaryVersion = m_shaderBinaryVersion,
+    .shaderBinaryUUID = m_shaderBinaryUUID,
+    .shaderCount = static_cast<uint32_t>(shaders.size()),
+  };
+
+  std::vector<std::vector<uint8_t>> binaries;
+  for (vk::ShaderEXT shader : shaders) {
+    auto binary = m_device->getDevice().getShaderBinaryDataEXT(shader);
+    if (binary.result != vk::Result::eSuccess || binary.value.empty()) {
+      core::Logger::warn("Failed to retrieve shader binary data, {:016x} won't be cached", key);
+      return;
+    }
+    binaries.push_back(std::move(binary.value));
+  }
+
+  std::vector<char> data(sizeof(FileHeader) + binaries.size() * sizeof(uint64_t));
+  std::memcpy(data.data(), &header, sizeof(header));
+  for (size_t i = 0; i < binaries.size(); i++) {
+    uint64_t size = binaries[i].size();
+    std::memcpy(data.data() + sizeof(FileHeader) + i * sizeof(uint64_t), &size, sizeof(size));
+    data.insert(data.end(), binaries[i].begin(), binaries[i].end());
+  }
+
+  if (!core::writeBinaryFile(getPath(key), data)) {
+    core::Logger::warn("Failed to write shader binary {:016x}", key);
+  }
+}
+
+bool VulkanShaderBinaryCache::createFromBinaries(const std::vector<vk::ShaderCreateInfoEXT> &infos,
+  const std::vector<std::vector<uint8_t>> &binaries,
+  std::vector<vk::ShaderEXT> &shaders) const
+{
+  std::vector<vk::ShaderCreateInfoEXT> binaryInfos = infos;
+  for (size_t i = 0; i < binaryInfos.size(); i++) {
+    binaryInfos[i].setCodeType(vk::ShaderCodeTypeEXT::eBinary)
+      .setCodeSize(binaries[i].size())
+      .setPCode(binaries[i].data());
+  }
+
+  // Called through the dispatcher, a rejected binary is an expected result here and mustn't trip vulkan-hpp's
+  // result assertions
+  std::vector<VkShaderEXT> rawShaders(binaryInfos.size(), VK_NULL_HANDLE);
+  VkResult result = VULKAN_HPP_DEFAULT_DISPATCHER.vkCreateShadersEXT(m_device->getDevice(),
+    static_cast<uint32_t>(binaryInfos.size()),
+    reinterpret_cast<const VkShaderCreateInfoEXT *>(binaryInfos.data()),
+    nullptr,
+    rawShaders.data());
+
+  if (result != VK_SUCCESS) {
+    for (VkShaderEXT shader : rawShaders) {
+      if (shader != VK_NULL_HANDLE) { m_device->getDevice().destroyShaderEXT(shader); }
+    }
+    return false;
+  }
+
+  shaders.assign(rawShaders.begin(), rawShaders.end());
+  return true;
+}
+
+std::vector<vk::ShaderEXT> VulkanShaderBinaryCache::createFromSpirv(
+  const std::vector<vk::ShaderCreateInfoEXT> &infos) const
+{
+  std::vector<VkShaderEXT> rawShaders(infos.size(), VK_NULL_HANDLE);
+  checkVkResult(VULKAN_HPP_DEFAULT_DISPATCHER.vkCreateShadersEXT(m_device->getDevice(),
+    static_cast<uint32_t>(infos.size()),
+    reinterpret_cast<const VkShaderCreateInfoEXT *>(infos.data()),
+    nullptr,
+    rawShaders.data()));
+
+  return { rawShaders.begin(), rawShaders.end() };
+}
+}// namespace engine::renderer
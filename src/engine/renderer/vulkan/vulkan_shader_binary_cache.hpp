@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <filesystem>
+#include <vector>
+
+namespace engine::renderer {
+// Keeps the driver's compiled shader objects on disk. A set of linked shaders is keyed by a hash of everything that
+// went into creating it (SPIR-V, stages, flags, interface), and every file is tagged with the device's
+// shaderBinaryUUID/shaderBinaryVersion so binaries from another driver are never tried.
+class VulkanShaderBinaryCache
+{
+public:
+  VulkanShaderBinaryCache(VulkanDevice *device);
+
+  VulkanShaderBinaryCache(const VulkanShaderBinaryCache &) = delete;
+  VulkanShaderBinaryCache &operator=(const VulkanShaderBinaryCache &) = delete;
+
+  // infos must describe SPIR-V shaders. Creates them from a cached binary when there is a compatible one, otherwise
+  // compiles the SPIR-V and stores the resulting binaries for the next launch.
+  std::vector<vk::ShaderEXT> createShaders(const std::vector<vk::ShaderCreateInfoEXT> &infos);
+
+private:
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t shaderBinaryVersion;
+    std::array<uint8_t, VK_UUID_SIZE> shaderBinaryUUID;
+    uint32_t shaderCount;
+  };
+
+  uint64_t computeKey(const std::vector<vk::ShaderCreateInfoEXT> &infos) const;
+  std::filesystem::path getPath(uint64_t key) const;
+
+  bool loadBinaries(uint64_t key, size_t shaderCount, std::vector<std::vector<uint8_t>> &binaries) const;
+  void storeBinaries(uint64_t key, const std::vector<vk::ShaderEXT> &shaders) const;
+
+  bool createFromBinaries(const std::vector<vk::ShaderCreateInfoEXT> &infos,
+    const std::vector<std::vector<uint8_t>> &binaries,
+    std::vector<vk::ShaderEXT> &shaders) const;
+  std::vector<vk::ShaderEXT> createFromSpirv(const std::vector<vk::ShaderCreateInfoEXT> &infos) const;
+
+private:
+  static constexpr uint32_t FILE_MAGIC = 0x53425343;// "CSBS"
+
+  VulkanDevice *m_device;
+  std::array<uint8_t, VK_UUID_SIZE> m_shaderBinaryUUID;
+  uint32_t m_shaderBinaryVersion;
+};
+}// namespace engine::renderer
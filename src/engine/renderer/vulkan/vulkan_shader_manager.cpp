@@ -15,6 +15,7 @@ namespace renderer {
   {
     for (auto &shader : m_vertexShaders) { vkDestroyShaderModule(m_device->getDevice(), shader.shader, nullptr); }
     for (auto &shader : m_fragmentShaders) { vkDestroyShaderModule(m_device->getDevice(), shader.shader, nullptr); }
+    for (auto &shader : m_computeShaders) { vkDestroyShaderModule(m_device->getDevice(), shader.shader, nullptr); }
   }
 
   std::vector<Shader> &VulkanShaderManager::getShaders(ShaderType type)
@@ -24,6 +25,20 @@ namespace renderer {
       return m_vertexShaders;
     case ShaderType::Fragment:
       return m_fragmentShaders;
+    case ShaderType::Compute:
+      return m_computeShaders;
+    }
+  }
+
+  const char *VulkanShaderManager::getExtension(ShaderType type)
+  {
+    switch (type) {
+    case ShaderType::Vertex:
+      return ".vert";
+    case ShaderType::Fragment:
+      return ".frag";
+    case ShaderType::Compute:
+      return ".comp";
     }
   }
 
@@ -34,11 +49,7 @@ namespace renderer {
       std::find_if(shaders.begin(), shaders.end(), [path](const Shader &shader) { return shader.path == path; });
     if (it != shaders.end()) { return static_cast<size_t>(it - shaders.begin()); }
 
-    const std::string filename = std::string(path) + (type == ShaderType::Vertex ? ".vert" : ".frag") + ".spv";
-    const std::filesystem::path relativePath = std::filesystem::path("shaders") / filename;
-    std::string absPathStr = core::getAbsolutePath(relativePath);
-
-    auto code = readFile(absPathStr);
+    auto code = readFile(getShaderFile(path, type));
 
     vk::ShaderModuleCreateInfo createInfo{};
     createInfo.codeSize = code.size();
@@ -55,6 +66,18 @@ namespace renderer {
     return shaders.size() - 1;
   }
 
+  bool VulkanShaderManager::shaderExists(std::string_view path, ShaderType type)
+  {
+    return std::filesystem::exists(getShaderFile(path, type));
+  }
+
+  std::string VulkanShaderManager::getShaderFile(std::string_view path, ShaderType type)
+  {
+    const std::string filename = std::string(path) + getExtension(type) + ".spv";
+    const std::filesystem::path relativePath = std::filesystem::path("shaders") / filename;
+    return core::getAbsolutePath(relativePath).string();
+  }
+
   std::vector<char> VulkanShaderManager::readFile(std::string_view filename)
   {
     std::ifstream file(filename.data(), std::ios::ate | std::ios::binary);
@@ -82,6 +105,11 @@ namespace renderer {
 
     core::assertion(result == SPV_REFLECT_RESULT_SUCCESS, "Spirv reflection failed!");
 
+    if (reflectModule.shader_stage == SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT && reflectModule.entry_point_count > 0) {
+      const SpvReflectEntryPoint &entryPoint = reflectModule.entry_points[0];
+      reflection.workgroupSize = { entryPoint.local_size.x, entryPoint.local_size.y, entryPoint.local_size.z };
+    }
+
     uint32_t inputCount = 0;
     result = spvReflectEnumerateInputVariables(&reflectModule, &inputCount, NULL);
 
@@ -182,7 +210,8 @@ namespace renderer {
           bindInfo.count = reflectionBinding->count;
           bindInfo.stageFlags = static_cast<vk::ShaderStageFlagBits>(reflectModule.shader_stage);
 
-          if (bindInfo.descriptorType == vk::DescriptorType::eStorageBuffer) {
+          if (bindInfo.descriptorType == vk::DescriptorType::eStorageBuffer
+              || bindInfo.descriptorType == vk::DescriptorType::eStorageImage) {
             bindInfo.isUsed = reflectionBinding->accessed;
             bindInfo.isWrite = (reflectionBinding->resource_type & SPV_REFLECT_RESOURCE_FLAG_UAV);
           }
@@ -197,5 +226,37 @@ namespace renderer {
     return reflection;
   }
 
+  std::vector<BindInfo> VulkanShaderManager::mergeBindInfos(std::span<const BindReflection *const> stages)
+  {
+    std::vector<BindInfo> merged;
+    for (const BindReflection *stage : stages) {
+      for (const BindInfo &bindInfo : stage->bindInfos) {
+        auto it = std::find_if(merged.begin(), merged.end(), [&bindInfo](const BindInfo &other) {
+          return other.set == bindInfo.set && other.binding == bindInfo.binding;
+        });
+        if (it == merged.end()) {
+          merged.push_back(bindInfo);
+          continue;
+        }
+
+        core::assertion(it->descriptorType == bindInfo.descriptorType,
+          "Binding {} of set {} is declared as {} and {}",
+          bindInfo.binding,
+          bindInfo.set,
+          vk::to_string(it->descriptorType),
+          vk::to_string(bindInfo.descriptorType));
+        it->count = std::max(it->count, bindInfo.count);
+        it->stageFlags |= bindInfo.stageFlags;
+        it->isUsed |= bindInfo.isUsed;
+        it->isWrite |= bindInfo.isWrite;
+      }
+    }
+
+    std::sort(merged.begin(), merged.end(), [](const BindInfo &a, const BindInfo &b) {
+      return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+    return merged;
+  }
+
 }// namespace renderer
 }// namespace engine
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <array>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <span>
 #include <string>
 
 namespace engine {
 namespace renderer {
 struct BindInfoPushConstant {
-  vk::ShaderStageFlagBits stageFlags;
+  vk::ShaderStageFlags stageFlags;
   uint32_t offset;
   uint32_t size;
 };
@@ -17,7 +19,7 @@ struct BindInfo {
   uint32_t set;
   uint32_t binding;
   uint32_t count;
-  vk::ShaderStageFlagBits stageFlags;
+  vk::ShaderStageFlags stageFlags;
 
   bool isUsed = false;
   bool isWrite = false;
@@ -27,6 +29,8 @@ struct BindReflection {
   std::vector<vk::VertexInputAttributeDescription2EXT> attributeDescriptions;
   std::vector<BindInfoPushConstant> pushConstants;
   std::vector<BindInfo> bindInfos;
+  // local_size_x/y/z of compute shaders, 1 for other stages
+  std::array<uint32_t, 3> workgroupSize = {1, 1, 1};
 };
 struct Shader {
   std::string path;
@@ -37,26 +41,38 @@ struct Shader {
 
 class VulkanShaderManager {
 public:
-  enum class ShaderType { Vertex, Fragment };
+  enum class ShaderType { Vertex, Fragment, Compute };
 
 public:
   VulkanShaderManager(VulkanDevice *device);
   ~VulkanShaderManager();
 
   size_t loadShader(std::string_view path, ShaderType type);
+  // Whether loadShader would find the compiled shader
+  static bool shaderExists(std::string_view path, ShaderType type);
+  const std::string &getShaderPath(size_t index, ShaderType type) { return getShaders(type)[index].path; }
 
   VkShaderModule getVertexShaderModule(size_t index) { return m_vertexShaders[index].shader; }
   VkShaderModule getFragmentShaderModule(size_t index) { return m_fragmentShaders[index].shader; }
+  VkShaderModule getComputeShaderModule(size_t index) { return m_computeShaders[index].shader; }
 
   const BindReflection &getVertexBindReflection(size_t index) { return m_vertexShaders[index].bindReflection; }
   const BindReflection &getFragmentBindReflection(size_t index) { return m_fragmentShaders[index].bindReflection; }
+  const BindReflection &getComputeBindReflection(size_t index) { return m_computeShaders[index].bindReflection; }
 
   std::vector<char> &getVertexSpirv(size_t index) { return m_vertexShaders[index].spirv; }
   std::vector<char> &getFragmentSpirv(size_t index) { return m_fragmentShaders[index].spirv; }
+  std::vector<char> &getComputeSpirv(size_t index) { return m_computeShaders[index].spirv; }
+
+  // Bindings of all the stages of a program, sorted by set and binding. A binding declared by several stages (or
+  // aliased within one) becomes a single entry visible to all of them, their types have to match.
+  static std::vector<BindInfo> mergeBindInfos(std::span<const BindReflection *const> stages);
 
 private:
+  static std::string getShaderFile(std::string_view path, ShaderType type);
   static std::vector<char> readFile(std::string_view filename);
   static BindReflection reflectBind(std::vector<char> &code);
+  static const char *getExtension(ShaderType type);
 
   std::vector<Shader> &getShaders(ShaderType type);
 
@@ -64,6 +80,7 @@ private:
   VulkanDevice *m_device;
   std::vector<Shader> m_vertexShaders;
   std::vector<Shader> m_fragmentShaders;
+  std::vector<Shader> m_computeShaders;
 };
 } // namespace renderer
 } // namespace engine
@@ -1,10 +1,39 @@
 #include "vulkan_shader_program.hpp"
+#include "vulkan_utils.hpp"
+#include <engine/core/assert.hpp>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
 namespace engine::renderer {
 VulkanShaderProgram::VulkanShaderProgram(VulkanDevice *device, VulkanShaderProgramDesc const &desc)
-    : m_device{device}, m_attributes{desc.attributes}, m_bindings{desc.bindings} {
+    : m_device{device}, m_attributes{desc.attributes}, m_bindings{desc.bindings}, m_state{desc.state},
+      m_isCompute{desc.computeSpirv.has_value()}, m_workgroupSize{desc.workgroupSize}, m_setLayouts{desc.setLayouts},
+      m_pipelineLayout{desc.pipelineLayout} {
+  core::assertion(!m_isCompute || (!desc.vertexSpirv.has_value() && !desc.fragmentSpirv.has_value()),
+                  "A compute program can't have graphics stages");
+
+  m_vertexInputHash = computeVertexInputHash();
+
+  for (const BindInfoPushConstant &pushConstant : desc.pushConstants) {
+    m_pushConstantStages |= pushConstant.stageFlags;
+  }
+
+  core::assertion(static_cast<bool>(m_pipelineLayout), "Programs are created with a pipeline layout from the cache");
+
+  if (desc.vertexSpirv.has_value()) {
+    m_stages.push_back(vk::ShaderStageFlagBits::eVertex);
+  }
+  if (desc.fragmentSpirv.has_value()) {
+    m_stages.push_back(vk::ShaderStageFlagBits::eFragment);
+  }
+  if (desc.computeSpirv.has_value()) {
+    m_stages.push_back(vk::ShaderStageFlagBits::eCompute);
+  }
+}
+
+void VulkanShaderProgram::compile(VulkanShaderBinaryCache *binaryCache, VulkanShaderProgramDesc const &desc) {
+  core::assertion(!isReady(), "Program already compiled");
+
   std::vector<vk::ShaderCreateInfoEXT> infos;
   std::vector<vk::PushConstantRange> pushConstantRanges;
 
@@ -15,18 +44,8 @@ VulkanShaderProgram::VulkanShaderProgram(VulkanDevice *device, VulkanShaderProgr
     range.stageFlags = pushConstant.stageFlags;
   }
 
-  vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {
-      .setLayoutCount = 0,    // TODO
-      .pSetLayouts = nullptr, // TODO
-      .pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size()),
-      .pPushConstantRanges = pushConstantRanges.data(),
-  };
-
-  m_pipelineLayout = m_device->getDevice().createPipelineLayout(pipelineLayoutInfo).value;
-
   if (desc.vertexSpirv.has_value()) {
     infos.push_back(createShaderCreateInfo(desc.vertexSpirv.value(), desc));
-    m_stages.push_back(vk::ShaderStageFlagBits::eVertex);
     infos[0].setPushConstantRanges(pushConstantRanges);
     if (desc.fragmentSpirv.has_value()) {
       infos[0].setStage(vk::ShaderStageFlagBits::eVertex);
@@ -36,7 +55,6 @@ VulkanShaderProgram::VulkanShaderProgram(VulkanDevice *device, VulkanShaderProgr
   }
 
   if (desc.fragmentSpirv.has_value()) {
-    m_stages.push_back(vk::ShaderStageFlagBits::eFragment);
     infos.push_back(createShaderCreateInfo(desc.fragmentSpirv.value(), desc));
     const size_t idx = infos.size() - 1;
     infos[idx].setStage(vk::ShaderStageFlagBits::eFragment);
@@ -44,14 +62,21 @@ VulkanShaderProgram::VulkanShaderProgram(VulkanDevice *device, VulkanShaderProgr
     infos[idx].setPushConstantRanges(pushConstantRanges);
   }
 
-  m_shaders = m_device->getDevice().createShadersEXT(infos).value;
+  if (desc.computeSpirv.has_value()) {
+    infos.push_back(createShaderCreateInfo(desc.computeSpirv.value(), desc));
+    infos.back().setStage(vk::ShaderStageFlagBits::eCompute);
+    infos.back().setPushConstantRanges(pushConstantRanges);
+  }
+
+  m_shaders = binaryCache->createShaders(infos);
+  m_isReady.store(true, std::memory_order_release);
+  m_isReady.notify_all();
 }
 
 VulkanShaderProgram::~VulkanShaderProgram() {
   for (auto shader : m_shaders) {
     m_device->getDevice().destroyShaderEXT(shader);
   }
-  m_device->getDevice().destroyPipelineLayout(m_pipelineLayout);
 }
 
 vk::ShaderCreateInfoEXT VulkanShaderProgram::createShaderCreateInfo(const std::vector<char> &code,
@@ -66,30 +91,30 @@ vk::ShaderCreateInfoEXT VulkanShaderProgram::createShaderCreateInfo(const std::v
   return info;
 }
 
-void VulkanShaderProgram::bind(vk::CommandBuffer commandBuffer) {
-  commandBuffer.setCullMode(vk::CullModeFlagBits::eNone);
-  commandBuffer.setFrontFace(vk::FrontFace::eCounterClockwise);
-  commandBuffer.setDepthTestEnable(vk::True);
-  commandBuffer.setDepthWriteEnable(vk::True);
-  commandBuffer.setDepthCompareOp(vk::CompareOp::eLessOrEqual);
-  commandBuffer.setPrimitiveTopology(vk::PrimitiveTopology::eTriangleList);
-  commandBuffer.setRasterizerDiscardEnable(vk::False);
-  commandBuffer.setPolygonModeEXT(vk::PolygonMode::eFill);
-  commandBuffer.setRasterizationSamplesEXT(vk::SampleCountFlagBits::e1);
-  commandBuffer.setAlphaToCoverageEnableEXT(vk::False);
-  commandBuffer.setDepthBiasEnable(vk::False);
-  commandBuffer.setStencilTestEnable(vk::False);
-  commandBuffer.setPrimitiveRestartEnable(vk::False);
-  commandBuffer.setDepthClampEnableEXT(vk::False);
-
-  commandBuffer.setSampleMaskEXT(vk::SampleCountFlagBits::e1, 0xff);
-
-  commandBuffer.setColorBlendEnableEXT(0, {vk::False});
-  commandBuffer.setColorWriteMaskEXT(0, vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                                            vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA);
-
-  commandBuffer.setVertexInputEXT(m_bindings, m_attributes);
+uint64_t VulkanShaderProgram::computeVertexInputHash() const {
+  size_t seed = 0;
+  for (const vk::VertexInputBindingDescription2EXT &binding : m_bindings) {
+    hashCombine(seed, binding.binding);
+    hashCombine(seed, binding.stride);
+    hashCombine(seed, static_cast<uint32_t>(binding.inputRate));
+    hashCombine(seed, binding.divisor);
+  }
+  for (const vk::VertexInputAttributeDescription2EXT &attribute : m_attributes) {
+    hashCombine(seed, attribute.location);
+    hashCombine(seed, attribute.binding);
+    hashCombine(seed, static_cast<uint32_t>(attribute.format));
+    hashCombine(seed, attribute.offset);
+  }
+  return seed;
+}
+
+void VulkanShaderProgram::bind(vk::CommandBuffer commandBuffer, VulkanDynamicStateTracker &stateTracker) {
+  stateTracker.setState(commandBuffer, m_state);
+  stateTracker.setVertexInput(commandBuffer, m_vertexInputHash, m_bindings, m_attributes);
+  stateTracker.bindShaders(commandBuffer, m_stages, m_shaders);
+}
 
+void VulkanShaderProgram::bindCompute(vk::CommandBuffer commandBuffer) {
   commandBuffer.bindShadersEXT(m_stages, m_shaders);
 }
-} // namespace engine::renderer
\ No newline at end of file
+} // namespace engine::renderer
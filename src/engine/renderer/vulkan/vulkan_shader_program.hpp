@@ -2,19 +2,43 @@
 
 #include <engine/renderer/descriptors/shader_program_descriptors.hpp>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_dynamic_state.hpp>
+#include <engine/renderer/vulkan/vulkan_shader_binary_cache.hpp>
+#include <atomic>
 #include <vulkan/vulkan_enums.hpp>
 
 namespace engine::renderer {
+// Created without shaders, compile() creates them and may run on a VulkanAsyncCompiler thread. Everything but the
+// shaders (layout, state, vertex input) is usable right away, e.g. to push constants while a fallback is bound.
 class VulkanShaderProgram {
 public:
   VulkanShaderProgram(VulkanDevice *device, VulkanShaderProgramDesc const &desc);
   ~VulkanShaderProgram();
 
-  void bind(vk::CommandBuffer commandBuffer);
+  // Called once, with the desc the program was created from
+  void compile(VulkanShaderBinaryCache *binaryCache, VulkanShaderProgramDesc const &desc);
+  bool isReady() const { return m_isReady.load(std::memory_order_acquire); }
+  // A compile job and a synchronous request may race for a program, only the first one to claim it compiles
+  bool claim() { return !m_isClaimed.exchange(true, std::memory_order_acq_rel); }
+  // Blocks until whoever claimed the program has compiled it
+  void waitReady() const { m_isReady.wait(false, std::memory_order_acquire); }
+
+  void bind(vk::CommandBuffer commandBuffer, VulkanDynamicStateTracker &stateTracker);
+
+  // Compute programs bind their single shader directly, they don't touch the graphics state tracker
+  void bindCompute(vk::CommandBuffer commandBuffer);
 
   vk::PipelineLayout &getPipelineLayout() { return m_pipelineLayout; };
+  // Set 0 is the bindless heap
+  vk::DescriptorSetLayout getSetLayout(uint32_t set) const { return m_setLayouts[set]; }
+  uint32_t getSetCount() const { return static_cast<uint32_t>(m_setLayouts.size()); }
+  vk::ShaderStageFlags getPushConstantStages() const { return m_pushConstantStages; }
+  bool isCompute() const { return m_isCompute; }
+  uint64_t getVertexInputHash() const { return m_vertexInputHash; }
+  const std::array<uint32_t, 3> &getWorkgroupSize() const { return m_workgroupSize; }
 
 private:
+  uint64_t computeVertexInputHash() const;
   vk::ShaderCreateInfoEXT createShaderCreateInfo(const std::vector<char> &code,
                                                  VulkanShaderProgramDesc const &desc) const;
 
@@ -23,9 +47,18 @@ private:
 
   std::vector<vk::VertexInputAttributeDescription2EXT> m_attributes;
   std::vector<vk::VertexInputBindingDescription2EXT> m_bindings;
+  uint64_t m_vertexInputHash = 0;
+  DynamicStateBlock m_state;
   std::vector<vk::ShaderStageFlagBits> m_stages;
   std::vector<vk::ShaderEXT> m_shaders;
+  // Published by compile(), m_shaders isn't touched by the renderer before
+  std::atomic<bool> m_isReady = false;
+  std::atomic<bool> m_isClaimed = false;
+  bool m_isCompute = false;
+  std::array<uint32_t, 3> m_workgroupSize;
 
+  std::vector<vk::DescriptorSetLayout> m_setLayouts;
   vk::PipelineLayout m_pipelineLayout;
+  vk::ShaderStageFlags m_pushConstantStages;
 };
 } // namespace engine::renderer
@@ -1,14 +1,79 @@
 #include "vulkan_shader_program_manager.hpp"
+#include <engine/core/assert.hpp>
 
 namespace engine::renderer {
-VulkanShaderProgramManager::VulkanShaderProgramManager(VulkanDevice *device) : m_device{device} {}
+VulkanShaderProgramManager::VulkanShaderProgramManager(VulkanDevice *device, VulkanAsyncCompiler *compiler)
+    : m_device{device}, m_compiler{compiler}, m_binaryCache{device} {}
+
+VulkanShaderProgramManager::~VulkanShaderProgramManager() { m_compiler->waitIdle(); }
 
 ShaderProgramId VulkanShaderProgramManager::createShaderProgram(VulkanShaderProgramDesc const &desc) {
-  m_shaderPrograms.emplace_back(std::make_unique<VulkanShaderProgram>(m_device, desc));
+  auto &program = m_shaderPrograms.emplace_back(std::make_unique<VulkanShaderProgram>(m_device, desc));
+  m_pendingDescs.emplace_back();
+  program->compile(&m_binaryCache, desc);
   return ShaderProgramId{m_shaderPrograms.size() - 1};
 };
 
-void VulkanShaderProgramManager::bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId) {
-  m_shaderPrograms[shaderProgramId.value]->bind(commandBuffer);
+ShaderProgramId VulkanShaderProgramManager::createShaderProgramAsync(VulkanShaderProgramDesc desc) {
+  VulkanShaderProgram *program =
+      m_shaderPrograms.emplace_back(std::make_unique<VulkanShaderProgram>(m_device, desc)).get();
+  auto sharedDesc = std::make_shared<const VulkanShaderProgramDesc>(std::move(desc));
+  m_pendingDescs.emplace_back(sharedDesc);
+  m_compiler->submit([this, program, sharedDesc] {
+    if (program->claim()) {
+      program->compile(&m_binaryCache, *sharedDesc);
+    }
+  });
+  return ShaderProgramId{m_shaderPrograms.size() - 1};
+}
+
+void VulkanShaderProgramManager::finishShaderProgram(ShaderProgramId shaderProgramId) {
+  VulkanShaderProgram *program = m_shaderPrograms[shaderProgramId.value].get();
+  if (program->isReady()) {
+    return;
+  }
+
+  // Expired only once the job has run, the program is ready then
+  std::shared_ptr<const VulkanShaderProgramDesc> desc = m_pendingDescs[shaderProgramId.value].lock();
+  if (desc && program->claim()) {
+    program->compile(&m_binaryCache, *desc);
+  } else {
+    program->waitReady();
+  }
+}
+
+void VulkanShaderProgramManager::setFallbackProgram(ShaderProgramId shaderProgramId) {
+  core::assertion(!m_shaderPrograms[shaderProgramId.value]->isCompute(), "Only graphics programs have a fallback");
+  core::assertion(isReady(shaderProgramId), "The fallback program has to be compiled synchronously");
+  m_fallbackProgram = shaderProgramId;
+}
+
+bool VulkanShaderProgramManager::bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId,
+                                                   VulkanDynamicStateTracker &stateTracker) {
+  VulkanShaderProgram *program = m_shaderPrograms[shaderProgramId.value].get();
+  core::assertion(!program->isCompute(), "Compute programs are bound with bindComputeProgram");
+  if (!program->isReady()) {
+    if (!m_fallbackProgram.has_value()) {
+      return false;
+    }
+    // A fallback reading other attributes would draw garbage, better to draw nothing
+    VulkanShaderProgram *fallback = m_shaderPrograms[m_fallbackProgram->value].get();
+    if (fallback->getVertexInputHash() != program->getVertexInputHash()) {
+      return false;
+    }
+    program = fallback;
+  }
+  program->bind(commandBuffer, stateTracker);
+  return true;
+}
+
+bool VulkanShaderProgramManager::bindComputeProgram(vk::CommandBuffer commandBuffer, ShaderProgramId shaderProgramId) {
+  VulkanShaderProgram *program = m_shaderPrograms[shaderProgramId.value].get();
+  core::assertion(program->isCompute(), "Not a compute program");
+  if (!program->isReady()) {
+    return false;
+  }
+  program->bindCompute(commandBuffer);
+  return true;
 }
-} // namespace engine::renderer
\ No newline at end of file
+} // namespace engine::renderer
@@ -1,21 +1,46 @@
 #pragma once
+#include <engine/renderer/vulkan/vulkan_async_compiler.hpp>
 #include <engine/renderer/vulkan/vulkan_shader_program.hpp>
 #include <memory>
+#include <optional>
 
 namespace engine::renderer {
 class VulkanDevice;
 class VulkanShaderProgramManager {
 public:
-  VulkanShaderProgramManager(VulkanDevice *device);
+  VulkanShaderProgramManager(VulkanDevice *device, VulkanAsyncCompiler *compiler);
+  // Waits for the programs still compiling
+  ~VulkanShaderProgramManager();
 
+  // Compiles on the calling thread
   ShaderProgramId createShaderProgram(VulkanShaderProgramDesc const &desc);
+  // Returns right away, the program compiles on the compiler's threads and is bound in place of the fallback (or not
+  // at all) until then
+  ShaderProgramId createShaderProgramAsync(VulkanShaderProgramDesc desc);
+  bool isReady(ShaderProgramId shaderProgramId) const { return m_shaderPrograms[shaderProgramId.value]->isReady(); }
+  // For a program requested asynchronously that is needed now: compiles it on the calling thread, or waits for the
+  // compiler thread already on it. Never for the jobs queued before it.
+  void finishShaderProgram(ShaderProgramId shaderProgramId);
 
-  void bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId);
+  // Stands in for graphics programs still compiling that read the same vertex input, programs with another vertex
+  // layout are skipped. The fallback itself is compiled synchronously.
+  void setFallbackProgram(ShaderProgramId shaderProgramId);
+
+  // Return false when neither the program nor a fallback could be bound, the draw or dispatch has to be skipped
+  bool bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId,
+                         VulkanDynamicStateTracker &stateTracker);
+  bool bindComputeProgram(vk::CommandBuffer commandBuffer, ShaderProgramId shaderProgramId);
 
   VulkanShaderProgram *getShaderProgram(ShaderProgramId id) { return m_shaderPrograms[id.value].get(); }
 
 private:
   VulkanDevice *m_device;
+  VulkanAsyncCompiler *m_compiler;
+  VulkanShaderBinaryCache m_binaryCache;
+  // Programs never move, compile jobs hold on to them
   std::vector<std::unique_ptr<VulkanShaderProgram>> m_shaderPrograms;
+  // Indexed like the programs, owned by the compile jobs so they expire once the job has run
+  std::vector<std::weak_ptr<const VulkanShaderProgramDesc>> m_pendingDescs;
+  std::optional<ShaderProgramId> m_fallbackProgram;
 };
-} // namespace engine::renderer
\ No newline at end of file
+} // namespace engine::renderer
@@ -0,0 +1,108 @@
+#include "vulkan_static_batch.hpp"
+#include <engine/core/assert.hpp>
+
+namespace engine::renderer {
+VulkanStaticBatchCache::VulkanStaticBatchCache(VulkanRenderer *renderer) : m_renderer{ renderer } {}
+
+VulkanStaticBatchCache::~VulkanStaticBatchCache()
+{
+  for (Batch &batch : m_batches) { release(batch); }
+}
+
+size_t VulkanStaticBatchCache::addBatch(StaticBatchDesc desc)
+{
+  core::assertion(bool(desc.record), "Static batch {} has nothing to record", desc.name);
+
+  size_t batchId = m_batches.size();
+  if (!m_freeIds.empty()) {
+    batchId = m_freeIds.front();
+    m_freeIds.pop();
+  } else {
+    m_batches.emplace_back();
+  }
+
+  m_batches[batchId].desc = std::move(desc);
+  return batchId;
+}
+
+void VulkanStaticBatchCache::removeBatch(size_t batchId)
+{
+  release(m_batches[batchId]);
+  m_batches[batchId] = {};
+  m_freeIds.push(batchId);
+}
+
+void VulkanStaticBatchCache::invalidate(size_t batchId)
+{
+  release(m_batches[batchId]);
+}
+
+void VulkanStaticBatchCache::invalidateAll()
+{
+  for (Batch &batch : m_batches) { release(batch); }
+}
+
+void VulkanStaticBatchCache::execute(vk::CommandBuffer commandBuffer, std::span<const size_t> batchIds)
+{
+  m_executed.clear();
+  for (size_t batchId : batchIds) {
+    Batch &batch = m_batches[batchId];
+    core::assertion(bool(batch.desc.record), "Static batch {} was removed", batchId);
+
+    if (isStale(batch)) { record(batch); }
+    m_executed.push_back(batch.commandBuffer);
+  }
+
+  if (!m_executed.empty()) { commandBuffer.executeCommands(m_executed); }
+}
+
+bool VulkanStaticBatchCache::isStale(const Batch &batch) const
+{
+  if (!batch.commandBuffer) { return true; }
+  if (batch.extent != m_renderer->getBackbufferExtent()) { return true; }
+  if (batch.isProvisional && m_renderer->getPendingCompileCount() == 0) { return true; }
+
+  for (size_t i = 0; i < batch.desc.buffers.size(); i++) {
+    if (m_renderer->getBufferGeneration(batch.desc.buffers[i]) != batch.bufferGenerations[i]) { return true; }
+  }
+  return false;
+}
+
+void VulkanStaticBatchCache::record(Batch &batch)
+{
+  // The old recording may still be executing in frames in flight, it can't be reset in place
+  release(batch);
+
+  VulkanDevice *device = m_renderer->getDevice();
+  vk::CommandBufferAllocateInfo allocInfo = {
+    .commandPool = device->getCommandPool(),
+    .level = vk::CommandBufferLevel::eSecondary,
+    .commandBufferCount = 1,
+  };
+  batch.commandBuffer = device->getDevice().allocateCommandBuffers(allocInfo).value.front();
+
+  // Checked on both sides, the callback itself may queue compiles
+  batch.isProvisional = m_renderer->getPendingCompileCount() > 0;
+  m_renderer->beginSecondaryRendering(batch.commandBuffer);
+  batch.desc.record(batch.commandBuffer);
+  m_renderer->endSecondaryRendering(batch.commandBuffer);
+  batch.isProvisional = batch.isProvisional || m_renderer->getPendingCompileCount() > 0;
+
+  batch.bufferGenerations.clear();
+  for (size_t bufferId : batch.desc.buffers) {
+    batch.bufferGenerations.push_back(m_renderer->getBufferGeneration(bufferId));
+  }
+  batch.extent = m_renderer->getBackbufferExtent();
+  m_recordCount++;
+}
+
+void VulkanStaticBatchCache::release(Batch &batch)
+{
+  if (!batch.commandBuffer) { return; }
+
+  m_renderer->deferDeletion([device = m_renderer->getDevice(), commandBuffer = batch.commandBuffer] {
+    device->getDevice().freeCommandBuffers(device->getCommandPool(), commandBuffer);
+  });
+  batch.commandBuffer = nullptr;
+}
+}// namespace engine::renderer
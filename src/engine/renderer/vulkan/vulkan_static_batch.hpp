@@ -0,0 +1,81 @@
+#pragma once
+
+#include <engine/renderer/vulkan_renderer.hpp>
+#include <functional>
+#include <queue>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace engine::renderer {
+struct StaticBatchDesc
+{
+  using RecordCallback = std::function<void(vk::CommandBuffer commandBuffer)>;
+
+  std::string name = ""; // For debugging
+  // Binds programs and buffers and draws, with the renderer's bind and draw functions. Whatever changes per frame
+  // (camera, transforms, visibility) has to be read from buffer contents or bindless slots, push constants and
+  // descriptor sets are baked into the recording.
+  RecordCallback record;
+  // Buffers whose handles the recording bakes in: vertex, index and indirect argument buffers
+  std::vector<size_t> buffers;
+};
+
+// Draws that don't change from frame to frame (level geometry, GPU driven batches with fixed draw and count buffers)
+// are recorded once into a secondary command buffer and only executed afterwards, the per-frame CPU cost no longer
+// depends on the number of draws.
+//
+// A batch is recorded again on its next execution when it went stale:
+//   one of its buffers was destroyed, replaced or moved by defragmentation (see getBufferGeneration),
+//   the backbuffer was resized,
+//   it was recorded while programs or pipelines were still compiling, so it may draw with fallbacks or skip draws.
+//   It waits for the background compiler to be idle.
+// Replaced recordings are freed once the frames executing them are done. Anything else the callback depends on has
+// to be reported with invalidate().
+class VulkanStaticBatchCache
+{
+public:
+  // Destroyed before the renderer
+  explicit VulkanStaticBatchCache(VulkanRenderer *renderer);
+  ~VulkanStaticBatchCache();
+
+  VulkanStaticBatchCache(const VulkanStaticBatchCache &) = delete;
+  VulkanStaticBatchCache &operator=(const VulkanStaticBatchCache &) = delete;
+
+  // Recorded on first execution
+  [[nodiscard]] size_t addBatch(StaticBatchDesc desc);
+  void removeBatch(size_t batchId);
+  void invalidate(size_t batchId);
+  void invalidateAll();
+
+  // Inside beginRendering with RenderingContents::SecondaryCommandBuffers, records the stale batches first. The pass
+  // declares the batches' reads (e.g. indirect arguments) like for inline draws.
+  void execute(vk::CommandBuffer commandBuffer, std::span<const size_t> batchIds);
+
+  // Recordings made since the cache was created, stays flat while nothing changes
+  inline size_t getRecordCount() const noexcept { return m_recordCount; }
+
+private:
+  struct Batch
+  {
+    StaticBatchDesc desc;
+    vk::CommandBuffer commandBuffer;
+    // What the recording was made against
+    std::vector<uint64_t> bufferGenerations;
+    vk::Extent2D extent;
+    bool isProvisional = false;
+  };
+
+  bool isStale(const Batch &batch) const;
+  void record(Batch &batch);
+  void release(Batch &batch);
+
+private:
+  VulkanRenderer *m_renderer;
+
+  std::vector<Batch> m_batches;
+  std::queue<size_t> m_freeIds;
+  std::vector<vk::CommandBuffer> m_executed;
+  size_t m_recordCount = 0;
+};
+}// namespace engine::renderer
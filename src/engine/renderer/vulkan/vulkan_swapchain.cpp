@@ -1,9 +1,30 @@
 #include "vulkan_swapchain.hpp"
+#include <algorithm>
 #include <engine/core/logger.hpp>
+#include <engine/core/timer.hpp>
 
 namespace engine::renderer {
-VulkanSwapchain::VulkanSwapchain(VulkanDevice *device, vk::Extent2D extent)
-  : m_device{ device }, m_windowExtent{ extent }
+SwapchainPolicy SwapchainPolicy::fromProfile(SwapchainProfile profile)
+{
+  switch (profile) {
+  case SwapchainProfile::LowLatency:
+    return { .framesInFlight = 1,
+      .presentModes = { vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eFifo },
+      .extraImages = 0 };
+  case SwapchainProfile::Throughput:
+    return { .framesInFlight = 3, .presentModes = { vk::PresentModeKHR::eMailbox }, .extraImages = 1 };
+  case SwapchainProfile::PowerSaving:
+    return { .framesInFlight = 2, .presentModes = { vk::PresentModeKHR::eFifo }, .extraImages = 0 };
+  }
+
+  return {};
+}
+
+VulkanSwapchain::VulkanSwapchain(VulkanDevice *device,
+  vk::Extent2D extent,
+  const SwapchainPolicy &policy,
+  VulkanTimeline *frameTimeline)
+  : m_policy{ policy }, m_device{ device }, m_windowExtent{ extent }, m_frameTimeline{ frameTimeline }
 {
   init();
   core::Logger::info("Vulkan swapchain created");
@@ -11,8 +32,11 @@ VulkanSwapchain::VulkanSwapchain(VulkanDevice *device, vk::Extent2D extent)
 
 VulkanSwapchain::VulkanSwapchain(VulkanDevice *device,
   vk::Extent2D extent,
+  const SwapchainPolicy &policy,
+  VulkanTimeline *frameTimeline,
   std::shared_ptr<VulkanSwapchain> previousSwapChain)
-  : m_device{ device }, m_windowExtent{ extent }, m_oldSwapChain{ previousSwapChain }
+  : m_policy{ policy }, m_device{ device }, m_windowExtent{ extent }, m_oldSwapChain{ previousSwapChain },
+    m_frameTimeline{ frameTimeline }
 {
   init();
   m_oldSwapChain = nullptr;
@@ -21,10 +45,19 @@ VulkanSwapchain::VulkanSwapchain(VulkanDevice *device,
 
 void VulkanSwapchain::init()
 {
-  createSwapChain();
+  m_framesInFlight = std::clamp<uint32_t>(m_policy.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
+  if (m_device->isHeadless()) {
+    createOffscreenImages();
+  } else {
+    createSwapChain();
+  }
   createImageViews();
   createDepthResources();
-  createSyncObjects();
+  if (m_oldSwapChain) {
+    adoptSyncObjects(*m_oldSwapChain);
+  } else {
+    createSyncObjects();
+  }
 }
 
 VulkanSwapchain::~VulkanSwapchain()
@@ -37,16 +70,19 @@ VulkanSwapchain::~VulkanSwapchain()
     m_swapChain = nullptr;
   }
 
+  for (size_t i = 0; i < m_offscreenImageMemorys.size(); i++) {
+    vmaDestroyImage(m_device->getAllocator(), m_swapChainImages[i], m_offscreenImageMemorys[i]);
+  }
+
   for (size_t i = 0; i < m_depthImages.size(); i++) {
     m_device->getDevice().destroyImageView(m_depthImageViews[i]);
     vmaDestroyImage(m_device->getAllocator(), m_depthImages[i], m_depthImageMemorys[i]);
   }
 
-  // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  // cleanup synchronization objects, empty when a newer swapchain took them over
+  for (size_t i = 0; i < m_imageAvailableSemaphores.size(); i++) {
     m_device->getDevice().destroySemaphore(m_renderFinishedSemaphores[i]);
     m_device->getDevice().destroySemaphore(m_imageAvailableSemaphores[i]);
-    m_device->getDevice().destroyFence(m_inFlightFences[i]);
   }
 
   core::Logger::info("Vulkan swapchain destroyed");
@@ -54,60 +90,111 @@ VulkanSwapchain::~VulkanSwapchain()
 
 vk::Result VulkanSwapchain::acquireNextImage(uint32_t *imageIndex)
 {
-  m_device->getDevice().waitForFences(
-    { m_inFlightFences[m_currentFrame] }, vk::True, std::numeric_limits<uint64_t>::max());
+  m_frameTimings.frameWait = m_frameTimeline->wait(m_frameValues[m_currentFrame]);
 
+  if (isOffscreen()) {
+    // The image belongs to the frame slot, the wait above covers it
+    *imageIndex = static_cast<uint32_t>(m_currentFrame);
+    m_frameTimings.acquireWait = 0.0f;
+    return vk::Result::eSuccess;
+  }
+
+  core::Timer timer;
   auto result = vkAcquireNextImageKHR(m_device->getDevice(),
     m_swapChain,
     std::numeric_limits<uint64_t>::max(),
     m_imageAvailableSemaphores[m_currentFrame],
     VK_NULL_HANDLE,
     imageIndex);
+  m_frameTimings.acquireWait = timer.getDeltaTime();
 
   return vk::Result(result);
 }
 
-vk::Result VulkanSwapchain::submitCommandBuffers(const vk::CommandBuffer *buffers, uint32_t *imageIndex)
+vk::Result VulkanSwapchain::submitCommandBuffers(const vk::CommandBuffer *buffers,
+  uint32_t *imageIndex,
+  std::span<const vk::SemaphoreSubmitInfo> waitSemaphores,
+  std::span<const vk::SemaphoreSubmitInfo> signalSemaphores)
 {
-  if (m_imagesInFlight[*imageIndex] != nullptr) {
-    m_device->getDevice().waitForFences(m_imagesInFlight[*imageIndex], vk::True, std::numeric_limits<uint64_t>::max());
-  }
-  m_imagesInFlight[*imageIndex] = m_inFlightFences[m_currentFrame];
+  const FrameSubmission submission = prepareSubmission(*buffers, *imageIndex, waitSemaphores, signalSemaphores);
+  auto [result, presentWait] = execute(submission);
+  m_frameTimings.presentWait = presentWait;
+  return result;
+}
 
-  vk::SubmitInfo submitInfo = {};
+FrameSubmission VulkanSwapchain::prepareSubmission(vk::CommandBuffer commandBuffer,
+  uint32_t imageIndex,
+  std::span<const vk::SemaphoreSubmitInfo> waitSemaphores,
+  std::span<const vk::SemaphoreSubmitInfo> signalSemaphores)
+{
+  // An image acquired again before the frame that last rendered to it (from another slot) has finished, usually a no-op
+  m_frameTimeline->wait(m_imageValues[imageIndex]);
+  const uint64_t frameValue = m_frameTimeline->advance();
+  m_frameValues[m_currentFrame] = frameValue;
+  m_imageValues[imageIndex] = frameValue;
+
+  FrameSubmission submission = {
+    .swapChain = this,
+    .commandBuffer = commandBuffer,
+    .imageIndex = imageIndex,
+  };
+  if (!isOffscreen()) {
+    submission.waitSemaphores.push_back({ .semaphore = m_imageAvailableSemaphores[m_currentFrame],
+      .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput });
+    submission.signalSemaphores.push_back({ .semaphore = m_renderFinishedSemaphores[m_currentFrame],
+      .stageMask = vk::PipelineStageFlagBits2::eAllCommands });
+    submission.renderFinished = m_renderFinishedSemaphores[m_currentFrame];
+  }
+  submission.signalSemaphores.push_back(
+    m_frameTimeline->getSignalInfo(frameValue, vk::PipelineStageFlagBits2::eAllCommands));
+  submission.waitSemaphores.insert(submission.waitSemaphores.end(), waitSemaphores.begin(), waitSemaphores.end());
+  submission.signalSemaphores.insert(
+    submission.signalSemaphores.end(), signalSemaphores.begin(), signalSemaphores.end());
+
+  m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+  return submission;
+}
 
-  vk::Semaphore waitSemaphores[] = { m_imageAvailableSemaphores[m_currentFrame] };
-  vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
+std::pair<vk::Result, float> VulkanSwapchain::execute(const FrameSubmission &submission)
+{
+  vk::CommandBufferSubmitInfo commandBufferInfo = {
+    .commandBuffer = submission.commandBuffer,
+  };
 
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = buffers;
+  vk::SubmitInfo2 submitInfo = {
+    .waitSemaphoreInfoCount = static_cast<uint32_t>(submission.waitSemaphores.size()),
+    .pWaitSemaphoreInfos = submission.waitSemaphores.data(),
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &commandBufferInfo,
+    .signalSemaphoreInfoCount = static_cast<uint32_t>(submission.signalSemaphores.size()),
+    .pSignalSemaphoreInfos = submission.signalSemaphores.data(),
+  };
 
-  auto signalSemaphores = std::to_array({ m_renderFinishedSemaphores[m_currentFrame] });
-  submitInfo.signalSemaphoreCount = signalSemaphores.size();
-  submitInfo.pSignalSemaphores = signalSemaphores.data();
+  {
+    auto lock = m_device->lockQueue(m_device->getGraphicsQueue());
+    m_device->getGraphicsQueue().submit2(submitInfo);
+  }
 
-  m_device->getDevice().resetFences(m_inFlightFences[m_currentFrame]);
+  if (isOffscreen()) { return { vk::Result::eSuccess, 0.0f }; }
 
-  m_device->getGraphicsQueue().submit(submitInfo, m_inFlightFences[m_currentFrame]);
+  auto presentSemaphores = std::to_array({ submission.renderFinished });
 
   vk::PresentInfoKHR presentInfo = {};
-  presentInfo.waitSemaphoreCount = signalSemaphores.size();
-  presentInfo.pWaitSemaphores = signalSemaphores.data();
+  presentInfo.waitSemaphoreCount = presentSemaphores.size();
+  presentInfo.pWaitSemaphores = presentSemaphores.data();
 
   auto swapChains = std::to_array({ m_swapChain });
   presentInfo.swapchainCount = swapChains.size();
   presentInfo.pSwapchains = swapChains.data();
 
-  presentInfo.pImageIndices = imageIndex;
+  presentInfo.pImageIndices = &submission.imageIndex;
   VkPresentInfoKHR rawPresentInfo = presentInfo;
+  auto lock = m_device->lockQueue(m_device->getPresentQueue());
+  // Started once the queue is ours, waiting on submits from other threads isn't presentation time
+  core::Timer timer;
   auto result = vkQueuePresentKHR(m_device->getPresentQueue(), &rawPresentInfo);
 
-  m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
-  return vk::Result(result);
+  return { vk::Result(result), timer.getDeltaTime() };
 }
 
 void VulkanSwapchain::createSwapChain()
@@ -118,7 +205,9 @@ void VulkanSwapchain::createSwapChain()
   vk::PresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   vk::Extent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // Fewer images than frames in flight would make acquire block on presentation instead of the frame timeline
+  uint32_t imageCount =
+    std::max(swapChainSupport.capabilities.minImageCount + m_policy.extraImages, m_framesInFlight);
   if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
   }
@@ -131,6 +220,10 @@ void VulkanSwapchain::createSwapChain()
   createInfo.imageExtent = extent;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
+  // Lets the backbuffer be read back (screenshots, image comparisons) where the surface allows it
+  if (swapChainSupport.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc) {
+    createInfo.imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+  }
 
   QueueFamilyIndices indices = m_device->findQueueFamilies();
   uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -155,19 +248,51 @@ void VulkanSwapchain::createSwapChain()
 
   m_swapChain = m_device->getDevice().createSwapchainKHR(createInfo).value;
 
-  // we only specified a minimum number of images in the swap chain, so the
-  // implementation is allowed to create a swap chain with more. That's why
-  // we'll first query the final number of images with vkGetSwapchainImagesKHR,
-  // then resize the container and finally call it again to retrieve the
-  // handles.
-  uint32_t swapChainImagesCount;
+  // Only a minimum number of images was asked for, the implementation is allowed to create more
   m_swapChainImages = m_device->getDevice().getSwapchainImagesKHR(m_swapChain).value;
 
+  m_presentMode = presentMode;
   m_swapChainImageFormat = surfaceFormat.format;
+  m_swapChainImageUsage = createInfo.imageUsage;
   m_swapChainExtent = extent;
   m_aspectRatio = static_cast<float>(m_swapChainExtent.width) / static_cast<float>(m_swapChainExtent.height);
 }
 
+void VulkanSwapchain::createOffscreenImages()
+{
+  // Same format a surface would most likely get, so pipelines built against it don't depend on the mode
+  m_swapChainImageFormat = vk::Format::eB8G8R8A8Unorm;
+  m_swapChainImageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+  m_swapChainExtent = m_windowExtent;
+  m_aspectRatio = static_cast<float>(m_swapChainExtent.width) / static_cast<float>(m_swapChainExtent.height);
+  m_presentMode = vk::PresentModeKHR::eImmediate;
+  core::Logger::info("Offscreen rendering at {}x{}, {} frames in flight",
+    m_swapChainExtent.width,
+    m_swapChainExtent.height,
+    m_framesInFlight);
+
+  m_swapChainImages.resize(m_framesInFlight);
+  m_offscreenImageMemorys.resize(m_framesInFlight);
+  for (size_t i = 0; i < m_swapChainImages.size(); i++) {
+    vk::ImageCreateInfo imageInfo = {
+      .imageType = vk::ImageType::e2D,
+      .format = m_swapChainImageFormat,
+      .extent = { .width = m_swapChainExtent.width, .height = m_swapChainExtent.height, .depth = 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = m_swapChainImageUsage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .queueFamilyIndexCount = 0,
+      .pQueueFamilyIndices = nullptr,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    };
+
+    m_device->createImageWithInfo(imageInfo, VMA_MEMORY_USAGE_AUTO, m_swapChainImages[i], m_offscreenImageMemorys[i]);
+  }
+}
+
 void VulkanSwapchain::createImageViews()
 {
   m_swapChainImageViews.resize(m_swapChainImages.size());
@@ -192,9 +317,17 @@ void VulkanSwapchain::createDepthResources()
   m_swapChainDepthFormat = depthFormat;
   vk::Extent2D swapChainExtent = getSwapChainExtent();
 
-  m_depthImages.resize(imageCount());
-  m_depthImageMemorys.resize(imageCount());
-  m_depthImageViews.resize(imageCount());
+  // Depth is cleared at the start of every frame and never read afterwards, so it only has to exist once per frame
+  // in flight rather than per swapchain image. Where the device has lazily allocated memory the attachment may never
+  // leave tile memory at all.
+  const bool lazilyAllocated = !m_policy.sampledDepth && m_device->supportsLazilyAllocatedMemory();
+  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+  if (lazilyAllocated) { usage |= vk::ImageUsageFlagBits::eTransientAttachment; }
+  if (m_policy.sampledDepth) { usage |= vk::ImageUsageFlagBits::eSampled; }
+
+  m_depthImages.resize(m_framesInFlight);
+  m_depthImageMemorys.resize(m_framesInFlight);
+  m_depthImageViews.resize(m_framesInFlight);
 
   for (size_t i = 0; i < m_depthImages.size(); i++) {
     vk::ImageCreateInfo imageInfo = {
@@ -205,14 +338,17 @@ void VulkanSwapchain::createDepthResources()
       .arrayLayers = 1,
       .samples = vk::SampleCountFlagBits::e1,
       .tiling = vk::ImageTiling::eOptimal,
-      .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+      .usage = usage,
       .sharingMode = vk::SharingMode::eExclusive,
       .queueFamilyIndexCount = 0,
       .pQueueFamilyIndices = nullptr,
       .initialLayout = vk::ImageLayout::eUndefined,
     };
 
-    m_device->createImageWithInfo(imageInfo, VMA_MEMORY_USAGE_AUTO, m_depthImages[i], m_depthImageMemorys[i]);
+    m_device->createImageWithInfo(imageInfo,
+      lazilyAllocated ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_AUTO,
+      m_depthImages[i],
+      m_depthImageMemorys[i]);
 
     vk::ImageViewCreateInfo viewInfo = { .image = m_depthImages[i],
       .viewType = vk::ImageViewType::e2D,
@@ -232,22 +368,32 @@ void VulkanSwapchain::createSyncObjects()
 {
   m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
   m_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  m_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  m_imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+  // 0 is always reached, slots and images that never submitted don't wait
+  m_imageValues.resize(imageCount(), 0);
 
   vk::SemaphoreCreateInfo semaphoreInfo = {};
 
-  vk::FenceCreateInfo fenceInfo = {
-    .flags = vk::FenceCreateFlagBits::eSignaled,
-  };
-
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     m_imageAvailableSemaphores[i] = m_device->getDevice().createSemaphore(semaphoreInfo).value;
     m_renderFinishedSemaphores[i] = m_device->getDevice().createSemaphore(semaphoreInfo).value;
-    m_inFlightFences[i] = m_device->getDevice().createFence(fenceInfo).value;
   }
 }
 
+void VulkanSwapchain::adoptSyncObjects(VulkanSwapchain &previous)
+{
+  m_imageAvailableSemaphores = std::move(previous.m_imageAvailableSemaphores);
+  m_renderFinishedSemaphores = std::move(previous.m_renderFinishedSemaphores);
+  previous.m_imageAvailableSemaphores.clear();
+  previous.m_renderFinishedSemaphores.clear();
+  m_frameValues = previous.m_frameValues;
+  // The new images have never been rendered to
+  m_imageValues.resize(imageCount(), 0);
+
+  // Slots beyond a smaller frame count aren't waited on again until they come back into use, their values stay
+  // meaningful on the timeline until then
+  m_currentFrame = previous.m_currentFrame % m_framesInFlight;
+}
+
 vk::SurfaceFormatKHR VulkanSwapchain::chooseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &availableFormats)
 {
   for (const auto &availableFormat : availableFormats) {
@@ -262,14 +408,14 @@ vk::SurfaceFormatKHR VulkanSwapchain::chooseSwapSurfaceFormat(const std::vector<
 
 vk::PresentModeKHR VulkanSwapchain::chooseSwapPresentMode(const std::vector<vk::PresentModeKHR> &availablePresentModes)
 {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
-      core::Logger::info("Present mode: Mailbox");
-      return availablePresentMode;
+  for (vk::PresentModeKHR preferredPresentMode : m_policy.presentModes) {
+    if (std::ranges::find(availablePresentModes, preferredPresentMode) != availablePresentModes.end()) {
+      core::Logger::info("Present mode: {}, {} frames in flight", vk::to_string(preferredPresentMode), m_framesInFlight);
+      return preferredPresentMode;
     }
   }
 
-  core::Logger::info("Present mode: V-Sync");
+  core::Logger::info("Present mode: V-Sync, {} frames in flight", m_framesInFlight);
   return vk::PresentModeKHR::eFifo;
 }
 
@@ -1,35 +1,127 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
 #include <memory>
+#include <span>
+#include <utility>
+#include <vector>
 
 namespace engine {
 namespace renderer {
 
+enum class SwapchainProfile {
+  // One frame in flight, presents as soon as possible (immediate, or FIFO where tearing isn't available)
+  LowLatency,
+  // Three frames in flight and mailbox so the GPU never waits on the display
+  Throughput,
+  // FIFO with the fewest images, rendering is paced by the display's refresh rate
+  PowerSaving,
+};
+
+struct SwapchainPolicy {
+  uint32_t framesInFlight = 2;
+  // Most preferred first, FIFO is used when the surface supports none of them
+  std::vector<vk::PresentModeKHR> presentModes = {vk::PresentModeKHR::eMailbox};
+  // Images requested on top of the surface's minimum
+  uint32_t extraImages = 1;
+  // Depth buffers can be sampled by shaders (e.g. to build a depth pyramid), which rules out lazily allocated memory
+  bool sampledDepth = false;
+  // Submit and present on a dedicated thread so drivers blocking in present don't stall the frame loop, see
+  // VulkanPresentThread
+  bool presentThread = false;
+
+  static SwapchainPolicy fromProfile(SwapchainProfile profile);
+};
+
+// Time the CPU spent blocked in the last frame, in seconds
+struct SwapchainFrameTimings {
+  // For the frame slot's previous frame on the frame timeline
+  float frameWait = 0.0f;
+  float acquireWait = 0.0f;
+  // With the present thread, the time spent waiting for it to finish presenting before the next acquire
+  float presentWait = 0.0f;
+};
+
+class VulkanSwapchain;
+
+// A recorded frame ready for the graphics queue and the display, self-contained so another thread can execute it
+struct FrameSubmission {
+  VulkanSwapchain *swapChain = nullptr;
+  vk::CommandBuffer commandBuffer;
+  std::vector<vk::SemaphoreSubmitInfo> waitSemaphores;
+  std::vector<vk::SemaphoreSubmitInfo> signalSemaphores;
+  // Null when offscreen, nothing is presented
+  vk::Semaphore renderFinished;
+  uint32_t imageIndex = 0;
+};
+
+// On a headless device there is no surface to present to. The swapchain then owns one offscreen color image per frame
+// in flight instead, acquire only waits for the frame slot and submit doesn't present. The renderer's frame loop
+// stays the same, and the images can be read back after each frame.
 class VulkanSwapchain {
 public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+  // Upper bound for per-frame resources, the policy decides how many of them are used
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
 
-  VulkanSwapchain(VulkanDevice *device, vk::Extent2D windowExtent);
-  VulkanSwapchain(VulkanDevice *device, vk::Extent2D windowExtent, std::shared_ptr<VulkanSwapchain> previousSwapChain);
+  // Frames are paced on the frame timeline (the graphics queue's), every submission signals its next value. A frame
+  // slot is reused once the value of its previous frame is reached, no fences involved.
+  VulkanSwapchain(VulkanDevice *device, vk::Extent2D windowExtent, const SwapchainPolicy &policy,
+                  VulkanTimeline *frameTimeline);
+  // Takes over the previous swapchain's semaphores and frame values, along with its current frame slot, so frames
+  // still in flight on it keep being tracked. The previous swapchain is retired by the driver but its images may still
+  // be in use, it must be kept alive until the frame timeline reaches the last value submitted with it.
+  VulkanSwapchain(VulkanDevice *device, vk::Extent2D windowExtent, const SwapchainPolicy &policy,
+                  VulkanTimeline *frameTimeline, std::shared_ptr<VulkanSwapchain> previousSwapChain);
   ~VulkanSwapchain();
 
   inline vk::ImageView getImageView(size_t index) noexcept { return m_swapChainImageViews[index]; }
   inline vk::Image getImage(size_t index) noexcept { return m_swapChainImages[index]; }
-  inline vk::ImageView getDepthImageView(size_t index) noexcept { return m_depthImageViews[index]; }
-  inline vk::Image getDepthImage(size_t index) noexcept { return m_depthImages[index]; }
+  // Depth buffers are indexed by frame slot, not by swapchain image
+  inline vk::ImageView getDepthImageView(size_t frameIndex) noexcept { return m_depthImageViews[frameIndex]; }
+  inline vk::Image getDepthImage(size_t frameIndex) noexcept { return m_depthImages[frameIndex]; }
   inline size_t imageCount() noexcept { return m_swapChainImages.size(); }
   inline vk::Format getSwapChainImageFormat() noexcept { return m_swapChainImageFormat; }
+  inline vk::Format getSwapChainDepthFormat() noexcept { return m_swapChainDepthFormat; }
+  inline vk::ImageUsageFlags getImageUsage() const noexcept { return m_swapChainImageUsage; }
   inline vk::Extent2D getSwapChainExtent() noexcept { return m_swapChainExtent; }
   inline uint32_t width() noexcept { return m_swapChainExtent.width; }
   inline uint32_t height() noexcept { return m_swapChainExtent.height; }
 
   inline float extentAspectRatio() noexcept { return m_aspectRatio; }
+  inline uint32_t getFramesInFlight() const noexcept { return m_framesInFlight; }
+  inline vk::PresentModeKHR getPresentMode() const noexcept { return m_presentMode; }
+  inline const SwapchainFrameTimings &getFrameTimings() const noexcept { return m_frameTimings; }
+  // When frames are executed elsewhere, the time the frame loop waited for them
+  inline void setPresentWait(float seconds) noexcept { m_frameTimings.presentWait = seconds; }
+  inline size_t getCurrentFrameIndex() const noexcept { return m_currentFrame; }
+  inline bool isOffscreen() const noexcept { return m_swapChain == nullptr; }
+  // What the images are left in at the end of a frame, offscreen images are ready to be copied from
+  inline vk::ImageLayout getFinalLayout() const noexcept {
+    return isOffscreen() ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+  }
+  // Whether the last submission made from the given frame slot has finished executing
+  bool isFrameComplete(size_t frameIndex) const { return m_frameTimeline->isReached(m_frameValues[frameIndex]); }
   vk::Format findDepthFormat();
 
   vk::Result acquireNextImage(uint32_t *imageIndex);
-  vk::Result submitCommandBuffers(const vk::CommandBuffer *buffers, uint32_t *imageIndex);
+  // Signals the next value of the frame timeline. The extra semaphores are waited on and signaled on top of the acquire
+  // and present semaphores, e.g. the async compute timeline.
+  vk::Result submitCommandBuffers(const vk::CommandBuffer *buffers, uint32_t *imageIndex,
+                                  std::span<const vk::SemaphoreSubmitInfo> waitSemaphores = {},
+                                  std::span<const vk::SemaphoreSubmitInfo> signalSemaphores = {});
+  // submitCommandBuffers in two halves. Preparing reserves the frame's timeline value and moves on to the next frame
+  // slot, it stays on the frame loop's thread. Executing submits and presents and may run on another thread, frames
+  // have to be executed in the order they were prepared. Waiting on the frame timeline for a prepared frame is fine,
+  // the wait just lasts until it has been executed and has finished. The swapchain is externally synchronized, the
+  // next acquire (or recreation) has to wait until the prepared frames are executed.
+  FrameSubmission prepareSubmission(vk::CommandBuffer commandBuffer, uint32_t imageIndex,
+                                    std::span<const vk::SemaphoreSubmitInfo> waitSemaphores = {},
+                                    std::span<const vk::SemaphoreSubmitInfo> signalSemaphores = {});
+  // Returns the present result and the time present blocked, in seconds
+  std::pair<vk::Result, float> execute(const FrameSubmission &submission);
 
   inline bool compareSwapFormats(const VulkanSwapchain &other) const noexcept {
     return other.m_swapChainDepthFormat == m_swapChainDepthFormat &&
@@ -39,16 +131,24 @@ public:
 private:
   void init();
   void createSwapChain();
+  void createOffscreenImages();
   void createImageViews();
   void createDepthResources();
   void createSyncObjects();
+  void adoptSyncObjects(VulkanSwapchain &previous);
 
   vk::SurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &availableFormats);
   vk::PresentModeKHR chooseSwapPresentMode(const std::vector<vk::PresentModeKHR> &availablePresentModes);
   vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR &capabilities);
 
+  SwapchainPolicy m_policy;
+  uint32_t m_framesInFlight;
+  vk::PresentModeKHR m_presentMode;
+  SwapchainFrameTimings m_frameTimings;
+
   vk::Format m_swapChainImageFormat;
   vk::Format m_swapChainDepthFormat;
+  vk::ImageUsageFlags m_swapChainImageUsage;
   vk::Extent2D m_swapChainExtent;
   float m_aspectRatio = 0.0f;
 
@@ -57,6 +157,8 @@ private:
   std::vector<vk::ImageView> m_depthImageViews;
   std::vector<vk::Image> m_swapChainImages;
   std::vector<vk::ImageView> m_swapChainImageViews;
+  // Only for offscreen images, swapchain images belong to the swapchain
+  std::vector<VmaAllocation> m_offscreenImageMemorys;
 
   VulkanDevice *m_device;
   vk::Extent2D m_windowExtent;
@@ -64,10 +166,12 @@ private:
   vk::SwapchainKHR m_swapChain;
   std::shared_ptr<VulkanSwapchain> m_oldSwapChain;
 
+  VulkanTimeline *m_frameTimeline;
   std::vector<vk::Semaphore> m_imageAvailableSemaphores;
   std::vector<vk::Semaphore> m_renderFinishedSemaphores;
-  std::vector<vk::Fence> m_inFlightFences;
-  std::vector<vk::Fence> m_imagesInFlight;
+  // Frame timeline value of the last submission from each frame slot, and of the last one rendering to each image
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> m_frameValues = {};
+  std::vector<uint64_t> m_imageValues;
   size_t m_currentFrame = 0;
 };
 } // namespace renderer
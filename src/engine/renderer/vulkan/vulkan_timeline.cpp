@@ -0,0 +1,53 @@
+#include "vulkan_timeline.hpp"
+#include <algorithm>
+#include <engine/core/timer.hpp>
+#include <limits>
+
+namespace engine::renderer {
+VulkanTimeline::VulkanTimeline(VulkanDevice *device) : m_device{ device }
+{
+  m_semaphore = m_device->createTimelineSemaphore();
+}
+
+VulkanTimeline::~VulkanTimeline()
+{
+  wait(m_lastSubmittedValue);
+  m_device->getDevice().destroySemaphore(m_semaphore);
+}
+
+vk::SemaphoreSubmitInfo VulkanTimeline::getSignalInfo(uint64_t value, vk::PipelineStageFlags2 stages) const
+{
+  return { .semaphore = m_semaphore, .value = value, .stageMask = stages };
+}
+
+vk::SemaphoreSubmitInfo VulkanTimeline::getWaitInfo(uint64_t value, vk::PipelineStageFlags2 stages) const
+{
+  return { .semaphore = m_semaphore, .value = value, .stageMask = stages };
+}
+
+uint64_t VulkanTimeline::getCompletedValue() const
+{
+  m_completedValue = m_device->getDevice().getSemaphoreCounterValue(m_semaphore).value;
+  return m_completedValue;
+}
+
+bool VulkanTimeline::isReached(uint64_t value) const
+{
+  return value <= m_completedValue || value <= getCompletedValue();
+}
+
+float VulkanTimeline::wait(uint64_t value) const
+{
+  if (isReached(value)) { return 0.0f; }
+
+  core::Timer timer;
+  vk::SemaphoreWaitInfo waitInfo = {
+    .semaphoreCount = 1,
+    .pSemaphores = &m_semaphore,
+    .pValues = &value,
+  };
+  m_device->getDevice().waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max());
+  m_completedValue = std::max(m_completedValue, value);
+  return timer.getDeltaTime();
+}
+}// namespace engine::renderer
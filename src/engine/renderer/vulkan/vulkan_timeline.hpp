@@ -0,0 +1,45 @@
+#pragma once
+
+#include <engine/renderer/vulkan/vulkan_device.hpp>
+
+namespace engine::renderer {
+// The clock of one queue: a timeline semaphore every submission to the queue signals with the next value of a
+// monotonically increasing counter. Other queues wait on a value, the CPU polls or waits on it, and whatever has to
+// outlive the GPU's use of it (frame slots, deletion queues, readbacks) only remembers the value of the last
+// submission using it.
+class VulkanTimeline
+{
+public:
+  VulkanTimeline(VulkanDevice *device);
+  // Waits for everything submitted
+  ~VulkanTimeline();
+
+  VulkanTimeline(const VulkanTimeline &) = delete;
+  VulkanTimeline &operator=(const VulkanTimeline &) = delete;
+
+  // Reserves the value of the next submission, which has to signal it with getSignalInfo
+  uint64_t advance() noexcept { return ++m_lastSubmittedValue; }
+  vk::SemaphoreSubmitInfo getSignalInfo(uint64_t value, vk::PipelineStageFlags2 stages) const;
+  // What a submission (on any queue) waits on for the work that signaled value, at the stages consuming it
+  vk::SemaphoreSubmitInfo getWaitInfo(uint64_t value, vk::PipelineStageFlags2 stages) const;
+
+  // 0 before the first submission, which is also always reached
+  inline uint64_t getLastSubmittedValue() const noexcept { return m_lastSubmittedValue; }
+  // What the submission being prepared will signal
+  inline uint64_t getNextValue() const noexcept { return m_lastSubmittedValue + 1; }
+
+  uint64_t getCompletedValue() const;
+  // Only queries the semaphore when the value last seen completed is too small
+  bool isReached(uint64_t value) const;
+  // Returns the time spent blocked, in seconds
+  float wait(uint64_t value) const;
+
+  inline vk::Semaphore getSemaphore() const noexcept { return m_semaphore; }
+
+private:
+  VulkanDevice *m_device;
+  vk::Semaphore m_semaphore;
+  uint64_t m_lastSubmittedValue = 0;
+  mutable uint64_t m_completedValue = 0;
+};
+}// namespace engine::renderer
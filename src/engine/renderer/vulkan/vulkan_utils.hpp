@@ -2,6 +2,8 @@
 
 #include <engine/core/exception.hpp>
 #include <engine/renderer/descriptors/pipeline_descriptors.hpp>
+#include <functional>
+#include <span>
 #include <vulkan/vulkan.hpp>
 
 
@@ -14,6 +16,84 @@ inline void checkVkResult(VkResult result)
   }
 }
 
+template<typename T> inline void hashCombine(size_t &seed, const T &value)
+{
+  seed ^= std::hash<T>{}(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+// FNV-1a, stable across runs so it can key on-disk caches
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL)
+{
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    seed ^= bytes[i];
+    seed *= 0x100000001b3ULL;
+  }
+  return seed;
+}
+
+// One side of a buffer dependency
+struct BufferAccess
+{
+  vk::PipelineStageFlags2 stages;
+  vk::AccessFlags2 access;
+
+  static constexpr BufferAccess computeRead()
+  {
+    return { vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead };
+  }
+  static constexpr BufferAccess computeWrite()
+  {
+    return { vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite };
+  }
+  static constexpr BufferAccess computeReadWrite()
+  {
+    return { vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite };
+  }
+  static constexpr BufferAccess indirectRead()
+  {
+    return { vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead };
+  }
+  static constexpr BufferAccess vertexShaderRead()
+  {
+    return { vk::PipelineStageFlagBits2::eVertexShader, vk::AccessFlagBits2::eShaderStorageRead };
+  }
+  static constexpr BufferAccess transferWrite()
+  {
+    return { vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite };
+  }
+  static constexpr BufferAccess hostRead() { return { vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead }; }
+};
+
+inline vk::BufferMemoryBarrier2 createBufferBarrier(vk::Buffer buffer,
+  BufferAccess src,
+  BufferAccess dst,
+  vk::DeviceSize offset = 0,
+  vk::DeviceSize size = vk::WholeSize)
+{
+  return { .srcStageMask = src.stages,
+    .srcAccessMask = src.access,
+    .dstStageMask = dst.stages,
+    .dstAccessMask = dst.access,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .buffer = buffer,
+    .offset = offset,
+    .size = size };
+}
+
+// Records all barriers in a single vkCmdPipelineBarrier2
+inline void recordBufferBarriers(vk::CommandBuffer commandBuffer, std::span<const vk::BufferMemoryBarrier2> barriers)
+{
+  if (barriers.empty()) { return; }
+  vk::DependencyInfo dependencyInfo = {
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+    .pBufferMemoryBarriers = barriers.data(),
+  };
+  commandBuffer.pipelineBarrier2(dependencyInfo);
+}
+
 class VulkanUtils
 {
 public:
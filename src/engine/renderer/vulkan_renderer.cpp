@@ -11,32 +11,62 @@
 #include <memory>
 
 namespace engine::renderer {
-VulkanRenderer::VulkanRenderer(SDL_Window *window) : m_window{ window }
+VulkanRenderer::VulkanRenderer(SDL_Window *window) : VulkanRenderer(window, {}) {}
+
+VulkanRenderer::VulkanRenderer(vk::Extent2D offscreenExtent) : VulkanRenderer(nullptr, offscreenExtent) {}
+
+VulkanRenderer::VulkanRenderer(SDL_Window *window, vk::Extent2D offscreenExtent)
+  : m_window{ window }, m_offscreenExtent{ offscreenExtent }
 {
   m_device = std::make_unique<VulkanDevice>(m_window);
   m_shaderManager = new VulkanShaderManager(m_device.get());
+  m_graphicsTimeline = std::make_unique<VulkanTimeline>(m_device.get());
   recreateSwapChain();
-  m_pipelineManager = new VulkanPipelineManager(m_device.get(), m_shaderManager, m_swapChain.get());
-  m_bufferManager = std::make_unique<VulkanBufferManager>(m_device.get());
-  m_shaderProgramManager = std::make_unique<VulkanShaderProgramManager>(m_device.get());
+  m_bindlessHeap = std::make_unique<VulkanBindlessHeap>(m_device.get(), m_graphicsTimeline.get());
+  m_asyncCompute = std::make_unique<VulkanAsyncCompute>(m_device.get());
+  m_bufferManager = std::make_unique<VulkanBufferManager>(
+    m_device.get(), m_bindlessHeap.get(), m_graphicsTimeline.get(), &m_deletionQueue);
+  m_imageManager = std::make_unique<VulkanImageManager>(
+    m_device.get(), m_bufferManager.get(), m_bindlessHeap.get(), m_graphicsTimeline.get(), &m_deletionQueue);
+  m_asyncCompiler = std::make_unique<VulkanAsyncCompiler>();
+  m_shaderProgramManager = std::make_unique<VulkanShaderProgramManager>(m_device.get(), m_asyncCompiler.get());
+  m_prewarmList = std::make_unique<VulkanPrewarmList>();
+  m_descriptorSetLayoutCache = std::make_unique<VulkanDescriptorSetLayoutCache>(m_device.get());
+  m_pipelineLayoutCache = std::make_unique<VulkanPipelineLayoutCache>(
+    m_device.get(), m_bindlessHeap.get(), m_descriptorSetLayoutCache.get());
+  m_pipelineManager = new VulkanPipelineManager(
+    m_device.get(), m_shaderManager, m_swapChain.get(), m_pipelineLayoutCache.get(), m_asyncCompiler.get());
+  m_descriptorAllocator = std::make_unique<VulkanDescriptorAllocator>(m_device.get());
+  m_renderGraph = std::make_unique<VulkanRenderGraph>(m_device.get(), m_graphicsTimeline.get(), &m_deletionQueue);
+  for (auto &allocator : m_frameDescriptorAllocators) {
+    allocator = std::make_unique<VulkanDescriptorAllocator>(m_device.get());
+  }
   createCommandBuffers();
-  initImGui();
+  if (!isHeadless()) { initImGui(); }
 }
 
 VulkanRenderer::~VulkanRenderer()
 {
+  m_presentThread.reset();
+  // Queued compile jobs still use the shader modules, which go away with the shader manager below
+  m_asyncCompiler->waitIdle();
   m_device->flushGPU();
-  ImGui_ImplVulkan_Shutdown();
-  ImGui_ImplSDL3_Shutdown();
-  ImGui::DestroyContext();
+  // Nothing runs on the GPU anymore, what the unsubmitted frame queued goes too. Buffers have to be gone before the
+  // buffer manager destroys its pools.
+  m_deletionQueue.collect(std::numeric_limits<uint64_t>::max());
+  if (!isHeadless()) {
+    ImGui_ImplVulkan_Shutdown();
+    ImGui_ImplSDL3_Shutdown();
+    ImGui::DestroyContext();
+    vkDestroyDescriptorPool(m_device->getDevice(), m_imguiPool, nullptr);
+  }
   delete m_shaderManager;
   delete m_pipelineManager;
   m_device->getDevice().freeCommandBuffers(m_device->getCommandPool(), m_commandBuffers);
-  vkDestroyDescriptorPool(m_device->getDevice(), m_imguiPool, nullptr);
   m_commandBuffers.clear();
 }
 
-void VulkanRenderer::beginRendering(vk::CommandBuffer commandBuffer)
+void VulkanRenderer::beginRendering(vk::CommandBuffer commandBuffer, bool clear, RenderingContents contents)
 {
   core::assertion(m_isFrameStarted,
     "Can't call beginSwapChainRenderPass "
@@ -44,42 +74,29 @@ void VulkanRenderer::beginRendering(vk::CommandBuffer commandBuffer)
   core::assertion(
     commandBuffer == getCurrentCommandBuffer(), "Can't call beginSwapChainRenderPass on a different command buffer");
 
-  m_device->transitionImageLayout(commandBuffer,
-    m_swapChain->getImage(m_currentImageIndex),
-    vk::AccessFlags(),
-    vk::AccessFlagBits::eColorAttachmentWrite,
-    vk::ImageLayout::eUndefined,
-    vk::ImageLayout::eColorAttachmentOptimal,
-    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
-  m_device->transitionImageLayout(commandBuffer,
-    m_swapChain->getDepthImage(m_currentImageIndex),
-    vk::AccessFlags(),
-    vk::AccessFlagBits::eDepthStencilAttachmentWrite,
-    vk::ImageLayout::eUndefined,
-    vk::ImageLayout::eDepthStencilAttachmentOptimal,
-    vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
-    vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
-    vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 });
-
   vk::RenderingAttachmentInfo colorAttachment{};
-  colorAttachment.imageView = m_swapChain->getImageView(m_currentImageIndex);
+  colorAttachment.imageView = m_renderGraph->getImageView(m_backbuffer);
   colorAttachment.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
-  colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+  colorAttachment.loadOp = clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
   colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
   colorAttachment.clearValue.color = { { { 0.0f, 0.0f, 0.0f, 0.0f } } };
 
   // A single depth stencil attachment info can be used, but they can also be specified separately.
   // When both are specified separately, the only requirement is that the image view is identical.
   vk::RenderingAttachmentInfo depthStencilAttachment{};
-  depthStencilAttachment.imageView = m_swapChain->getDepthImageView(m_currentImageIndex);
+  depthStencilAttachment.imageView = m_renderGraph->getImageView(m_depthBuffer);
   depthStencilAttachment.imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-  depthStencilAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-  depthStencilAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+  depthStencilAttachment.loadOp = clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+  // Unless something like a depth pyramid or a later pass reads depth back, storing it would only cost bandwidth (and
+  // defeat lazily allocated memory on tilers)
+  depthStencilAttachment.storeOp = m_renderGraph->isReadAfterCurrentPass(m_depthBuffer) ? vk::AttachmentStoreOp::eStore
+                                                                                         : vk::AttachmentStoreOp::eDontCare;
   depthStencilAttachment.clearValue.depthStencil = { 1.0f, 0 };
 
   vk::RenderingInfo renderingInfo = {};
+  if (contents == RenderingContents::SecondaryCommandBuffers) {
+    renderingInfo.flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+  }
   renderingInfo.renderArea = { { 0, 0 },
     { m_swapChain->getSwapChainExtent().width, m_swapChain->getSwapChainExtent().height } };
   renderingInfo.layerCount = 1;
@@ -90,15 +107,8 @@ void VulkanRenderer::beginRendering(vk::CommandBuffer commandBuffer)
 
   commandBuffer.beginRendering(renderingInfo);
 
-  vk::Viewport viewport{ .x = 0.0f,
-    .y = 0.0f,
-    .width = static_cast<float>(m_swapChain->getSwapChainExtent().width),
-    .height = static_cast<float>(m_swapChain->getSwapChainExtent().height),
-    .minDepth = 0.0f,
-    .maxDepth = 1.0f };
-  vk::Rect2D scissor{ { 0, 0 }, m_swapChain->getSwapChainExtent() };
-  commandBuffer.setViewportWithCount(viewport);
-  commandBuffer.setScissorWithCount(scissor);
+  // The secondaries set their own, nothing but executeCommands is allowed here
+  if (contents == RenderingContents::Inline) { setFullViewport(commandBuffer); }
 }
 
 void VulkanRenderer::endRendering(vk::CommandBuffer commandBuffer)
@@ -110,22 +120,79 @@ void VulkanRenderer::endRendering(vk::CommandBuffer commandBuffer)
     commandBuffer == getCurrentCommandBuffer(), "Can't call endSwapChainRenderPass on a different command buffer");
 
   commandBuffer.endRendering();
+}
+
+void VulkanRenderer::beginSecondaryRendering(vk::CommandBuffer commandBuffer)
+{
+  core::assertion(!m_secondaryCommandBuffer, "Only one secondary command buffer can be recorded at a time");
 
-  m_device->transitionImageLayout(commandBuffer,
-    m_swapChain->getImage(m_currentImageIndex),
-    vk::AccessFlagBits::eColorAttachmentWrite,
-    vk::AccessFlags(),
-    vk::ImageLayout::eColorAttachmentOptimal,
-    vk::ImageLayout::ePresentSrcKHR,
-    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    vk::PipelineStageFlagBits::eBottomOfPipe,
-    vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+  // Has to match beginRendering, apart from the contents flag
+  const vk::Format colorFormat = m_swapChain->getSwapChainImageFormat();
+  vk::CommandBufferInheritanceRenderingInfo renderingInfo = {
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &colorFormat,
+    .depthAttachmentFormat = m_swapChain->getSwapChainDepthFormat(),
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+  vk::CommandBufferInheritanceInfo inheritanceInfo = { .pNext = &renderingInfo };
+  vk::CommandBufferBeginInfo beginInfo = {
+    .flags =
+      vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse,
+    .pInheritanceInfo = &inheritanceInfo,
+  };
+  commandBuffer.begin(beginInfo);
+
+  m_secondaryCommandBuffer = commandBuffer;
+  m_secondaryStateTracker.invalidate();
+  m_bindlessHeap->bind(commandBuffer, vk::PipelineBindPoint::eGraphics);
+  setFullViewport(commandBuffer);
+}
+
+void VulkanRenderer::endSecondaryRendering(vk::CommandBuffer commandBuffer)
+{
+  core::assertion(commandBuffer == m_secondaryCommandBuffer, "Secondary command buffer isn't being recorded");
+
+  commandBuffer.end();
+  m_secondaryCommandBuffer = nullptr;
+}
+
+void VulkanRenderer::setFullViewport(vk::CommandBuffer commandBuffer)
+{
+  vk::Viewport viewport{ .x = 0.0f,
+    .y = 0.0f,
+    .width = static_cast<float>(m_swapChain->getSwapChainExtent().width),
+    .height = static_cast<float>(m_swapChain->getSwapChainExtent().height),
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f };
+  vk::Rect2D scissor{ { 0, 0 }, m_swapChain->getSwapChainExtent() };
+  commandBuffer.setViewportWithCount(viewport);
+  commandBuffer.setScissorWithCount(scissor);
+}
+
+VulkanDynamicStateTracker &VulkanRenderer::getStateTracker(vk::CommandBuffer commandBuffer)
+{
+  if (m_secondaryCommandBuffer && commandBuffer == m_secondaryCommandBuffer) { return m_secondaryStateTracker; }
+  core::assertion(commandBuffer == getCurrentCommandBuffer(),
+    "Programs can only be bound on the current frame's command buffer or a secondary being recorded");
+  return m_dynamicStateTrackers[m_currentFrameIndex];
 }
 
 vk::CommandBuffer VulkanRenderer::beginFrame()
 {
   core::assertion(!m_isFrameStarted, "Can't call beginFrame while already in progress");
 
+  if (m_presentThread) {
+    // Acquire and present aren't allowed to overlap on the swapchain, and waiting here rather than after submitting
+    // lets a blocking present overlap with the game's update
+    m_swapChain->setPresentWait(m_presentThread->waitIdle());
+    if (m_presentThread->consumeOutOfDate()) { recreateSwapChain(); }
+  }
+
+  if (m_swapchainPolicyChanged) {
+    m_swapchainPolicyChanged = false;
+    recreateSwapChain();
+  }
+
   auto result = m_swapChain->acquireNextImage(&m_currentImageIndex);
 
   if (result == vk::Result::eErrorOutOfDateKHR) {
@@ -136,13 +203,31 @@ vk::CommandBuffer VulkanRenderer::beginFrame()
   core::assertion(
     result == vk::Result::eSuccess || result == vk::Result::eSuboptimalKHR, "Failed to acquire swap chain image!");
 
+  m_deletionQueue.collect(m_graphicsTimeline->getCompletedValue());
+
 #ifndef NDEBUG
   m_isFrameStarted = true;
 #endif
 
+  // acquireNextImage has waited for the slot's previous frame, so no set from this slot is in use anymore
+  m_frameDescriptorAllocators[m_currentFrameIndex]->reset();
+  m_bindlessHeap->beginFrame();
+  m_bufferManager->beginFrame();
+  m_asyncCompute->beginFrame(m_currentFrameIndex);
+  m_computeWaits.clear();
+
   auto commandBuffer = getCurrentCommandBuffer();
   auto biginInfo = vk::CommandBufferBeginInfo{};
   commandBuffer.begin(biginInfo);
+  m_dynamicStateTrackers[m_currentFrameIndex].invalidate();
+
+  // Every program layout starts with the heap's set and shares its push constant range, so this binding survives
+  // program switches for the whole frame
+  m_bindlessHeap->bind(commandBuffer, vk::PipelineBindPoint::eGraphics);
+  m_bindlessHeap->bind(commandBuffer, vk::PipelineBindPoint::eCompute);
+
+  m_renderGraph->reset();
+  importFrameResources();
 
   return commandBuffer;
 }
@@ -152,42 +237,134 @@ void VulkanRenderer::endFrame()
   core::assertion(m_isFrameStarted, "Can't call endFrame while frame not in progress");
 
   auto commandBuffer = getCurrentCommandBuffer();
+  m_renderGraph->execute(commandBuffer);
   commandBuffer.end();
 
-  auto result = m_swapChain->submitCommandBuffers(&commandBuffer, &m_currentImageIndex);
+  // Signals the graphics timeline, the swapchain paces its frame slots on it
+  vk::Result result = vk::Result::eSuccess;
+  if (m_presentThread) {
+    // Results come back through consumeOutOfDate at the next beginFrame
+    m_presentThread->push(m_swapChain->prepareSubmission(commandBuffer, m_currentImageIndex, m_computeWaits));
+  } else {
+    result = m_swapChain->submitCommandBuffers(&commandBuffer, &m_currentImageIndex, m_computeWaits);
+  }
+
+#ifndef NDEBUG
+  m_isFrameStarted = false;
+#endif
+
+  m_currentFrameIndex = m_swapChain->getCurrentFrameIndex();
 
   if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR) {
     recreateSwapChain();
   } else if (result != vk::Result::eSuccess) {
     core::panic("Failed to present swap chain image!");
   }
+}
 
-#ifndef NDEBUG
-  m_isFrameStarted = false;
-#endif
+uint64_t VulkanRenderer::scheduleAsyncCompute(const AsyncComputeCallback &record,
+  vk::PipelineStageFlags2 consumerStages,
+  bool afterPreviousFrame)
+{
+  core::assertion(m_isFrameStarted, "Async compute can only be scheduled while a frame is in progress");
 
-  m_currentFrameIndex = (m_currentFrameIndex + 1) % VulkanSwapchain::MAX_FRAMES_IN_FLIGHT;
+  vk::CommandBuffer commandBuffer = m_asyncCompute->begin();
+  m_bindlessHeap->bind(commandBuffer, vk::PipelineBindPoint::eCompute);
+  record(commandBuffer);
+
+  std::vector<vk::SemaphoreSubmitInfo> waits;
+  if (afterPreviousFrame && m_graphicsTimeline->getLastSubmittedValue() > 0) {
+    waits.push_back(m_graphicsTimeline->getWaitInfo(
+      m_graphicsTimeline->getLastSubmittedValue(), vk::PipelineStageFlagBits2::eComputeShader));
+  }
+  const uint64_t value = m_asyncCompute->submit(commandBuffer, waits);
+
+  m_computeWaits.push_back(m_asyncCompute->getWaitInfo(value, consumerStages));
+  return value;
+}
+
+void VulkanRenderer::deferDeletion(VulkanDeletionQueue::Deleter deleter)
+{
+  m_deletionQueue.push(getFrameTimelineValue(), std::move(deleter));
+}
+
+void VulkanRenderer::importFrameResources()
+{
+  constexpr vk::PipelineStageFlags2 depthStages =
+    vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests;
+
+  // The acquire semaphore is waited on at the color attachment output stage, chaining the first transition to it
+  m_backbuffer = m_renderGraph->importImage("backbuffer",
+    { .image = m_swapChain->getImage(m_currentImageIndex),
+      .view = m_swapChain->getImageView(m_currentImageIndex),
+      .range = { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 },
+      .extent = m_swapChain->getSwapChainExtent(),
+      .initialLayout = vk::ImageLayout::eUndefined,
+      .initialStages = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      .finalLayout = m_swapChain->getFinalLayout() });
+
+  // One per frame slot and cleared every frame, its contents never outlive the frame
+  m_depthBuffer = m_renderGraph->importImage("depth",
+    { .image = m_swapChain->getDepthImage(m_currentFrameIndex),
+      .view = m_swapChain->getDepthImageView(m_currentFrameIndex),
+      .range = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 },
+      .extent = m_swapChain->getSwapChainExtent(),
+      .initialLayout = vk::ImageLayout::eUndefined,
+      .initialStages = depthStages,
+      .initialAccess = vk::AccessFlagBits2::eDepthStencilAttachmentWrite });
 }
 
 void VulkanRenderer::recreateSwapChain()
 {
-  int width = 0;
-  int height = 0;
-  SDL_GetWindowSize(m_window, &width, &height);
-  vk::Extent2D extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
-  m_device->flushGPU();
+  // The old swapchain is externally synchronized with its replacement's creation
+  if (m_presentThread) { m_presentThread->waitIdle(); }
+
+  vk::Extent2D extent = m_offscreenExtent;
+  if (!isHeadless()) {
+    int width = 0;
+    int height = 0;
+    SDL_GetWindowSize(m_window, &width, &height);
+    extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+  }
 
   if (m_swapChain == nullptr) {
-    m_swapChain = std::make_unique<VulkanSwapchain>(m_device.get(), extent);
+    m_swapChain =
+      std::make_unique<VulkanSwapchain>(m_device.get(), extent, m_swapchainPolicy, m_graphicsTimeline.get());
   } else {
     std::shared_ptr<VulkanSwapchain> oldSwapChain = std::move(m_swapChain);
-    m_swapChain = std::make_unique<VulkanSwapchain>(m_device.get(), extent, oldSwapChain);
+    m_swapChain = std::make_unique<VulkanSwapchain>(
+      m_device.get(), extent, m_swapchainPolicy, m_graphicsTimeline.get(), oldSwapChain);
 
     core::assertion(m_swapChain->compareSwapFormats(*oldSwapChain), "Swap chain image format has changed!");
+
+    // No idle wait, frames submitted with the old swapchain keep running and presenting. Its images and depth buffers
+    // are destroyed once the timeline has passed every frame that could have used them.
+    deferDeletion([oldSwapChain = std::move(oldSwapChain)] {});
+  }
+  if (m_swapchainPolicy.presentThread && !m_swapChain->isOffscreen()) {
+    if (!m_presentThread) { m_presentThread = std::make_unique<VulkanPresentThread>(); }
+  } else {
+    m_presentThread.reset();
   }
+  // The new swapchain continues from the old one's frame slot (folded into its frame count), the renderer's per-frame
+  // resources follow it
+  m_currentFrameIndex = m_swapChain->getCurrentFrameIndex();
   core::Logger::info("Swap chain recreated");
 }
 
+void VulkanRenderer::setSwapchainProfile(SwapchainProfile profile)
+{
+  SwapchainPolicy policy = SwapchainPolicy::fromProfile(profile);
+  policy.sampledDepth = m_swapchainPolicy.sampledDepth;
+  setSwapchainPolicy(policy);
+}
+
+void VulkanRenderer::setSwapchainPolicy(const SwapchainPolicy &policy)
+{
+  m_swapchainPolicy = policy;
+  m_swapchainPolicyChanged = true;
+}
+
 void VulkanRenderer::createCommandBuffers()
 {
   m_commandBuffers.resize(VulkanSwapchain::MAX_FRAMES_IN_FLIGHT);
@@ -204,7 +381,7 @@ void VulkanRenderer::createCommandBuffers()
 void VulkanRenderer::onResize(int width, int height)
 {
   if (width == 0 || height == 0) return;
-  m_device->flushGPU();
+  if (isHeadless()) { m_offscreenExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; }
   recreateSwapChain();
 }
 
@@ -270,32 +447,290 @@ size_t VulkanRenderer::loadVertexShader(std::string_view path)
   return m_shaderManager->loadShader(path, VulkanShaderManager::ShaderType::Vertex);
 }
 
-void VulkanRenderer::flushGPU() { m_device->flushGPU(); }
+size_t VulkanRenderer::loadComputeShader(std::string_view path)
+{
+  return m_shaderManager->loadShader(path, VulkanShaderManager::ShaderType::Compute);
+}
+
+void VulkanRenderer::flushGPU()
+{
+  // Frames still queued haven't been submitted, the device idling wouldn't cover them
+  if (m_presentThread) { m_presentThread->waitIdle(); }
+  m_device->flushGPU();
+}
 
 size_t VulkanRenderer::createGraphicsPipeline(GraphicsPipelineDesc &desc)
 {
-  return m_pipelineManager->createGraphicsPipeline(desc);
+  return requestGraphicsPipeline(desc, false);
+}
+
+size_t VulkanRenderer::createGraphicsPipelineAsync(GraphicsPipelineDesc &desc)
+{
+  return requestGraphicsPipeline(desc, true);
 }
 
 ShaderProgramId VulkanRenderer::createShaderProgram(ShaderProgramDesc const &desc)
 {
+  return requestShaderProgram(desc.vertexShaderId,
+    desc.fragmentShaderId,
+    DynamicStateBlock::create(desc.primitiveTopology,
+      desc.rasterizerState,
+      desc.depthStencilState,
+      desc.blendState,
+      desc.colorAttachmentCount),
+    false);
+}
+
+ShaderProgramId VulkanRenderer::createShaderProgramAsync(ShaderProgramDesc const &desc)
+{
+  return requestShaderProgram(desc.vertexShaderId,
+    desc.fragmentShaderId,
+    DynamicStateBlock::create(desc.primitiveTopology,
+      desc.rasterizerState,
+      desc.depthStencilState,
+      desc.blendState,
+      desc.colorAttachmentCount),
+    true);
+}
+
+ShaderProgramId VulkanRenderer::createComputeProgram(ComputeProgramDesc const &desc)
+{
+  return requestComputeProgram(desc.computeShaderId, false);
+}
+
+ShaderProgramId VulkanRenderer::createComputeProgramAsync(ComputeProgramDesc const &desc)
+{
+  return requestComputeProgram(desc.computeShaderId, true);
+}
+
+void VulkanRenderer::setFallbackShaderProgram(ShaderProgramId shaderProgramId)
+{
+  m_shaderProgramManager->setFallbackProgram(shaderProgramId);
+}
+
+void VulkanRenderer::setFallbackPipeline(size_t pipelineId) { m_pipelineManager->setFallbackPipeline(pipelineId); }
+
+size_t VulkanRenderer::prewarm()
+{
+  using ShaderType = VulkanShaderManager::ShaderType;
+
+  size_t count = 0;
+  for (const PrewarmEntry &entry : m_prewarmList->getPreviousEntries()) {
+    switch (entry.kind) {
+    case PrewarmEntry::Kind::ShaderProgram:
+      // Shaders renamed or deleted since
+      if (!VulkanShaderManager::shaderExists(entry.shaderPaths[0], ShaderType::Vertex)
+          || !VulkanShaderManager::shaderExists(entry.shaderPaths[1], ShaderType::Fragment)) {
+        continue;
+      }
+      requestShaderProgram(m_shaderManager->loadShader(entry.shaderPaths[0], ShaderType::Vertex),
+        m_shaderManager->loadShader(entry.shaderPaths[1], ShaderType::Fragment),
+        entry.programState,
+        true);
+      break;
+    case PrewarmEntry::Kind::ComputeProgram:
+      if (!VulkanShaderManager::shaderExists(entry.shaderPaths[0], ShaderType::Compute)) { continue; }
+      requestComputeProgram(m_shaderManager->loadShader(entry.shaderPaths[0], ShaderType::Compute), true);
+      break;
+    case PrewarmEntry::Kind::GraphicsPipeline: {
+      GraphicsPipelineDesc desc = entry.pipelineDesc;
+      desc.vertexShaderId = INVALID_ID;
+      desc.fragmentShaderId = INVALID_ID;
+      if (!entry.shaderPaths[0].empty()) {
+        if (!VulkanShaderManager::shaderExists(entry.shaderPaths[0], ShaderType::Vertex)) { continue; }
+        desc.vertexShaderId = m_shaderManager->loadShader(entry.shaderPaths[0], ShaderType::Vertex);
+      }
+      if (!entry.shaderPaths[1].empty()) {
+        if (!VulkanShaderManager::shaderExists(entry.shaderPaths[1], ShaderType::Fragment)) { continue; }
+        desc.fragmentShaderId = m_shaderManager->loadShader(entry.shaderPaths[1], ShaderType::Fragment);
+      }
+      requestGraphicsPipeline(desc, true);
+      break;
+    }
+    }
+    count++;
+  }
+
+  core::Logger::info("Prewarming {} programs and pipelines", count);
+  return count;
+}
+
+ShaderProgramId VulkanRenderer::requestShaderProgram(size_t vertexShaderId,
+  size_t fragmentShaderId,
+  const DynamicStateBlock &state,
+  bool async)
+{
+  ProgramKey key{ .isCompute = false, .shaderIds = { vertexShaderId, fragmentShaderId }, .state = state };
+  if (auto it = m_programLookup.find(key); it != m_programLookup.end()) {
+    // Requested asynchronously before, the caller needs it now
+    if (!async) { m_shaderProgramManager->finishShaderProgram(it->second); }
+    return it->second;
+  }
+
+  const BindReflection &vertexReflection = m_shaderManager->getVertexBindReflection(vertexShaderId);
+  const auto stages =
+    std::to_array({ &vertexReflection, &m_shaderManager->getFragmentBindReflection(fragmentShaderId) });
+  ProgramLayout layout = m_pipelineLayoutCache->getLayout(stages);
+
+  VulkanShaderProgramDesc vulkanDesc = {};
+  vulkanDesc.fragmentSpirv = m_shaderManager->getFragmentSpirv(fragmentShaderId);
+  vulkanDesc.vertexSpirv = m_shaderManager->getVertexSpirv(vertexShaderId);
+  vulkanDesc.pushConstants = { { .stageFlags = VulkanBindlessHeap::PUSH_CONSTANT_STAGES,
+    .offset = 0,
+    .size = VulkanBindlessHeap::PUSH_CONSTANT_SIZE } };
+  vulkanDesc.setLayouts = std::move(layout.setLayouts);
+  vulkanDesc.pipelineLayout = layout.pipelineLayout;
+  vulkanDesc.bindings = vertexReflection.bindingDescriptions;
+  vulkanDesc.attributes = vertexReflection.attributeDescriptions;
+  vulkanDesc.state = state;
+
+  const ShaderProgramId shaderProgramId = async
+                                            ? m_shaderProgramManager->createShaderProgramAsync(std::move(vulkanDesc))
+                                            : m_shaderProgramManager->createShaderProgram(vulkanDesc);
+  m_programLookup.emplace(key, shaderProgramId);
+  m_prewarmList->record({
+    .kind = PrewarmEntry::Kind::ShaderProgram,
+    .shaderPaths = { m_shaderManager->getShaderPath(vertexShaderId, VulkanShaderManager::ShaderType::Vertex),
+      m_shaderManager->getShaderPath(fragmentShaderId, VulkanShaderManager::ShaderType::Fragment) },
+    .programState = state,
+  });
+  return shaderProgramId;
+}
+
+ShaderProgramId VulkanRenderer::requestComputeProgram(size_t computeShaderId, bool async)
+{
+  ProgramKey key{ .isCompute = true, .shaderIds = { computeShaderId, INVALID_ID } };
+  if (auto it = m_programLookup.find(key); it != m_programLookup.end()) {
+    if (!async) { m_shaderProgramManager->finishShaderProgram(it->second); }
+    return it->second;
+  }
+
+  const BindReflection &reflection = m_shaderManager->getComputeBindReflection(computeShaderId);
+  const auto stages = std::to_array({ &reflection });
+  ProgramLayout layout = m_pipelineLayoutCache->getLayout(stages);
+
   VulkanShaderProgramDesc vulkanDesc = {};
-  vulkanDesc.fragmentSpirv = m_shaderManager->getFragmentSpirv(desc.fragmentShaderId);
-  vulkanDesc.vertexSpirv = m_shaderManager->getVertexSpirv(desc.vertexShaderId);
-  vulkanDesc.pushConstants = m_shaderManager->getVertexBindReflection(desc.vertexShaderId).pushConstants;
-  vulkanDesc.bindings = m_shaderManager->getVertexBindReflection(desc.vertexShaderId).bindingDescriptions;
-  vulkanDesc.attributes = m_shaderManager->getVertexBindReflection(desc.vertexShaderId).attributeDescriptions;
-  return m_shaderProgramManager->createShaderProgram(vulkanDesc);
+  vulkanDesc.computeSpirv = m_shaderManager->getComputeSpirv(computeShaderId);
+  vulkanDesc.workgroupSize = reflection.workgroupSize;
+  vulkanDesc.pushConstants = { { .stageFlags = VulkanBindlessHeap::PUSH_CONSTANT_STAGES,
+    .offset = 0,
+    .size = VulkanBindlessHeap::PUSH_CONSTANT_SIZE } };
+  vulkanDesc.setLayouts = std::move(layout.setLayouts);
+  vulkanDesc.pipelineLayout = layout.pipelineLayout;
+
+  const ShaderProgramId shaderProgramId = async
+                                            ? m_shaderProgramManager->createShaderProgramAsync(std::move(vulkanDesc))
+                                            : m_shaderProgramManager->createShaderProgram(vulkanDesc);
+  m_programLookup.emplace(key, shaderProgramId);
+  m_prewarmList->record({
+    .kind = PrewarmEntry::Kind::ComputeProgram,
+    .shaderPaths = { m_shaderManager->getShaderPath(computeShaderId, VulkanShaderManager::ShaderType::Compute), "" },
+  });
+  return shaderProgramId;
 }
 
-void VulkanRenderer::bindPipeline(VkCommandBuffer commandBuffer, size_t pipelineId)
+size_t VulkanRenderer::requestGraphicsPipeline(GraphicsPipelineDesc &desc, bool async)
 {
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineManager->getGraphicsPipeline(pipelineId));
+  const size_t pipelineId =
+    async ? m_pipelineManager->createGraphicsPipelineAsync(desc) : m_pipelineManager->createGraphicsPipeline(desc);
+
+  PrewarmEntry entry{ .kind = PrewarmEntry::Kind::GraphicsPipeline, .pipelineDesc = desc };
+  if (desc.vertexShaderId != INVALID_ID) {
+    entry.shaderPaths[0] = m_shaderManager->getShaderPath(desc.vertexShaderId, VulkanShaderManager::ShaderType::Vertex);
+  }
+  if (desc.fragmentShaderId != INVALID_ID) {
+    entry.shaderPaths[1] =
+      m_shaderManager->getShaderPath(desc.fragmentShaderId, VulkanShaderManager::ShaderType::Fragment);
+  }
+  // Ids are reassigned when the list is replayed, zeroing them keeps entries of the same pipeline equal across runs
+  entry.pipelineDesc.vertexShaderId = INVALID_ID;
+  entry.pipelineDesc.fragmentShaderId = INVALID_ID;
+  m_prewarmList->record(std::move(entry));
+  return pipelineId;
+}
+
+size_t VulkanRenderer::ProgramKeyHash::operator()(const ProgramKey &key) const
+{
+  size_t seed = key.isCompute;
+  hashCombine(seed, key.shaderIds[0]);
+  hashCombine(seed, key.shaderIds[1]);
+  hashCombine(seed, key.state.hash);
+  return seed;
 }
 
-void VulkanRenderer::bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId)
+vk::DescriptorSetLayout VulkanRenderer::getProgramSetLayout(ShaderProgramId shaderProgramId, uint32_t set)
 {
-  m_shaderProgramManager->bindShaderProgram(commandBuffer, shaderProgramId);
+  auto *program = m_shaderProgramManager->getShaderProgram(shaderProgramId);
+  core::assertion(set != VulkanBindlessHeap::SET_INDEX && set < program->getSetCount(),
+    "Set {} isn't one of the program's own sets",
+    set);
+  return program->getSetLayout(set);
+}
+
+void VulkanRenderer::bindDescriptorSet(vk::CommandBuffer commandBuffer,
+  ShaderProgramId shaderProgramId,
+  uint32_t set,
+  vk::DescriptorSet descriptorSet)
+{
+  auto *program = m_shaderProgramManager->getShaderProgram(shaderProgramId);
+  core::assertion(set != VulkanBindlessHeap::SET_INDEX && set < program->getSetCount(),
+    "Set {} isn't one of the program's own sets",
+    set);
+  const vk::PipelineBindPoint bindPoint =
+    program->isCompute() ? vk::PipelineBindPoint::eCompute : vk::PipelineBindPoint::eGraphics;
+  commandBuffer.bindDescriptorSets(bindPoint, program->getPipelineLayout(), set, descriptorSet, nullptr);
+}
+
+bool VulkanRenderer::bindPipeline(VkCommandBuffer commandBuffer, size_t pipelineId)
+{
+  const vk::Pipeline pipeline = m_pipelineManager->getGraphicsPipeline(pipelineId);
+  if (!pipeline) { return false; }
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  // The pipeline's static state and shaders replace whatever the tracker recorded
+  getStateTracker(commandBuffer).invalidate();
+  return true;
+}
+
+bool VulkanRenderer::bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId)
+{
+  return m_shaderProgramManager->bindShaderProgram(commandBuffer, shaderProgramId, getStateTracker(commandBuffer));
+}
+
+bool VulkanRenderer::bindComputeProgram(vk::CommandBuffer commandBuffer, ShaderProgramId shaderProgramId)
+{
+  return m_shaderProgramManager->bindComputeProgram(commandBuffer, shaderProgramId);
+}
+
+void VulkanRenderer::dispatch(vk::CommandBuffer commandBuffer,
+  uint32_t groupCountX,
+  uint32_t groupCountY,
+  uint32_t groupCountZ)
+{
+  commandBuffer.dispatch(groupCountX, groupCountY, groupCountZ);
+}
+
+void VulkanRenderer::dispatchThreads(vk::CommandBuffer commandBuffer,
+  ShaderProgramId shaderProgramId,
+  uint32_t threadCountX,
+  uint32_t threadCountY,
+  uint32_t threadCountZ)
+{
+  const auto &workgroupSize = m_shaderProgramManager->getShaderProgram(shaderProgramId)->getWorkgroupSize();
+  commandBuffer.dispatch((threadCountX + workgroupSize[0] - 1) / workgroupSize[0],
+    (threadCountY + workgroupSize[1] - 1) / workgroupSize[1],
+    (threadCountZ + workgroupSize[2] - 1) / workgroupSize[2]);
+}
+
+void VulkanRenderer::dispatchIndirect(vk::CommandBuffer commandBuffer, size_t bufferId, vk::DeviceSize offset)
+{
+  commandBuffer.dispatchIndirect(m_bufferManager->getBuffer(bufferId), offset);
+}
+
+void VulkanRenderer::bufferBarrier(vk::CommandBuffer commandBuffer, size_t bufferId, BufferAccess src, BufferAccess dst)
+{
+  const auto barrier = createBufferBarrier(m_bufferManager->getBuffer(bufferId), src, dst);
+  recordBufferBarriers(commandBuffer, std::span(&barrier, 1));
 }
 
 void VulkanRenderer::draw(VkCommandBuffer commandBuffer,
@@ -307,6 +742,22 @@ void VulkanRenderer::draw(VkCommandBuffer commandBuffer,
   vkCmdDraw(commandBuffer, numVertices, numInstances, vertexOffset, instanceOffset);
 }
 
+void VulkanRenderer::drawIndexedIndirectCount(vk::CommandBuffer commandBuffer,
+  size_t bufferId,
+  vk::DeviceSize offset,
+  size_t countBufferId,
+  vk::DeviceSize countOffset,
+  uint32_t maxDrawCount)
+{
+  // Through VK_KHR_draw_indirect_count, the device doesn't enable the Vulkan 1.2 drawIndirectCount feature
+  commandBuffer.drawIndexedIndirectCountKHR(m_bufferManager->getBuffer(bufferId),
+    offset,
+    m_bufferManager->getBuffer(countBufferId),
+    countOffset,
+    maxDrawCount,
+    sizeof(vk::DrawIndexedIndirectCommand));
+}
+
 void VulkanRenderer::setVertexBuffer(VkCommandBuffer commandBuffer, uint32_t slot, size_t bufferId)
 {
   VkBuffer vertexBuffer = m_bufferManager->getBuffer(bufferId);
@@ -322,6 +773,27 @@ void VulkanRenderer::setIndexBuffer(VkCommandBuffer commandBuffer, size_t buffer
 
 size_t VulkanRenderer::createBuffer(BufferDesc &desc) { return m_bufferManager->createBuffer(desc); }
 
+void VulkanRenderer::destroyBuffer(size_t bufferId) { m_bufferManager->destroyBuffer(bufferId); }
+
+size_t VulkanRenderer::createImage(ImageDesc &desc, const ImageData *data)
+{
+  return m_imageManager->createImage(desc, data);
+}
+
+void VulkanRenderer::destroyImage(size_t imageId) { m_imageManager->destroyImage(imageId); }
+
+void VulkanRenderer::setBufferEvictionCallback(VulkanBufferManager::EvictionCallback callback)
+{
+  m_bufferManager->setEvictionCallback(std::move(callback));
+}
+
+void VulkanRenderer::defragmentBuffers()
+{
+  core::assertion(!m_isFrameStarted, "Can't defragment while a frame is being recorded");
+  flushGPU();
+  m_bufferManager->defragment();
+}
+
 void VulkanRenderer::copyBuffer(VkCommandBuffer commandBuffer,
   size_t dstBuffer,
   uint64_t dstOffset,
@@ -347,17 +819,26 @@ void VulkanRenderer::copyBuffer(VkCommandBuffer commandBuffer,
   vkCmdCopyBuffer(commandBuffer, vkSrcBuffer, vkDstBuffer, 1, &copyRegion);
 }
 
+vk::DescriptorSet VulkanRenderer::allocateDescriptorSet(vk::DescriptorSetLayout layout)
+{
+  return m_descriptorAllocator->allocate(layout);
+}
+
+vk::DescriptorSet VulkanRenderer::allocateTransientDescriptorSet(vk::DescriptorSetLayout layout)
+{
+  core::assertion(m_isFrameStarted, "Transient descriptor sets can only be allocated while a frame is in progress");
+  return m_frameDescriptorAllocators[m_currentFrameIndex]->allocate(layout);
+}
+
 void VulkanRenderer::pushConstant(vk::CommandBuffer commandBuffer,
   ShaderProgramId shaderId,
   void *data,
   uint32_t offset,
   uint32_t size)
 {
-  // auto layout = m_pipelineManager->getGraphicsPipelineLayout(pipelineId);
-  // TODO Stage Flags
-  // vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, offset, size, data);
-  commandBuffer.pushConstants(m_shaderProgramManager->getShaderProgram(shaderId)->getPipelineLayout(),
-    vk::ShaderStageFlagBits::eVertex,
+  auto *program = m_shaderProgramManager->getShaderProgram(shaderId);
+  commandBuffer.pushConstants(program->getPipelineLayout(),
+    program->getPushConstantStages(),
     offset,
     size,
     data);
@@ -366,7 +847,12 @@ void VulkanRenderer::pushConstant(vk::CommandBuffer commandBuffer,
 // Temporary
 void VulkanRenderer::writeToBuffer(size_t bufferId, void *data, VkDeviceSize size)
 {
-  vmaCopyMemoryToAllocation(m_device->getAllocator(), data, m_bufferManager->getBufferAllocation(bufferId), 0, size);
+  m_bufferManager->writeBuffer(bufferId, data, size);
+}
+
+void VulkanRenderer::readFromBuffer(size_t bufferId, void *data, VkDeviceSize size)
+{
+  vmaCopyAllocationToMemory(m_device->getAllocator(), m_bufferManager->getBufferAllocation(bufferId), 0, data, size);
 }
 // Temporary
 VkCommandBuffer VulkanRenderer::beginSingleTimeCommands() { return m_device->beginSingleTimeCommands(); }
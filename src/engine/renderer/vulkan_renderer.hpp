@@ -5,33 +5,121 @@
 #include "engine/renderer/vulkan/vulkan_shader_program_manager.hpp"
 #include <engine/core/assert.hpp>
 #include <engine/renderer/descriptors/shader_program_descriptors.hpp>
+#include <engine/renderer/vulkan/vulkan_async_compiler.hpp>
+#include <engine/renderer/vulkan/vulkan_async_compute.hpp>
+#include <engine/renderer/vulkan/vulkan_bindless_heap.hpp>
 #include <engine/renderer/vulkan/vulkan_buffer_manager.hpp>
+#include <engine/renderer/vulkan/vulkan_deletion_queue.hpp>
+#include <engine/renderer/vulkan/vulkan_descriptors.hpp>
 #include <engine/renderer/vulkan/vulkan_device.hpp>
+#include <engine/renderer/vulkan/vulkan_dynamic_state.hpp>
+#include <engine/renderer/vulkan/vulkan_image_manager.hpp>
+#include <engine/renderer/vulkan/vulkan_pipeline_layout_cache.hpp>
+#include <engine/renderer/vulkan/vulkan_present_thread.hpp>
+#include <engine/renderer/vulkan/vulkan_prewarm_list.hpp>
+#include <engine/renderer/vulkan/vulkan_render_graph.hpp>
 #include <engine/renderer/vulkan/vulkan_swapchain.hpp>
+#include <engine/renderer/vulkan/vulkan_timeline.hpp>
+#include <engine/renderer/vulkan/vulkan_utils.hpp>
+#include <functional>
 #include <memory>
+#include <unordered_map>
 
 class GameRenderer;
 
 namespace engine {
 namespace renderer {
+  // What a beginRendering render pass instance is filled with
+  enum class RenderingContents {
+    Inline,
+    // Only executeCommands until endRendering, e.g. VulkanStaticBatchCache::execute
+    SecondaryCommandBuffers,
+  };
+
   class VulkanRenderer
   {
     friend class ::GameRenderer;// TODO For testing only
   public:
     VulkanRenderer(SDL_Window *window);
+    // Headless renderer drawing into offscreen images of the given size, for machines without a display or GPU (see
+    // VulkanDevice). The frame loop is the same, the backbuffer ends every frame ready to be read back (see
+    // VulkanReadback) and there is no ImGui.
+    explicit VulkanRenderer(vk::Extent2D offscreenExtent);
     ~VulkanRenderer();
 
-    void beginRendering(vk::CommandBuffer commandBuffer);
+    inline bool isHeadless() const noexcept { return m_window == nullptr; }
+
+    // Begin/end dynamic rendering into the backbuffer and depth buffer. Only valid inside a render graph pass that
+    // writes getBackbuffer() as ColorAttachment and getDepthBuffer() as DepthStencilAttachment, the graph does the
+    // layout transitions. Without clear the attachments keep what earlier passes rendered, the pass then has to read
+    // them as well. With RenderingContents::SecondaryCommandBuffers the draws come from secondary command buffers
+    // (see beginSecondaryRendering), the viewport and scissor aren't set.
+    void beginRendering(vk::CommandBuffer commandBuffer,
+      bool clear = true,
+      RenderingContents contents = RenderingContents::Inline);
     void endRendering(vk::CommandBuffer commandBuffer);
+    // Records a secondary command buffer to be executed inside beginRendering with
+    // RenderingContents::SecondaryCommandBuffers. Nothing is inherited from the frame's command buffer, the viewport,
+    // scissor and bindless heap are set here. bindShaderProgram and bindPipeline accept it until endSecondaryRendering,
+    // one recording at a time. Must be allocated with simultaneous use in mind, frames in flight may all execute it.
+    void beginSecondaryRendering(vk::CommandBuffer commandBuffer);
+    void endSecondaryRendering(vk::CommandBuffer commandBuffer);
+
+    // Passes are added between beginFrame and endFrame, the graph is compiled and recorded by endFrame
+    inline VulkanRenderGraph &getRenderGraph() { return *m_renderGraph; }
+    inline RenderGraphResource getBackbuffer() const { return m_backbuffer; }
+    inline vk::Format getBackbufferFormat() const { return m_swapChain->getSwapChainImageFormat(); }
+    inline vk::Extent2D getBackbufferExtent() const { return m_swapChain->getSwapChainExtent(); }
+    // Always true when headless, windowed it depends on the surface
+    inline bool canReadBackbuffer() const
+    {
+      return bool(m_swapChain->getImageUsage() & vk::ImageUsageFlagBits::eTransferSrc);
+    }
+    inline RenderGraphResource getDepthBuffer() const { return m_depthBuffer; }
+
+    using AsyncComputeCallback = std::function<void(vk::CommandBuffer commandBuffer)>;
+
+    // Records compute work (culling, particles, post effects) and submits it to the compute queue right away, where it
+    // overlaps with the graphics work of previous frames still executing. This frame's graphics submission waits for
+    // it at consumerStages. With afterPreviousFrame it first waits for the previous frame's graphics submission, for
+    // inputs produced there. Only buffers can be shared with graphics, images are owned by the graphics family.
+    uint64_t scheduleAsyncCompute(const AsyncComputeCallback &record,
+      vk::PipelineStageFlags2 consumerStages,
+      bool afterPreviousFrame = false);
+
+    // Signaled by every graphics submission, frames are paced on it
+    inline const VulkanTimeline &getGraphicsTimeline() const { return *m_graphicsTimeline; }
+    // Value the graphics timeline reaches once the frame being recorded has finished on the GPU
+    inline uint64_t getFrameTimelineValue() const noexcept { return m_graphicsTimeline->getNextValue(); }
+    inline bool isTimelineValueReached(uint64_t value) const { return m_graphicsTimeline->isReached(value); }
+    inline void waitForTimelineValue(uint64_t value) const { m_graphicsTimeline->wait(value); }
+    // Runs the deleter once the frame being recorded (or the next one, between frames) has finished on the GPU, for
+    // resources it may still use
+    void deferDeletion(VulkanDeletionQueue::Deleter deleter);
 
     [[nodiscard]] size_t createBuffer(BufferDesc &desc);
+    void destroyBuffer(size_t bufferId);
+    // Called when a buffer allocation would exceed the memory budget, see VulkanBufferManager
+    void setBufferEvictionCallback(VulkanBufferManager::EvictionCallback callback);
+    // Waits for the GPU and compacts buffer memory. Buffer handles obtained before are invalid afterwards, bindless
+    // slots stay valid. Meant for level transitions and the like, not every frame.
+    void defragmentBuffers();
 
     [[nodiscard]] vk::CommandBuffer beginFrame();
     void endFrame();
 
     void onResize(int width, int height);
 
+    // Applied at the start of the next frame by recreating the swapchain
+    void setSwapchainProfile(SwapchainProfile profile);
+    void setSwapchainPolicy(const SwapchainPolicy &policy);
+    inline const SwapchainPolicy &getSwapchainPolicy() const { return m_swapchainPolicy; }
+    // CPU time spent waiting on the frame timeline, acquire and present during the last frame. With
+    // SwapchainPolicy::presentThread, present is the wait for the present thread before acquiring.
+    inline const SwapchainFrameTimings &getFrameTimings() const { return m_swapChain->getFrameTimings(); }
+
     inline float getAspectRatio() const { return m_swapChain->extentAspectRatio(); }
+    inline VulkanDevice *getDevice() const { return m_device.get(); }
     inline size_t getFrameIndex() const
     {
       core::assertion(m_isFrameStarted, "Can't get frame index when frame not in progress");
@@ -45,14 +133,56 @@ namespace renderer {
 
     [[nodiscard]] size_t loadFragmentShader(std::string_view path);
     [[nodiscard]] size_t loadVertexShader(std::string_view path);
+    [[nodiscard]] size_t loadComputeShader(std::string_view path);
 
+    // Identical descriptions return the same pipeline or program. The synchronous versions compile on the calling
+    // thread (or wait for an earlier async request of the same description), the async ones return right away and
+    // compile on background threads. Until then binding draws with the fallback, or binds nothing and returns false
+    // so the draw or dispatch can be skipped: gameplay never waits on a compile.
     [[nodiscard]] size_t createGraphicsPipeline(GraphicsPipelineDesc &desc);
+    [[nodiscard]] size_t createGraphicsPipelineAsync(GraphicsPipelineDesc &desc);
 
     [[nodiscard]] ShaderProgramId createShaderProgram(ShaderProgramDesc const &desc);
+    [[nodiscard]] ShaderProgramId createShaderProgramAsync(ShaderProgramDesc const &desc);
+    [[nodiscard]] ShaderProgramId createComputeProgram(ComputeProgramDesc const &desc);
+    [[nodiscard]] ShaderProgramId createComputeProgramAsync(ComputeProgramDesc const &desc);
+
+    inline bool isPipelineReady(size_t pipelineId) const { return m_pipelineManager->isPipelineReady(pipelineId); }
+    inline bool isShaderProgramReady(ShaderProgramId shaderProgramId) const
+    {
+      return m_shaderProgramManager->isReady(shaderProgramId);
+    }
+    // Queued or compiling, e.g. for a loading screen to wait on after prewarm()
+    inline size_t getPendingCompileCount() const { return m_asyncCompiler->getPendingCount(); }
+
+    // Something cheap (e.g. a flat shaded version of the standard mesh shaders), compiled synchronously. Stands in for
+    // the programs or pipelines still compiling that read the same vertex input.
+    void setFallbackShaderProgram(ShaderProgramId shaderProgramId);
+    void setFallbackPipeline(size_t pipelineId);
 
-    void bindPipeline(VkCommandBuffer commandBuffer, size_t pipelineId);
+    // Queues what the previous run created (see VulkanPrewarmList) on the background compiler, to be called once the
+    // renderer is set up. Returns how many programs and pipelines were queued.
+    size_t prewarm();
 
-    void bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId);
+    bool bindPipeline(VkCommandBuffer commandBuffer, size_t pipelineId);
+
+    bool bindShaderProgram(VkCommandBuffer commandBuffer, ShaderProgramId shaderProgramId);
+    // Works on any command buffer recording compute work, including the ones handed out by scheduleAsyncCompute.
+    // Compute programs have no fallback, false means the dispatch has to be skipped.
+    bool bindComputeProgram(vk::CommandBuffer commandBuffer, ShaderProgramId shaderProgramId);
+
+    void dispatch(vk::CommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+    // Enough workgroups of the program's reflected size to cover the thread counts
+    void dispatchThreads(vk::CommandBuffer commandBuffer,
+      ShaderProgramId shaderProgramId,
+      uint32_t threadCountX,
+      uint32_t threadCountY = 1,
+      uint32_t threadCountZ = 1);
+    void dispatchIndirect(vk::CommandBuffer commandBuffer, size_t bufferId, vk::DeviceSize offset = 0);
+
+    // Makes src accesses to the buffer available to dst, e.g. BufferAccess::computeWrite() to
+    // BufferAccess::indirectRead() between a culling dispatch and the draws it produced
+    void bufferBarrier(vk::CommandBuffer commandBuffer, size_t bufferId, BufferAccess src, BufferAccess dst);
 
     void flushGPU();
 
@@ -62,6 +192,14 @@ namespace renderer {
       uint32_t vertexOffset,
       uint32_t instanceOffset);
 
+    // Draws up to maxDrawCount VkDrawIndexedIndirectCommands, the actual count is read from countBufferId
+    void drawIndexedIndirectCount(vk::CommandBuffer commandBuffer,
+      size_t bufferId,
+      vk::DeviceSize offset,
+      size_t countBufferId,
+      vk::DeviceSize countOffset,
+      uint32_t maxDrawCount);
+
     void copyBuffer(VkCommandBuffer commandBuffer,
       size_t dstBuffer,
       uint64_t dstOffset,
@@ -72,34 +210,137 @@ namespace renderer {
     void setVertexBuffer(VkCommandBuffer commandBuffer, uint32_t slot, size_t bufferId);
     void setIndexBuffer(VkCommandBuffer commandBuffer, size_t bufferId, IndexFormat indexFormat);
 
+    // Lives until the renderer is destroyed
+    [[nodiscard]] vk::DescriptorSet allocateDescriptorSet(vk::DescriptorSetLayout layout);
+    // Valid for the current frame only, the memory is recycled once the frame slot comes around again
+    [[nodiscard]] vk::DescriptorSet allocateTransientDescriptorSet(vk::DescriptorSetLayout layout);
+    inline VulkanDescriptorSetLayoutCache &getDescriptorSetLayoutCache() { return *m_descriptorSetLayoutCache; }
+    // Layout of a set the program's shaders declare above the bindless heap, for allocating its descriptor sets
+    [[nodiscard]] vk::DescriptorSetLayout getProgramSetLayout(ShaderProgramId shaderProgramId, uint32_t set);
+    // Programs with the same sets share their pipeline layout, the set stays bound when switching between them
+    void bindDescriptorSet(vk::CommandBuffer commandBuffer,
+      ShaderProgramId shaderProgramId,
+      uint32_t set,
+      vk::DescriptorSet descriptorSet);
+    inline VulkanBindlessHeap &getBindlessHeap() { return *m_bindlessHeap; }
+    // Slot of a storage buffer in the bindless heap, to be passed to shaders through push constants or instance data
+    inline uint32_t getBufferBindlessSlot(size_t bufferId) const { return m_bufferManager->getBufferBindlessSlot(bufferId); }
+    inline vk::Buffer getBuffer(size_t bufferId) const { return m_bufferManager->getBuffer(bufferId); }
+    // See VulkanBufferManager::getBufferGeneration
+    inline uint64_t getBufferGeneration(size_t bufferId) const
+    {
+      return m_bufferManager->getBufferGeneration(bufferId);
+    }
+
+    // See VulkanImageManager::createImage, staged uploads wait for the GPU
+    [[nodiscard]] size_t createImage(ImageDesc &desc, const ImageData *data = nullptr);
+    void destroyImage(size_t imageId);
+    // See VulkanImageManager::writeImage, host writable images can be written from loader threads
+    inline void writeImage(size_t imageId, const ImageData &data) { m_imageManager->writeImage(imageId, data); }
+    inline bool isImageHostWritable(size_t imageId) const { return m_imageManager->isImageHostWritable(imageId); }
+    inline vk::ImageView getImageView(size_t imageId) const { return m_imageManager->getImageView(imageId); }
+    // Slot of a sampled image in the bindless heap
+    inline uint32_t getImageBindlessSlot(size_t imageId) const { return m_imageManager->getImageBindlessSlot(imageId); }
+    // Created on first use and shared by every identical create info
+    inline const CachedSampler &getSampler(const vk::SamplerCreateInfo &createInfo)
+    {
+      return m_imageManager->getSamplerCache().getSampler(createInfo);
+    }
+
     void pushConstant(vk::CommandBuffer commandBuffer,
       ShaderProgramId shaderId,
       void *data,
       uint32_t offset,
       uint32_t size);
 
-    // Temporary
+    // Through the mapping when the buffer is host visible, through a staging copy otherwise (see
+    // VulkanBufferManager::writeBuffer)
     void writeToBuffer(size_t bufferId, void *data, VkDeviceSize size);
+    inline BufferUploadPath getBufferUploadPath(size_t bufferId) const
+    {
+      return m_bufferManager->getBufferUploadPath(bufferId);
+    }
+    // The buffer has to be host visible (BufferCPUAccess::ReadOnly) and no longer written by the GPU
+    void readFromBuffer(size_t bufferId, void *data, VkDeviceSize size);
     // Temporary
     VkCommandBuffer beginSingleTimeCommands();
     // Temporary
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 
   private:
+    VulkanRenderer(SDL_Window *window, vk::Extent2D offscreenExtent);
+
     void recreateSwapChain();
+    void importFrameResources();
     void createCommandBuffers();
 
     void initImGui();
+    void setFullViewport(vk::CommandBuffer commandBuffer);
+    // The frame's tracker, or the secondary one while a secondary command buffer is being recorded into
+    VulkanDynamicStateTracker &getStateTracker(vk::CommandBuffer commandBuffer);
+
+    ShaderProgramId requestShaderProgram(size_t vertexShaderId,
+      size_t fragmentShaderId,
+      const DynamicStateBlock &state,
+      bool async);
+    ShaderProgramId requestComputeProgram(size_t computeShaderId, bool async);
+    size_t requestGraphicsPipeline(GraphicsPipelineDesc &desc, bool async);
+
+    struct ProgramKey
+    {
+      bool isCompute = false;
+      // Vertex and fragment shader, or the compute shader
+      std::array<size_t, 2> shaderIds = { INVALID_ID, INVALID_ID };
+      DynamicStateBlock state;
+
+      bool operator==(const ProgramKey &) const = default;
+    };
+
+    struct ProgramKeyHash
+    {
+      size_t operator()(const ProgramKey &key) const;
+    };
 
   private:
     SDL_Window *m_window;
+    // Size of the offscreen images when headless
+    vk::Extent2D m_offscreenExtent;
     std::unique_ptr<VulkanDevice> m_device;
+    // Outlives everything paced on it
+    std::unique_ptr<VulkanTimeline> m_graphicsTimeline;
     std::unique_ptr<VulkanSwapchain> m_swapChain;
+    // Keyed by graphics timeline values, also holds replaced swapchains until frames in flight are done with them
+    VulkanDeletionQueue m_deletionQueue;
+    // Null unless the swapchain policy asks for it, destroyed first so no frame is executed on a destroyed swapchain
+    std::unique_ptr<VulkanPresentThread> m_presentThread;
+    std::unique_ptr<VulkanBindlessHeap> m_bindlessHeap;
+    std::unique_ptr<VulkanAsyncCompute> m_asyncCompute;
+    std::vector<vk::SemaphoreSubmitInfo> m_computeWaits;
     std::unique_ptr<VulkanBufferManager> m_bufferManager;
+    std::unique_ptr<VulkanImageManager> m_imageManager;
+    // Before the managers, which wait for its jobs when destroyed
+    std::unique_ptr<VulkanAsyncCompiler> m_asyncCompiler;
     std::unique_ptr<VulkanShaderProgramManager> m_shaderProgramManager;
+    std::unordered_map<ProgramKey, ShaderProgramId, ProgramKeyHash> m_programLookup;
+    std::unique_ptr<VulkanPrewarmList> m_prewarmList;
+    std::unique_ptr<VulkanDescriptorSetLayoutCache> m_descriptorSetLayoutCache;
+    std::unique_ptr<VulkanPipelineLayoutCache> m_pipelineLayoutCache;
+    std::unique_ptr<VulkanDescriptorAllocator> m_descriptorAllocator;
+    std::unique_ptr<VulkanRenderGraph> m_renderGraph;
+    RenderGraphResource m_backbuffer;
+    RenderGraphResource m_depthBuffer;
+    std::array<std::unique_ptr<VulkanDescriptorAllocator>, VulkanSwapchain::MAX_FRAMES_IN_FLIGHT>
+      m_frameDescriptorAllocators;
     VulkanShaderManager *m_shaderManager;
     VulkanPipelineManager *m_pipelineManager;
     std::vector<vk::CommandBuffer> m_commandBuffers;
+    std::array<VulkanDynamicStateTracker, VulkanSwapchain::MAX_FRAMES_IN_FLIGHT> m_dynamicStateTrackers;
+    // Between beginSecondaryRendering and endSecondaryRendering
+    vk::CommandBuffer m_secondaryCommandBuffer;
+    VulkanDynamicStateTracker m_secondaryStateTracker;
+
+    SwapchainPolicy m_swapchainPolicy;
+    bool m_swapchainPolicyChanged = false;
 
     uint32_t m_currentImageIndex = 0;
     size_t m_currentFrameIndex = 0;